@@ -37,6 +37,7 @@
 
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
+#include "util/disk_cache_os.h"
 
 bool error = false;
 
@@ -516,6 +517,260 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+
+/* Fills the buffer with bytes that don't compress, so that the size an
+ * item takes in the cache is close to its own size.
+ */
+static void
+fill_incompressible(uint8_t *buf, size_t size, uint32_t seed)
+{
+   for (size_t i = 0; i < size; i++) {
+      seed = seed * 1103515245 + 12345;
+      buf[i] = seed >> 16;
+   }
+}
+
+static void
+test_put_and_get_database(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   uint8_t item_a[600], item_b[600];
+   uint8_t item_a_key[20], item_b_key[20];
+   char *result;
+   size_t size;
+   int count;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   setenv("MESA_DISK_CACHE_DATABASE", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+
+   cache = disk_cache_create("test", "make_check_db", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+
+   /* Ensure that disk_cache_get returns nothing before anything is added. */
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_null(result, "database disk_cache_get with non-existent item (pointer)");
+   expect_equal(size, 0, "database disk_cache_get with non-existent item (size)");
+
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+
+   /* disk_cache_put() hands things off to a thread so wait for it. */
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "database disk_cache_get of existing item (pointer)");
+   expect_equal(size, sizeof(blob), "database disk_cache_get of existing item (size)");
+   free(result);
+
+   result = disk_cache_get(cache, string_key, &size);
+   expect_equal_str(string, result, "database 2nd disk_cache_get of existing item (pointer)");
+   expect_equal(size, sizeof(string), "database 2nd disk_cache_get of existing item (size)");
+   free(result);
+
+   /* Items must survive the cache being destroyed and created again. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check_db", 0);
+
+   count = 0;
+   if (does_cache_contain(cache, blob_key))
+      count++;
+
+   if (does_cache_contain(cache, string_key))
+      count++;
+
+   expect_equal(count, 2, "database items persist across disk_cache_create");
+
+   /* Removed items must be gone. */
+   disk_cache_remove(cache, blob_key);
+   expect_false(does_cache_contain(cache, blob_key),
+                "database disk_cache_remove");
+
+   /* With a 1KB cache, the second of two 600 byte items evicts the first. */
+   disk_cache_destroy(cache);
+
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1K", 1);
+   cache = disk_cache_create("test", "make_check_db", 0);
+
+   fill_incompressible(item_a, sizeof(item_a), 1);
+   fill_incompressible(item_b, sizeof(item_b), 2);
+   disk_cache_compute_key(cache, item_a, sizeof(item_a), item_a_key);
+   disk_cache_compute_key(cache, item_b, sizeof(item_b), item_b_key);
+
+   disk_cache_put(cache, item_a_key, item_a, sizeof(item_a), NULL);
+   disk_cache_wait_for_idle(cache);
+   expect_true(does_cache_contain(cache, item_a_key),
+               "database disk_cache_put of item smaller than MAX_SIZE");
+
+   disk_cache_put(cache, item_b_key, item_b, sizeof(item_b), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   result = disk_cache_get(cache, item_b_key, &size);
+   expect_non_null(result, "database disk_cache_get after eviction (pointer)");
+   expect_equal(size, sizeof(item_b), "database disk_cache_get after eviction (size)");
+   expect_true(result && memcmp(result, item_b, sizeof(item_b)) == 0,
+               "database disk_cache_get after eviction (data)");
+   free(result);
+
+   expect_false(does_cache_contain(cache, item_a_key),
+                "database disk_cache_put eviction with MAX_SIZE=1K");
+
+   /* Growing the cache back keeps what it held. */
+   disk_cache_destroy(cache);
+
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   cache = disk_cache_create("test", "make_check_db", 0);
+
+   expect_true(does_cache_contain(cache, item_b_key),
+               "database items persist across a MAX_SIZE change");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_DATABASE");
+}
+
+static void
+test_get_batch(enum disk_cache_type type)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   char string[] = "While this string has thirty-four";
+   const char *items[] = { blob, string };
+   const size_t sizes[] = { sizeof(blob), sizeof(string) };
+   struct disk_cache_get_job *jobs[3];
+   cache_key keys[3];
+   char *result;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   cache = disk_cache_type_create("test", "make_check_batch", 0, type);
+
+   for (unsigned i = 0; i < 2; i++) {
+      disk_cache_compute_key(cache, items[i], sizes[i], keys[i]);
+      disk_cache_put(cache, keys[i], items[i], sizes[i], NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+
+   /* Never stored */
+   disk_cache_compute_key(cache, keys, sizeof(keys[0]) * 2, keys[2]);
+
+   disk_cache_get_batch(cache, keys, 3, jobs);
+
+   for (unsigned i = 0; i < 2; i++) {
+      result = disk_cache_get_job_finish(jobs[i], &size);
+      expect_equal_str(items[i], result, "disk_cache_get_batch of existing item (pointer)");
+      expect_equal(size, sizes[i], "disk_cache_get_batch of existing item (size)");
+      free(result);
+   }
+
+   result = disk_cache_get_job_finish(jobs[2], &size);
+   expect_null(result, "disk_cache_get_batch with non-existent item (pointer)");
+   expect_equal(size, 0, "disk_cache_get_batch with non-existent item (size)");
+
+   /* Jobs may still be queued behind puts */
+   jobs[0] = disk_cache_get_async(cache, keys[1]);
+   disk_cache_put(cache, keys[2], blob, sizeof(blob), NULL);
+   jobs[1] = disk_cache_get_async(cache, keys[1]);
+
+   for (unsigned i = 0; i < 2; i++) {
+      result = disk_cache_get_job_finish(jobs[i], &size);
+      expect_equal_str(string, result, "disk_cache_get_async with puts queued (pointer)");
+      expect_equal(size, sizeof(string), "disk_cache_get_async with puts queued (size)");
+      free(result);
+   }
+
+   disk_cache_destroy(cache);
+}
+
+static void
+test_read_only_dbs(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   uint8_t put_key[20];
+   const char *capture_dir = CACHE_TEST_TMP "/capture/" CACHE_DIR_NAME;
+   char *result;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   /* Fill a cache in files, as a capture run would */
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/capture", 1);
+   cache = disk_cache_create("test", "make_check_ro", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   /* Keys only, as the GLSL compiler stores for each shader it compiled */
+   disk_cache_compute_key(cache, string, sizeof(string), put_key);
+   put_key[0] ^= 0xff;
+   disk_cache_put_key(cache, put_key);
+
+   disk_cache_destroy(cache);
+
+   expect_equal(disk_cache_pack(CACHE_TEST_TMP "/pack", &capture_dir, 1), 2,
+                "disk_cache_pack of a cache in files");
+
+   /* A fresh cache finds the entry in the pack */
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/fresh", 1);
+   setenv("MESA_DISK_CACHE_READ_ONLY_DIRS",
+          CACHE_TEST_TMP "/missing:" CACHE_TEST_TMP "/pack", 1);
+   cache = disk_cache_create("test", "make_check_ro", 0);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "disk_cache_get from a read-only cache (pointer)");
+   expect_equal(size, sizeof(blob), "disk_cache_get from a read-only cache (size)");
+   free(result);
+
+   expect_true(disk_cache_has_key(cache, put_key),
+               "disk_cache_has_key from a read-only cache");
+   expect_false(disk_cache_get(cache, put_key, NULL),
+                "disk_cache_get of a key without a blob from a read-only cache");
+
+   /* New entries go to the writable cache, where the entries of the pack
+    * can't be removed.
+    */
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   expect_true(does_cache_contain(cache, string_key),
+               "disk_cache_put with read-only caches");
+
+   disk_cache_remove(cache, blob_key);
+   expect_true(does_cache_contain(cache, blob_key),
+               "disk_cache_remove leaves read-only caches alone");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_READ_ONLY_DIRS");
+   cache = disk_cache_create("test", "make_check_ro", 0);
+
+   expect_false(does_cache_contain(cache, blob_key),
+                "read-only cache entries don't land in the writable cache");
+   expect_true(does_cache_contain(cache, string_key),
+               "writable cache entries with read-only caches persist");
+
+   disk_cache_destroy(cache);
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 int
@@ -530,6 +785,14 @@ main(void)
 
    test_put_key_and_get_key();
 
+   test_put_and_get_database();
+
+   test_get_batch(DISK_CACHE_MULTI_FILE);
+
+   test_get_batch(DISK_CACHE_DATABASE);
+
+   test_read_only_dbs();
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
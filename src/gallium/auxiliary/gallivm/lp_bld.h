@@ -87,4 +87,10 @@
 #define GALLIVM_HAVE_CORO 0
 #endif
 
+#if LLVM_VERSION_MAJOR >= 13
+#define GALLIVM_HAVE_ORCJIT 1
+#else
+#define GALLIVM_HAVE_ORCJIT 0
+#endif
+
 #endif /* LP_BLD_H */
@@ -54,6 +54,10 @@
 
 unsigned gallivm_perf = 0;
 
+#if GALLIVM_HAVE_ORCJIT
+static boolean gallivm_use_orcjit = FALSE;
+#endif
+
 static const struct debug_named_value lp_bld_perf_flags[] = {
    { "no_brilinear", GALLIVM_PERF_NO_BRILINEAR, "disable brilinear optimization" },
    { "no_rho_approx", GALLIVM_PERF_NO_RHO_APPROX, "disable rho_approx optimization" },
@@ -146,7 +150,7 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMAddCoroElidePass(gallivm->cgpassmgr);
 #endif
 
-   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0) {
+   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0 && !gallivm->no_opt) {
       /*
        * TODO: Evaluate passes some more - keeping in mind
        * both quality of generated code and compile times.
@@ -250,6 +254,10 @@ gallivm_free_code(struct gallivm_state *gallivm)
 {
    assert(!gallivm->module);
    assert(!gallivm->engine);
+#if GALLIVM_HAVE_ORCJIT
+   lp_build_orc_free_module(gallivm->orc_module);
+   gallivm->orc_module = NULL;
+#endif
    lp_free_generated_code(gallivm->code);
    gallivm->code = NULL;
    lp_free_memory_manager(gallivm->memorymgr);
@@ -265,7 +273,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if ((gallivm_perf & GALLIVM_PERF_NO_OPT) || gallivm->no_opt) {
          optlevel = None;
       }
       else {
@@ -314,6 +322,35 @@ fail:
 }
 
 
+#if GALLIVM_HAVE_ORCJIT
+/**
+ * Compile the module into the process wide ORC session instead of an
+ * execution engine of its own.
+ */
+static boolean
+init_gallivm_orc(struct gallivm_state *gallivm)
+{
+   enum LLVM_CodeGenOpt_Level optlevel;
+   char *error = NULL;
+
+   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) || gallivm->no_opt)
+      optlevel = None;
+   else
+      optlevel = Default;
+
+   if (lp_build_orc_add_module(&gallivm->orc_module, gallivm->cache,
+                               gallivm->module, (unsigned) optlevel,
+                               &error)) {
+      _debug_printf("%s, falling back to MCJIT\n", error);
+      free(error);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+#endif
+
+
 /**
  * Allocate gallivm LLVM objects.
  * \return  TRUE for success, FALSE for failure
@@ -426,6 +463,10 @@ lp_build_init(void)
 
    gallivm_perf = debug_get_flags_option("GALLIVM_PERF", lp_bld_perf_flags, 0 );
 
+#if GALLIVM_HAVE_ORCJIT
+   gallivm_use_orcjit = debug_get_bool_option("GALLIVM_ORCJIT", FALSE);
+#endif
+
    lp_set_target_options();
 
    util_cpu_detect();
@@ -524,6 +565,30 @@ gallivm_create(const char *name, LLVMContextRef context,
 }
 
 
+/**
+ * Create a new gallivm_state object whose module gets neither optimization
+ * passes nor an optimizing code generator, as with GALLIVM_PERF=nopt, for
+ * code that has to be ready soon more than it has to run fast.
+ */
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context)
+{
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      gallivm->no_opt = TRUE;
+      if (!init_gallivm_state(gallivm, name, context, NULL)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   assert(gallivm != NULL);
+   return gallivm;
+}
+
+
 /**
  * Destroy a gallivm_state object.
  */
@@ -561,6 +626,38 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 }
 
 
+static void *
+gallivm_get_pointer_to_function(struct gallivm_state *gallivm,
+                                LLVMValueRef func)
+{
+#if GALLIVM_HAVE_ORCJIT
+   if (gallivm->orc_module)
+      return lp_build_orc_lookup(gallivm->orc_module, LLVMGetValueName(func));
+#endif
+   return LLVMGetPointerToGlobal(gallivm->engine, func);
+}
+
+
+/**
+ * Make a declared global of the module resolve to addr. Must be done after
+ * gallivm_compile_module() and before jitting any function.
+ */
+void
+gallivm_add_global_mapping(struct gallivm_state *gallivm,
+                           LLVMValueRef global, void *addr)
+{
+#if GALLIVM_HAVE_ORCJIT
+   if (gallivm->orc_module) {
+      lp_build_orc_define_symbol(gallivm->orc_module,
+                                 LLVMGetValueName(global), addr);
+      return;
+   }
+#endif
+   assert(gallivm->engine);
+   LLVMAddGlobalMapping(gallivm->engine, global, addr);
+}
+
+
 /**
  * Compile a module.
  * This does IR optimization on all functions in the module.
@@ -650,17 +747,22 @@ gallivm_compile_module(struct gallivm_state *gallivm)
     * lp_build_create_jit_compiler_for_module()
     */
  skip_cached:
-   LLVMSetDataLayout(gallivm->module, "");
-   assert(!gallivm->engine);
-   if (!init_gallivm_engine(gallivm)) {
-      assert(0);
+#if GALLIVM_HAVE_ORCJIT
+   if (!gallivm_use_orcjit || !init_gallivm_orc(gallivm))
+#endif
+   {
+      LLVMSetDataLayout(gallivm->module, "");
+      assert(!gallivm->engine);
+      if (!init_gallivm_engine(gallivm)) {
+         assert(0);
+      }
+      assert(gallivm->engine);
    }
-   assert(gallivm->engine);
 
    ++gallivm->compiled;
 
    if (gallivm->debug_printf_hook)
-      LLVMAddGlobalMapping(gallivm->engine, gallivm->debug_printf_hook, debug_printf);
+      gallivm_add_global_mapping(gallivm, gallivm->debug_printf_hook, debug_printf);
 
    if (gallivm_debug & GALLIVM_DEBUG_ASM) {
       LLVMValueRef llvm_func = LLVMGetFirstFunction(gallivm->module);
@@ -672,7 +774,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
           * LLVMGetPointerToGlobal() will abort otherwise.
           */
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = gallivm_get_pointer_to_function(gallivm, llvm_func);
             lp_disassemble(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -685,7 +787,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
       while (llvm_func) {
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = gallivm_get_pointer_to_function(gallivm, llvm_func);
             lp_profile(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -705,12 +807,12 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    int64_t time_begin = 0;
 
    assert(gallivm->compiled);
-   assert(gallivm->engine);
+   assert(gallivm->engine || gallivm->orc_module);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   code = gallivm_get_pointer_to_function(gallivm, func);
    assert(code);
    jit_func = pointer_to_func(code);
 
@@ -65,6 +65,16 @@
 #include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/Support/TargetSelect.h>
 
+#if LLVM_VERSION_MAJOR >= 13
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <atomic>
+#endif
+
 #if LLVM_VERSION_MAJOR < 11
 #include <llvm/IR/CallSite.h>
 #endif
@@ -321,60 +331,15 @@ public:
 };
 
 /**
- * Same as LLVMCreateJITCompilerForModule, but:
- * - allows using MCJIT and enabling AVX feature where available.
- * - set target options
- *
- * See also:
- * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
- * - llvm/tools/lli/lli.cpp
- * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ * Host CPU name and feature attributes to generate code for, shared by the
+ * MCJIT and ORC backends.
  */
-extern "C"
-LLVMBool
-lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
-                                        lp_generated_code **OutCode,
-                                        struct lp_cached_code *cache_out,
-                                        LLVMModuleRef M,
-                                        LLVMMCJITMemoryManagerRef CMM,
-                                        unsigned OptLevel,
-                                        char **OutError)
+static void
+lp_build_get_host_target(llvm::SmallVectorImpl<std::string> &MAttrs,
+                         std::string &MCPU)
 {
    using namespace llvm;
 
-   std::string Error;
-   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
-
-   /**
-    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
-    * friends for configuring code generation options, like stack alignment.
-    */
-   TargetOptions options;
-#if defined(PIPE_ARCH_X86)
-   options.StackAlignmentOverride = 4;
-#endif
-
-   builder.setEngineKind(EngineKind::JIT)
-          .setErrorStr(&Error)
-          .setTargetOptions(options)
-          .setOptLevel((CodeGenOpt::Level)OptLevel);
-
-#ifdef _WIN32
-    /*
-     * MCJIT works on Windows, but currently only through ELF object format.
-     *
-     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
-     * different strings for MinGW/MSVC, so better play it safe and be
-     * explicit.
-     */
-#  ifdef _WIN64
-    LLVMSetTarget(M, "x86_64-pc-win32-elf");
-#  else
-    LLVMSetTarget(M, "i686-pc-win32-elf");
-#  endif
-#endif
-
-   llvm::SmallVector<std::string, 16> MAttrs;
 
 #if LLVM_VERSION_MAJOR >= 4 && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64) || defined(PIPE_ARCH_ARM))
    /* llvm-3.3+ implements sys::getHostCPUFeatures for Arm
@@ -464,8 +429,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 #endif
 #endif
 
-   builder.setMAttrs(MAttrs);
-
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       int n = MAttrs.size();
       if (n > 0) {
@@ -476,7 +439,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       }
    }
 
-   StringRef MCPU = llvm::sys::getHostCPUName();
+   MCPU = llvm::sys::getHostCPUName().str();
    /*
     * The cpu bits are no longer set automatically, so need to set mcpu manually.
     * Note that the MAttrs set above will be sort of ignored (since we should
@@ -491,17 +454,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
     */
 
 #ifdef PIPE_ARCH_PPC_64
-   /*
-    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
-    * of the Medium code model once dynamically generated JIT-compiled shader
-    * programs are linked in and relocated.  Yet the default code model as of
-    * LLVM 8 is Medium or even Small.
-    * The cost of changing from Medium to Large is negligible:
-    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
-    * - change an add-immediate (addis) instruction to a load (ld).
-    */
-   builder.setCodeModel(CodeModel::Large);
-
 #if UTIL_ARCH_LITTLE_ENDIAN
    /*
     * Versions of LLVM prior to 4.0 lacked a table entry for "POWER8NVL",
@@ -516,10 +468,84 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       MCPU = "pwr8";
 #endif
 #endif
-   builder.setMCPU(MCPU);
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
-      debug_printf("llc -mcpu option: %s\n", MCPU.str().c_str());
+      debug_printf("llc -mcpu option: %s\n", MCPU.c_str());
    }
+}
+
+/**
+ * Same as LLVMCreateJITCompilerForModule, but:
+ * - allows using MCJIT and enabling AVX feature where available.
+ * - set target options
+ *
+ * See also:
+ * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
+ * - llvm/tools/lli/lli.cpp
+ * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ */
+extern "C"
+LLVMBool
+lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
+                                        lp_generated_code **OutCode,
+                                        struct lp_cached_code *cache_out,
+                                        LLVMModuleRef M,
+                                        LLVMMCJITMemoryManagerRef CMM,
+                                        unsigned OptLevel,
+                                        char **OutError)
+{
+   using namespace llvm;
+
+   std::string Error;
+   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
+
+   /**
+    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
+    * friends for configuring code generation options, like stack alignment.
+    */
+   TargetOptions options;
+#if defined(PIPE_ARCH_X86)
+   options.StackAlignmentOverride = 4;
+#endif
+
+   builder.setEngineKind(EngineKind::JIT)
+          .setErrorStr(&Error)
+          .setTargetOptions(options)
+          .setOptLevel((CodeGenOpt::Level)OptLevel);
+
+#ifdef _WIN32
+    /*
+     * MCJIT works on Windows, but currently only through ELF object format.
+     *
+     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
+     * different strings for MinGW/MSVC, so better play it safe and be
+     * explicit.
+     */
+#  ifdef _WIN64
+    LLVMSetTarget(M, "x86_64-pc-win32-elf");
+#  else
+    LLVMSetTarget(M, "i686-pc-win32-elf");
+#  endif
+#endif
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   std::string MCPU;
+
+   lp_build_get_host_target(MAttrs, MCPU);
+   builder.setMAttrs(MAttrs);
+
+#ifdef PIPE_ARCH_PPC_64
+   /*
+    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
+    * of the Medium code model once dynamically generated JIT-compiled shader
+    * programs are linked in and relocated.  Yet the default code model as of
+    * LLVM 8 is Medium or even Small.
+    * The cost of changing from Medium to Large is negligible:
+    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
+    * - change an add-immediate (addis) instruction to a load (ld).
+    */
+   builder.setCodeModel(CodeModel::Large);
+#endif
+   builder.setMCPU(MCPU);
 
    ShaderMemoryManager *MM = NULL;
    BaseMemoryManager* JMM = reinterpret_cast<BaseMemoryManager*>(CMM);
@@ -585,6 +611,238 @@ lp_free_objcache(void *objcache_ptr)
    delete objcache;
 }
 
+#if GALLIVM_HAVE_ORCJIT
+
+/*
+ * ORC backend: a single LLJIT, so a single execution session and JIT
+ * memory, for the whole process.
+ *
+ * Modules are compiled to objects on the calling thread, as their
+ * LLVMContext is shared with the other variants of the same context and
+ * can't be handed to another thread. This rules out LLJIT's own compile
+ * threads, which need the IR in a ThreadSafeContext they own. Threads that
+ * build modules in contexts of their own, like the background fragment
+ * shader compiles, can call in concurrently: only the session is shared,
+ * and it does its own locking. Each object goes into a JITDylib of its
+ * own: variants reuse function names, and dropping the dylib frees the
+ * code. Linking happens at the first lookup.
+ */
+
+struct lp_orc_module {
+   llvm::orc::JITDylib *dylib;
+};
+
+static once_flag lp_orc_once_flag = ONCE_FLAG_INIT;
+static llvm::orc::LLJIT *lp_orc_jit;
+static llvm::orc::JITTargetMachineBuilder *lp_orc_jtmb;
+static std::atomic<unsigned> lp_orc_num_dylibs;
+
+static void
+lp_orc_report(llvm::Error Err, const char *what)
+{
+   std::string msg = llvm::toString(std::move(Err));
+   _debug_printf("gallivm: %s: %s\n", what, msg.c_str());
+}
+
+static void
+lp_orc_init(void)
+{
+   using namespace llvm;
+   using namespace llvm::orc;
+
+   SmallVector<std::string, 16> MAttrs;
+   std::string MCPU;
+
+   lp_build_get_host_target(MAttrs, MCPU);
+
+   auto JTMB = JITTargetMachineBuilder::detectHost();
+   if (!JTMB) {
+      lp_orc_report(JTMB.takeError(), "ORC target detection failed");
+      return;
+   }
+
+   TargetOptions options;
+#if defined(PIPE_ARCH_X86)
+   options.StackAlignmentOverride = 4;
+#endif
+
+   JTMB->setCPU(MCPU);
+   JTMB->addFeatures(std::vector<std::string>(MAttrs.begin(), MAttrs.end()));
+   JTMB->setOptions(options);
+#ifdef PIPE_ARCH_PPC_64
+   /* See lp_build_create_jit_compiler_for_module() */
+   JTMB->setCodeModel(CodeModel::Large);
+#endif
+
+   auto J = LLJITBuilder()
+               .setJITTargetMachineBuilder(*JTMB)
+               .create();
+   if (!J) {
+      lp_orc_report(J.takeError(), "ORC LLJIT creation failed");
+      return;
+   }
+
+   /* Resolve libc/libm calls the same way MCJIT does */
+   auto Gen = DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*J)->getDataLayout().getGlobalPrefix());
+   if (!Gen) {
+      lp_orc_report(Gen.takeError(), "ORC process symbols unavailable");
+      return;
+   }
+   (*J)->getMainJITDylib().addGenerator(std::move(*Gen));
+
+   /* Both live until exit, like the native target registration */
+   lp_orc_jtmb = new JITTargetMachineBuilder(std::move(*JTMB));
+   lp_orc_jit = J->release();
+}
+
+static llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>>
+lp_orc_compile(llvm::Module *M, unsigned OptLevel)
+{
+   using namespace llvm;
+   using namespace llvm::orc;
+
+   JITTargetMachineBuilder JTMB = *lp_orc_jtmb;
+   JTMB.setCodeGenOptLevel((CodeGenOpt::Level)OptLevel);
+
+   auto TM = JTMB.createTargetMachine();
+   if (!TM)
+      return TM.takeError();
+
+   M->setDataLayout((*TM)->createDataLayout());
+   M->setTargetTriple((*TM)->getTargetTriple().str());
+
+   SmallVector<char, 0> buffer;
+   raw_svector_ostream os(buffer);
+   legacy::PassManager PM;
+
+   if ((*TM)->addPassesToEmitFile(PM, os, nullptr, CGFT_ObjectFile))
+      return make_error<StringError>("cannot emit objects",
+                                     inconvertibleErrorCode());
+   PM.run(*M);
+
+   return MemoryBuffer::getMemBufferCopy(StringRef(buffer.data(),
+                                                   buffer.size()),
+                                         M->getModuleIdentifier());
+}
+
+/**
+ * Compile the module, or take its object from the cache, and add it to the
+ * shared session. Code is only linked when first looked up.
+ */
+extern "C" LLVMBool
+lp_build_orc_add_module(struct lp_orc_module **OutModule,
+                        struct lp_cached_code *cache_out,
+                        LLVMModuleRef M,
+                        unsigned OptLevel,
+                        char **OutError)
+{
+   using namespace llvm;
+
+   call_once(&lp_orc_once_flag, lp_orc_init);
+   if (!lp_orc_jit) {
+      *OutError = strdup("ORC JIT unavailable");
+      return 1;
+   }
+
+   Module *mod = unwrap(M);
+   std::unique_ptr<MemoryBuffer> obj;
+
+   if (cache_out && cache_out->data_size) {
+      obj = MemoryBuffer::getMemBufferCopy(
+         StringRef((const char *)cache_out->data, cache_out->data_size),
+         mod->getModuleIdentifier());
+   } else {
+      auto compiled = lp_orc_compile(mod, OptLevel);
+      if (!compiled) {
+         *OutError = strdup(toString(compiled.takeError()).c_str());
+         return 1;
+      }
+      obj = std::move(*compiled);
+
+      if (cache_out) {
+         cache_out->data_size = obj->getBufferSize();
+         cache_out->data = malloc(cache_out->data_size);
+         memcpy(cache_out->data, obj->getBufferStart(), cache_out->data_size);
+      }
+   }
+
+   auto &ES = lp_orc_jit->getExecutionSession();
+   std::string name = mod->getModuleIdentifier() + "." +
+                      std::to_string(lp_orc_num_dylibs++);
+   auto JD = ES.createJITDylib(name);
+   if (!JD) {
+      *OutError = strdup(toString(JD.takeError()).c_str());
+      return 1;
+   }
+   JD->addToLinkOrder(lp_orc_jit->getMainJITDylib());
+
+   if (auto Err = lp_orc_jit->addObjectFile(*JD, std::move(obj))) {
+      *OutError = strdup(toString(std::move(Err)).c_str());
+      cantFail(ES.removeJITDylib(*JD));
+      return 1;
+   }
+
+   *OutModule = new lp_orc_module { &*JD };
+   return 0;
+}
+
+/**
+ * Equivalent of LLVMAddGlobalMapping(), must happen before the first lookup.
+ */
+extern "C" void
+lp_build_orc_define_symbol(struct lp_orc_module *module,
+                           const char *name, void *addr)
+{
+   using namespace llvm;
+   using namespace llvm::orc;
+
+   SymbolMap symbols;
+#if LLVM_VERSION_MAJOR >= 17
+   symbols[lp_orc_jit->mangleAndIntern(name)] =
+      ExecutorSymbolDef(ExecutorAddr::fromPtr(addr),
+                        JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+#else
+   symbols[lp_orc_jit->mangleAndIntern(name)] =
+      JITEvaluatedSymbol(pointerToJITTargetAddress(addr),
+                         JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+#endif
+
+   if (auto Err = module->dylib->define(absoluteSymbols(std::move(symbols))))
+      lp_orc_report(std::move(Err), "ORC symbol definition failed");
+}
+
+extern "C" void *
+lp_build_orc_lookup(struct lp_orc_module *module, const char *name)
+{
+   auto sym = lp_orc_jit->lookup(*module->dylib, name);
+   if (!sym) {
+      lp_orc_report(sym.takeError(), "ORC lookup failed");
+      return NULL;
+   }
+
+#if LLVM_VERSION_MAJOR >= 15
+   return sym->toPtr<void *>();
+#else
+   return llvm::jitTargetAddressToPointer<void *>(sym->getAddress());
+#endif
+}
+
+extern "C" void
+lp_build_orc_free_module(struct lp_orc_module *module)
+{
+   if (!module)
+      return;
+
+   auto &ES = lp_orc_jit->getExecutionSession();
+   if (auto Err = ES.removeJITDylib(*module->dylib))
+      lp_orc_report(std::move(Err), "ORC code release failed");
+
+   delete module;
+}
+
+#endif /* GALLIVM_HAVE_ORCJIT */
+
 extern "C" LLVMValueRef
 lp_get_called_value(LLVMValueRef call)
 {
@@ -91,6 +91,28 @@ lp_is_function(LLVMValueRef v);
 
 void
 lp_free_objcache(void *objcache);
+
+#if GALLIVM_HAVE_ORCJIT
+struct lp_orc_module;
+
+extern LLVMBool
+lp_build_orc_add_module(struct lp_orc_module **OutModule,
+                        struct lp_cached_code *cache_out,
+                        LLVMModuleRef M,
+                        unsigned OptLevel,
+                        char **OutError);
+
+extern void
+lp_build_orc_define_symbol(struct lp_orc_module *module,
+                           const char *name, void *addr);
+
+extern void *
+lp_build_orc_lookup(struct lp_orc_module *module, const char *name);
+
+extern void
+lp_build_orc_free_module(struct lp_orc_module *module);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
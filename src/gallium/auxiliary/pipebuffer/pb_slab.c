@@ -85,6 +85,35 @@ pb_slabs_reclaim_locked(struct pb_slabs *slabs)
    }
 }
 
+/* For slabs whose entries are all reclaimable at the same time: don't stop at
+ * the first entry that can't be reclaimed yet, as a busy slab must not hold
+ * back the entries of the others. can_reclaim is called once per slab and
+ * scan.
+ */
+static void
+pb_slabs_reclaim_by_slab_locked(struct pb_slabs *slabs)
+{
+   struct pb_slab_entry *entry, *next;
+
+   if (++slabs->reclaim_scan == 0)
+      slabs->reclaim_scan = 1;
+
+   LIST_FOR_EACH_ENTRY_SAFE(entry, next, &slabs->reclaim, head) {
+      struct pb_slab *slab = entry->slab;
+
+      if (slab->reclaim_scan != slabs->reclaim_scan) {
+         slab->reclaim_scan = slabs->reclaim_scan;
+         slab->reclaimable = slabs->can_reclaim(slabs->priv, entry);
+      }
+
+      /* Reclaiming the last entry frees the slab, but then no other entry
+       * of it is left on the list.
+       */
+      if (slab->reclaimable)
+         pb_slab_reclaim(slabs, entry);
+   }
+}
+
 /* Allocate a slab entry of the given size from the given heap.
  *
  * This will try to re-use entries that have previously been freed. However,
@@ -127,6 +156,20 @@ pb_slab_alloc(struct pb_slabs *slabs, unsigned size, unsigned heap)
       list_del(&slab->head);
    }
 
+   /* Before allocating a new slab, look past busy slabs for reusable entries.
+    */
+   if (slabs->reclaim_by_slab && list_is_empty(&group->slabs)) {
+      pb_slabs_reclaim_by_slab_locked(slabs);
+
+      while (!list_is_empty(&group->slabs)) {
+         slab = LIST_ENTRY(struct pb_slab, group->slabs.next, head);
+         if (!list_is_empty(&slab->free))
+            break;
+
+         list_del(&slab->head);
+      }
+   }
+
    if (list_is_empty(&group->slabs)) {
       /* Drop the mutex temporarily to prevent a deadlock where the allocation
        * calls back into slab functions (most likely to happen for
@@ -141,6 +184,7 @@ pb_slab_alloc(struct pb_slabs *slabs, unsigned size, unsigned heap)
          return NULL;
       mtx_lock(&slabs->mutex);
 
+      slab->reclaim_scan = 0;
       list_add(&slab->head, &group->slabs);
    }
 
@@ -212,6 +256,9 @@ pb_slabs_init(struct pb_slabs *slabs,
    slabs->slab_alloc = slab_alloc;
    slabs->slab_free = slab_free;
 
+   slabs->reclaim_by_slab = false;
+   slabs->reclaim_scan = 0;
+
    list_inithead(&slabs->reclaim);
 
    num_groups = slabs->num_orders * slabs->num_heaps;
@@ -76,6 +76,10 @@ struct pb_slab
    struct list_head free; /* list of free pb_slab_entry structures */
    unsigned num_free; /* number of entries in free list */
    unsigned num_entries; /* total number of entries */
+
+   /* can_reclaim result of the last scan, see pb_slabs::reclaim_by_slab */
+   unsigned reclaim_scan;
+   bool reclaimable;
 };
 
 /* Callback function that is called when a new slab needs to be allocated
@@ -125,6 +129,14 @@ struct pb_slabs
     */
    struct list_head reclaim;
 
+   /* Set by the user when can_reclaim only depends on the entry's slab. When
+    * a group runs out of entries, pb_slab_alloc then looks past busy slabs
+    * for reclaimable entries before allocating a new slab, calling
+    * can_reclaim once per slab.
+    */
+   bool reclaim_by_slab;
+   unsigned reclaim_scan;
+
    void *priv;
    slab_can_reclaim_fn *can_reclaim;
    slab_alloc_fn *slab_alloc;
@@ -227,7 +227,7 @@ _lima_resource_create_with_modifiers(struct pipe_screen *pscreen,
       res->tiled = should_tile;
 
       if (templat->bind & PIPE_BIND_INDEX_BUFFER)
-         res->index_cache = CALLOC_STRUCT(panfrost_minmax_cache);
+         res->index_cache = panfrost_minmax_cache_create(NULL, 0);
 
       debug_printf("%s: pres=%p width=%u height=%u depth=%u target=%d "
                    "bind=%x usage=%d tile=%d last_level=%d\n", __func__,
@@ -280,8 +280,7 @@ lima_resource_destroy(struct pipe_screen *pscreen, struct pipe_resource *pres)
    if (res->damage.region)
       FREE(res->damage.region);
 
-   if (res->index_cache)
-      FREE(res->index_cache);
+   panfrost_minmax_cache_destroy(res->index_cache);
 
    FREE(res);
 }
@@ -143,7 +143,8 @@ static void lp_draw_disk_cache_find_shader(void *cookie,
                                            unsigned char ir_sha1_cache_key[20])
 {
    struct llvmpipe_screen *screen = cookie;
-   lp_disk_cache_find_shader(screen, cache, ir_sha1_cache_key);
+   lp_disk_cache_find_shader(screen, LP_DISK_CACHE_DRAW, cache,
+                             ir_sha1_cache_key);
 }
 
 static void lp_draw_disk_cache_insert_shader(void *cookie,
@@ -54,6 +54,7 @@ struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
 struct lp_velems_state;
+struct disk_cache_get_job;
 
 struct llvmpipe_context {
    struct pipe_context pipe;  /**< base class */
@@ -159,6 +160,10 @@ struct llvmpipe_context {
    struct lp_setup_variant_list_item setup_variants_list;
    unsigned nr_setup_variants;
 
+   /** Disk cache lookup started by llvmpipe_prefetch_setup() */
+   struct disk_cache_get_job *setup_prefetch;
+   unsigned char setup_prefetch_key[20];
+
    /** List of all compute shader variants */
    struct lp_cs_variant_list_item cs_variants_list;
    unsigned nr_cs_variants;
@@ -30,17 +30,72 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
 #include "lp_cs_tpool.h"
+#include "lp_screen.h"
+
+/* A claim takes this fraction of what is left in the range, so chunks are
+ * large while a range is full and single iterations near its end, where
+ * the load balancing happens.
+ */
+#define LP_CS_TPOOL_CHUNK_DIVISOR 4
+
+static bool
+lp_cs_tpool_claim(struct lp_cs_tpool_range *range,
+                  unsigned *start, unsigned *count)
+{
+   unsigned next = p_atomic_read(&range->next);
+
+   while (next < range->end) {
+      unsigned chunk = MAX2(1, (range->end - next) / LP_CS_TPOOL_CHUNK_DIVISOR);
+      unsigned old = p_atomic_cmpxchg(&range->next, next, next + chunk);
+
+      if (old == next) {
+         *start = next;
+         *count = chunk;
+         return true;
+      }
+      next = old;
+   }
+
+   return false;
+}
+
+/**
+ * Run chunks of the task until none are left, own range first.
+ */
+static void
+lp_cs_tpool_run_task(struct lp_cs_tpool_task *task, unsigned thread_index,
+                     struct lp_cs_local_mem *lmem)
+{
+   for (unsigned i = 0; i < task->num_ranges; i++) {
+      struct lp_cs_tpool_range *range =
+         &task->ranges[(thread_index + i) % task->num_ranges];
+      unsigned start, count;
+
+      while (lp_cs_tpool_claim(range, &start, &count)) {
+         for (unsigned iter = start; iter < start + count; iter++)
+            task->work(task->data, iter, lmem);
+
+         p_atomic_add(&task->iter_finished, count);
+      }
+   }
+}
 
 static int
 lp_cs_tpool_worker(void *data)
 {
    struct lp_cs_tpool *pool = data;
    struct lp_cs_local_mem lmem;
+   unsigned thread_index;
 
    memset(&lmem, 0, sizeof(lmem));
    mtx_lock(&pool->m);
 
+   thread_index = pool->num_started++;
+   lp_set_thread_affinity(thread_index, pool->num_threads);
+
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
 
@@ -52,16 +107,20 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-      unsigned this_iter = task->iter_start++;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
+      task->num_workers++;
 
       mtx_unlock(&pool->m);
-      task->work(task->data, this_iter, &lmem);
+      lp_cs_tpool_run_task(task, thread_index, &lmem);
       mtx_lock(&pool->m);
-      task->iter_finished++;
-      if (task->iter_finished == task->iter_total)
+
+      /* Everything has been claimed, so don't hand the task out again. The
+       * waiter only frees it once no worker holds it any more.
+       */
+      if (!list_is_empty(&task->list))
+         list_delinit(&task->list);
+
+      if (--task->num_workers == 0 &&
+          p_atomic_read(&task->iter_finished) == task->iter_total)
          cnd_broadcast(&task->finish);
    }
    mtx_unlock(&pool->m);
@@ -82,6 +141,17 @@ lp_cs_tpool_create(unsigned num_threads)
 
    list_inithead(&pool->workqueue);
    assert (num_threads <= LP_MAX_THREADS);
+
+   if (num_threads) {
+      pool->threads = CALLOC(num_threads, sizeof(*pool->threads));
+      if (!pool->threads) {
+         cnd_destroy(&pool->new_work);
+         mtx_destroy(&pool->m);
+         FREE(pool);
+         return NULL;
+      }
+   }
+
    pool->num_threads = num_threads;
    for (unsigned i = 0; i < num_threads; i++)
       pool->threads[i] = u_thread_create(lp_cs_tpool_worker, pool);
@@ -105,6 +175,7 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
    FREE(pool);
 }
 
@@ -123,7 +194,11 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       }
       return NULL;
    }
-   task = CALLOC_STRUCT(lp_cs_tpool_task);
+   if (num_iters == 0)
+      return NULL;
+
+   task = CALLOC(1, sizeof(*task) +
+                    pool->num_threads * sizeof(struct lp_cs_tpool_range));
    if (!task) {
       return NULL;
    }
@@ -133,6 +208,14 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->iter_total = num_iters;
    cnd_init(&task->finish);
 
+   /* Fewer ranges than threads for small dispatches, idle threads steal */
+   task->num_ranges = CLAMP(num_iters, 1, pool->num_threads);
+   task->ranges = (struct lp_cs_tpool_range *)(task + 1);
+   for (unsigned i = 0; i < task->num_ranges; i++) {
+      task->ranges[i].next = (uint64_t)num_iters * i / task->num_ranges;
+      task->ranges[i].end = (uint64_t)num_iters * (i + 1) / task->num_ranges;
+   }
+
    mtx_lock(&pool->m);
 
    list_addtail(&task->list, &pool->workqueue);
@@ -152,7 +235,8 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
       return;
 
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (p_atomic_read(&task->iter_finished) < task->iter_total ||
+          task->num_workers)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
@@ -30,6 +30,11 @@
  * structs with just unique indexes in them.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
+ *
+ * The iterations of a task are split in one range per thread. Workers
+ * atomically claim chunks from their own range, which shrink as the range
+ * drains, then steal from the other ranges. The pool mutex is only taken
+ * to pick up and let go of a task, not per iteration.
  */
 #ifndef LP_CS_QUEUE
 #define LP_CS_QUEUE
@@ -45,8 +50,9 @@ struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
    unsigned num_threads;
+   unsigned num_started;   /**< for workers to pick their index */
    struct list_head workqueue;
    bool shutdown;
 };
@@ -58,14 +64,25 @@ struct lp_cs_local_mem {
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
 
+/* Padded to a cache line so that threads claiming from their own range
+ * don't bounce each other's.
+ */
+struct lp_cs_tpool_range {
+   unsigned next;
+   unsigned end;
+   char pad[64 - 2 * sizeof(unsigned)];
+};
+
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
    void *data;
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
+   unsigned iter_finished;   /**< atomic */
+   unsigned num_workers;     /**< workers holding the task, under pool->m */
+   unsigned num_ranges;
+   struct lp_cs_tpool_range *ranges;
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -39,11 +39,72 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_query.h"
+#include "lp_setup.h"
 
 #include "draw/draw_context.h"
 
 
 
+/**
+ * The draw module reads vertex and index buffers, runs the shaders before
+ * rasterization and writes stream output, on the CPU. Wait for flushed scenes
+ * that may still be writing any of the resources it reads, or still be
+ * accessing any of the resources it writes.
+ */
+static void
+llvmpipe_wait_vertex_inputs(struct llvmpipe_context *lp,
+                            const struct pipe_draw_info *info)
+{
+   static const enum pipe_shader_type stages[] = {
+      PIPE_SHADER_VERTEX,
+      PIPE_SHADER_GEOMETRY,
+      PIPE_SHADER_TESS_CTRL,
+      PIPE_SHADER_TESS_EVAL,
+   };
+   unsigned i, j;
+
+   for (i = 0; i < lp->num_vertex_buffers; i++) {
+      if (!lp->vertex_buffer[i].is_user_buffer)
+         lp_setup_wait_flushed_writes(lp->setup,
+                                      lp->vertex_buffer[i].buffer.resource);
+   }
+
+   if (info->index_size && !info->has_user_indices)
+      lp_setup_wait_flushed_writes(lp->setup, info->index.resource);
+
+   for (i = 0; i < ARRAY_SIZE(stages); i++) {
+      enum pipe_shader_type sh = stages[i];
+
+      for (j = 0; j < lp->num_sampler_views[sh]; j++) {
+         if (lp->sampler_views[sh][j])
+            lp_setup_wait_flushed_writes(lp->setup,
+                                         lp->sampler_views[sh][j]->texture);
+      }
+
+      for (j = 0; j < lp->num_images[sh]; j++) {
+         if (lp->images[sh][j].access & PIPE_IMAGE_ACCESS_WRITE)
+            lp_setup_wait_flushed_references(lp->setup,
+                                             lp->images[sh][j].resource);
+         else
+            lp_setup_wait_flushed_writes(lp->setup,
+                                         lp->images[sh][j].resource);
+      }
+
+      /* The writable mask of shader buffers isn't tracked, assume they are
+       * all written.
+       */
+      for (j = 0; j < ARRAY_SIZE(lp->ssbos[sh]); j++)
+         lp_setup_wait_flushed_references(lp->setup, lp->ssbos[sh][j].buffer);
+   }
+
+   for (i = 0; i < lp->num_so_targets; i++) {
+      if (lp->so_targets[i])
+         lp_setup_wait_flushed_references(lp->setup,
+                                          lp->so_targets[i]->target.buffer);
+   }
+}
+
+
 /**
  * Draw vertex arrays, with optional indexing, optional instancing.
  * All the other drawing functions are implemented in terms of this function.
@@ -79,6 +140,9 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
       return;
 
    if (indirect && indirect->buffer) {
+      /* The parameters are read back on the CPU. */
+      lp_setup_wait_flushed_writes(lp->setup, indirect->buffer);
+      lp_setup_wait_flushed_writes(lp->setup, indirect->indirect_draw_count);
       util_draw_indirect(pipe, info, indirect);
       return;
    }
@@ -86,6 +150,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   llvmpipe_wait_vertex_inputs(lp, info);
+
    /*
     * Map vertex buffers
     */
@@ -66,7 +66,11 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 16
+/**
+ * Upper bound on LP_NUM_THREADS. Per-thread state is sized at runtime for
+ * the actual number of threads.
+ */
+#define LP_MAX_THREADS 1024
 
 
 /**
@@ -53,13 +53,19 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
    assert(type < PIPE_QUERY_TYPES);
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* The per-thread counters follow the query */
+   pq = CALLOC(1, sizeof(*pq) + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
+      pq->num_threads = num_threads;
       pq->type = type;
       pq->index = index;
    }
@@ -225,8 +231,12 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
    else {
       unsigned i;
 
-      if (unflushed) {
-         llvmpipe_flush(pipe, NULL, __FUNCTION__);
+      /* With several scenes in flight, a flushed one may still be
+       * rasterizing and writing the results.
+       */
+      if (unsignalled) {
+         if (unflushed)
+            llvmpipe_flush(pipe, NULL, __FUNCTION__);
 
          if (!wait)
             return;
@@ -366,17 +376,21 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
-   /* Check if the query is already in the scene.  If so, we need to
-    * flush the scene now.  Real apps shouldn't re-use a query in a
-    * frame of rendering.
+   /* Check if the query is already in a scene.  If so, we need to
+    * flush the scene now, and wait for it as flushed scenes may still be
+    * rasterizing.  Real apps shouldn't re-use a query in a frame of
+    * rendering.
     */
-   if (pq->fence && !lp_fence_issued(pq->fence)) {
-      llvmpipe_finish(pipe, __FUNCTION__);
+   if (pq->fence && !lp_fence_signalled(pq->fence)) {
+      if (!lp_fence_issued(pq->fence))
+         llvmpipe_flush(pipe, NULL, __FUNCTION__);
+
+      lp_fence_wait(pq->fence);
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, pq->num_threads * sizeof(*pq->end));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -47,6 +47,7 @@
 #include "gallivm/lp_bld_format.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_scene.h"
+#include "lp_screen.h"
 #include "lp_tex_sample.h"
 
 
@@ -74,16 +75,29 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, MAX2(1, rast->num_threads) );
 }
 
 
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+   struct lp_fence *fence = NULL;
+
+   /* The setup may reuse the scene as soon as the fence signals, so only
+    * signal it once the scene has been reset.
+    */
+   lp_fence_reference(&fence, scene->fence);
+
+   lp_scene_end_rasterization( scene );
 
    rast->curr_scene = NULL;
+
+   if (fence) {
+      lp_fence_signal(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 }
 
 
@@ -691,20 +705,6 @@ rasterize_bin(struct lp_rasterizer_task *task,
 }
 
 
-/* An empty bin is one that just loads the contents of the tile and
- * stores them again unchanged.  This typically happens when bins have
- * been flushed for some reason in the middle of a frame, or when
- * incremental updates are being made to a render target.
- * 
- * Try to avoid doing pointless work in this case.
- */
-static boolean
-is_empty_bin( const struct cmd_bin *bin )
-{
-   return bin->head == NULL;
-}
-
-
 /**
  * Rasterize/execute all bins within a scene.
  * Called per thread.
@@ -733,9 +733,9 @@ rasterize_scene(struct lp_rasterizer_task *task,
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin( bin ))
-               rasterize_bin(task, bin, i, j);
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j))) {
+            rasterize_bin(task, bin, i, j);
          }
       }
    }
@@ -755,10 +755,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -807,29 +803,12 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. thread[0] ends the scene and signals its fence
  */
 static int
 thread_function(void *init_data)
@@ -843,6 +822,8 @@ thread_function(void *init_data)
    snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    u_thread_setname(thread_name);
 
+   lp_set_thread_affinity(task->thread_index, rast->num_threads);
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -882,17 +863,12 @@ thread_function(void *init_data)
       /* wait for all threads to finish with this scene */
       util_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
-       */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -942,6 +918,12 @@ lp_rast_create( unsigned num_threads )
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof(*rast->tasks));
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof(*rast->threads));
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
@@ -974,7 +956,7 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
@@ -982,6 +964,9 @@ no_thread_data_cache:
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+no_tasks:
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 no_rast:
    return NULL;
@@ -1030,6 +1015,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
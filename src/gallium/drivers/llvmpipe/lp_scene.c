@@ -29,6 +29,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/simple_list.h"
 #include "util/format/u_format.h"
 #include "lp_scene.h"
@@ -36,6 +37,7 @@
 #include "lp_debug.h"
 #include "lp_context.h"
 #include "lp_state_fs.h"
+#include "lp_screen.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -43,6 +45,7 @@
 /** List of resource references */
 struct resource_ref {
    struct pipe_resource *resource[RESOURCE_REF_SZ];
+   boolean writeable[RESOURCE_REF_SZ];
    int count;
    struct resource_ref *next;
 };
@@ -69,6 +72,15 @@ lp_scene_create( struct pipe_context *pipe )
 
    scene->pipe = pipe;
 
+   /* One range per rasterizer thread */
+   scene->max_bin_ranges = MAX2(1, llvmpipe_screen(pipe->screen)->num_threads);
+   scene->bin_ranges = CALLOC(scene->max_bin_ranges,
+                              sizeof(*scene->bin_ranges));
+   if (!scene->bin_ranges) {
+      FREE(scene);
+      return NULL;
+   }
+
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
@@ -103,6 +115,7 @@ lp_scene_destroy(struct lp_scene *scene)
    mtx_destroy(&scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
+   FREE(scene->bin_ranges);
    FREE(scene);
 }
 
@@ -228,6 +241,11 @@ lp_scene_end_rasterization(struct lp_scene *scene )
 {
    int i, j;
 
+   /* The setup may be checking the references of the scene concurrently,
+    * see lp_scene_is_resource_referenced().
+    */
+   mtx_lock(&scene->mutex);
+
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->cbufs[i].map) {
@@ -322,8 +340,7 @@ lp_scene_end_rasterization(struct lp_scene *scene )
       list->head->used = 0;
    }
 
-   lp_fence_reference(&scene->fence, NULL);
-
+   /* The fence is released by the setup, which may still be waiting on it */
    scene->resources = NULL;
    scene->frag_shaders = NULL;
    scene->scene_size = 0;
@@ -332,6 +349,8 @@ lp_scene_end_rasterization(struct lp_scene *scene )
    scene->alloc_failed = FALSE;
 
    util_unreference_framebuffer_state( &scene->fb );
+
+   mtx_unlock(&scene->mutex);
 }
 
 
@@ -404,11 +423,13 @@ lp_scene_data_size( const struct lp_scene *scene )
 
 /**
  * Add a reference to a resource by the scene.
+ * \param writeable  whether the scene's shaders may write to the resource
  */
 boolean
 lp_scene_add_resource_reference(struct lp_scene *scene,
                                 struct pipe_resource *resource,
-                                boolean initializing_scene)
+                                boolean initializing_scene,
+                                boolean writeable)
 {
    struct resource_ref *ref, **last = &scene->resources;
    int i;
@@ -420,9 +441,12 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
       /* Search for this resource:
        */
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
+      for (i = 0; i < ref->count; i++) {
+         if (ref->resource[i] == resource) {
+            ref->writeable[i] |= writeable;
             return TRUE;
+         }
+      }
 
       if (ref->count < RESOURCE_REF_SZ) {
          /* If the block is half-empty, then append the reference here.
@@ -445,6 +469,7 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
    /* Append the reference to the reference block.
     */
+   ref->writeable[ref->count] = writeable;
    pipe_resource_reference(&ref->resource[ref->count++], resource);
    scene->resource_reference_size += llvmpipe_resource_size(resource);
 
@@ -511,80 +536,135 @@ lp_scene_add_frag_shader_reference(struct lp_scene *scene,
 /**
  * Does this scene have a reference to the given resource?
  */
-boolean
-lp_scene_is_resource_referenced(const struct lp_scene *scene,
+unsigned
+lp_scene_is_resource_referenced(struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
+   unsigned referenced = LP_UNREFERENCED;
    int i;
 
-   for (ref = scene->resources; ref; ref = ref->next) {
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
-            return TRUE;
+   /* The scene may be in flight, with the rasterizer releasing the
+    * references as it finishes.
+    */
+   mtx_lock(&scene->mutex);
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         referenced = LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   return FALSE;
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource)
+      referenced = LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+   for (ref = scene->resources; ref && !referenced; ref = ref->next) {
+      for (i = 0; i < ref->count; i++) {
+         if (ref->resource[i] == resource) {
+            referenced = LP_REFERENCED_FOR_READ;
+            if (ref->writeable[i])
+               referenced |= LP_REFERENCED_FOR_WRITE;
+            break;
+         }
+      }
+   }
+
+   mtx_unlock(&scene->mutex);
+
+   return referenced;
 }
 
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/** Extract the even bits of a Morton code */
+static inline unsigned
+morton_compact(unsigned v)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
+   v &= 0x55555555;
+   v = (v | (v >> 1)) & 0x33333333;
+   v = (v | (v >> 2)) & 0x0f0f0f0f;
+   v = (v | (v >> 4)) & 0x00ff00ff;
+   v = (v | (v >> 8)) & 0x0000ffff;
+   return v;
 }
 
 
+/**
+ * Prepare for rasterization by num_threads threads.
+ * Called by one thread before the others start iterating.
+ *
+ * The non-empty bins are listed in Morton order, so neighbouring bins
+ * (likely sharing textures and framebuffer cache lines) are handed out
+ * together, and the list is split in one contiguous range per thread.
+ */
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads )
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned side = util_next_power_of_two(MAX2(scene->tiles_x,
+                                                scene->tiles_y));
+   unsigned num_bins = 0;
+   unsigned code, i;
+
+   for (code = 0; code < side * side; code++) {
+      unsigned x = morton_compact(code);
+      unsigned y = morton_compact(code >> 1);
+
+      if (x >= scene->tiles_x || y >= scene->tiles_y)
+         continue;
+
+      /* An empty bin would just load the contents of the tile and store
+       * them again unchanged. This typically happens when bins have been
+       * flushed for some reason in the middle of a frame, or when
+       * incremental updates are being made to a render target.
+       */
+      if (lp_scene_get_bin(scene, x, y)->head)
+         scene->active_bins[num_bins++] = x | (y << 16);
+   }
+
+   assert(num_threads > 0 && num_threads <= scene->max_bin_ranges);
+
+   scene->num_active_bins = num_bins;
+   scene->num_bin_ranges = num_threads;
+
+   for (i = 0; i < num_threads; i++) {
+      scene->bin_ranges[i].next = num_bins * i / num_threads;
+      scene->bin_ranges[i].end = num_bins * (i + 1) / num_threads;
+   }
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Return pointer to next bin to be rendered by the given thread, taken
+ * from its own range first and then stolen from the following threads'.
+ * Empty bins are never returned.
+ * Lock-free, multiple rendering threads call this function concurrently.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
+   unsigned i;
 
-   mtx_lock(&scene->mutex);
+   for (i = 0; i < scene->num_bin_ranges; i++) {
+      struct lp_scene_bin_range *range =
+         &scene->bin_ranges[(thread_index + i) % scene->num_bin_ranges];
+      unsigned idx;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+      /* Cheap check first, so exhausted ranges aren't written to */
+      if (p_atomic_read(&range->next) >= range->end)
+         continue;
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+      idx = p_atomic_inc_return(&range->next) - 1;
+      if (idx < range->end) {
+         uint32_t packed = scene->active_bins[idx];
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+         *x = packed & 0xffff;
+         *y = packed >> 16;
+         return lp_scene_get_bin(scene, *x, *y);
+      }
+   }
+
+   return NULL;
 }
 
 
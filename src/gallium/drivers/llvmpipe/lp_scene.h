@@ -119,6 +119,18 @@ struct resource_ref;
 
 struct shader_ref;
 
+
+/**
+ * A contiguous range of lp_scene::active_bins handed to one rasterizer
+ * thread, which other threads steal from once their own range is done.
+ * Padded to its own cache line as every thread advances one.
+ */
+struct lp_scene_bin_range {
+   unsigned next;   /**< next index to hand out, atomically incremented */
+   unsigned end;
+   char pad[64 - 2 * sizeof(unsigned)];
+};
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -185,7 +197,18 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
+   /** Non-empty bins in Morton order, packed as x | y << 16, split into
+    * one range per rasterizer thread. Set up by lp_scene_bin_iter_begin().
+    */
+   unsigned num_active_bins;
+   unsigned num_bin_ranges;
+   unsigned max_bin_ranges;
+   struct lp_scene_bin_range *bin_ranges;
+   uint32_t active_bins[TILES_X * TILES_Y];
+
+   /** Protects the references against concurrent checks while the
+    * rasterizer releases them.
+    */
    mtx_t mutex;
 
    struct cmd_bin tile[TILES_X][TILES_Y];
@@ -209,10 +232,11 @@ struct cmd_block *lp_scene_new_cmd_block( struct lp_scene *scene,
 
 boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
-                                        boolean initializing_scene);
+                                        boolean initializing_scene,
+                                        boolean writeable);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+unsigned lp_scene_is_resource_referenced(struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
 boolean lp_scene_add_frag_shader_reference(struct lp_scene *scene,
                                            struct lp_fragment_shader_variant *variant);
@@ -395,10 +419,11 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_threads );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread_index,
+                        int *x, int *y );
 
 
 
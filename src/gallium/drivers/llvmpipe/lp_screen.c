@@ -51,6 +51,7 @@
 #include "lp_limits.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
+#include "lp_flush.h"
 
 #include "frontend/sw_winsys.h"
 
@@ -725,8 +726,13 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
 
    assert(texture->dt);
-   if (texture->dt)
+   if (texture->dt) {
+      /* Rendering may still be in flight */
+      if (_pipe)
+         llvmpipe_flush_resource(_pipe, resource, 0, TRUE, TRUE, FALSE,
+                                 "frontbuffer");
       winsys->displaytarget_display(winsys, texture->dt, context_private, sub_box);
+   }
 }
 
 static void
@@ -735,6 +741,9 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   if (util_queue_is_initialized(&screen->fs_compile_queue))
+      util_queue_destroy(&screen->fs_compile_queue);
+
    if (screen->cs_tpool)
       lp_cs_tpool_destroy(screen->cs_tpool);
 
@@ -743,9 +752,24 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
 
    lp_jit_screen_cleanup(screen);
 
-   if (LP_DEBUG & DEBUG_CACHE_STATS)
-      printf("disk shader cache:   hits = %u, misses = %u\n", screen->num_disk_shader_cache_hits,
-             screen->num_disk_shader_cache_misses);
+   if (LP_DEBUG & DEBUG_CACHE_STATS) {
+      static const char *kind_names[LP_DISK_CACHE_NUM_KINDS] = {
+         [LP_DISK_CACHE_FS] = "fs",
+         [LP_DISK_CACHE_CS] = "cs",
+         [LP_DISK_CACHE_DRAW] = "draw",
+         [LP_DISK_CACHE_SETUP] = "setup",
+      };
+      unsigned hits = 0, misses = 0;
+
+      for (unsigned i = 0; i < LP_DISK_CACHE_NUM_KINDS; i++) {
+         printf("disk shader cache %-5s hits = %u, misses = %u\n", kind_names[i],
+                screen->num_disk_shader_cache_hits[i],
+                screen->num_disk_shader_cache_misses[i]);
+         hits += screen->num_disk_shader_cache_hits[i];
+         misses += screen->num_disk_shader_cache_misses[i];
+      }
+      printf("disk shader cache:   hits = %u, misses = %u\n", hits, misses);
+   }
    disk_cache_destroy(screen->disk_shader_cache);
    if(winsys->destroy)
       winsys->destroy(winsys);
@@ -830,7 +854,43 @@ static struct disk_cache *lp_get_disk_shader_cache(struct pipe_screen *_screen)
    return screen->disk_shader_cache;
 }
 
+/**
+ * Pin the calling worker thread to one of the CPU's L3 domains, spreading
+ * num_threads workers evenly so that threads sharing a cache are neighbours
+ * in thread_index order, and so likely to work on neighbouring tiles.
+ * Without L3 topology information the thread is left alone.
+ */
+void
+lp_set_thread_affinity(unsigned thread_index, unsigned num_threads)
+{
+   if (util_cpu_caps.num_L3_caches <= 1 || !num_threads ||
+       !debug_get_bool_option("LP_THREAD_AFFINITY", TRUE))
+      return;
+
+   unsigned L3_cache = (uint64_t)thread_index * util_cpu_caps.num_L3_caches /
+                       num_threads;
+
+   util_set_current_thread_affinity(util_cpu_caps.L3_affinity_mask[L3_cache],
+                                    NULL, util_cpu_caps.num_cpu_mask_bits);
+}
+
+static void lp_disk_cache_found_shader(struct llvmpipe_screen *screen,
+                                       enum lp_disk_cache_kind kind,
+                                       struct lp_cached_code *cache,
+                                       uint8_t *buffer, size_t binary_size)
+{
+   if (!buffer) {
+      cache->data_size = 0;
+      p_atomic_inc(&screen->num_disk_shader_cache_misses[kind]);
+      return;
+   }
+   cache->data_size = binary_size;
+   cache->data = buffer;
+   p_atomic_inc(&screen->num_disk_shader_cache_hits[kind]);
+}
+
 void lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                               enum lp_disk_cache_kind kind,
                                struct lp_cached_code *cache,
                                unsigned char ir_sha1_cache_key[20])
 {
@@ -842,14 +902,32 @@ void lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
 
    size_t binary_size;
    uint8_t *buffer = disk_cache_get(screen->disk_shader_cache, sha1, &binary_size);
-   if (!buffer) {
-      cache->data_size = 0;
-      p_atomic_inc(&screen->num_disk_shader_cache_misses);
-      return;
-   }
-   cache->data_size = binary_size;
-   cache->data = buffer;
-   p_atomic_inc(&screen->num_disk_shader_cache_hits);
+   lp_disk_cache_found_shader(screen, kind, cache, buffer, binary_size);
+}
+
+/* Starts the lookup on the disk cache threads, for
+ * lp_disk_cache_find_prefetched_shader() to collect.
+ */
+struct disk_cache_get_job *lp_disk_cache_prefetch_shader(struct llvmpipe_screen *screen,
+                                                         unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+
+   if (!screen->disk_shader_cache)
+      return NULL;
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key, 20, sha1);
+
+   return disk_cache_get_async(screen->disk_shader_cache, sha1);
+}
+
+void lp_disk_cache_find_prefetched_shader(struct llvmpipe_screen *screen,
+                                          enum lp_disk_cache_kind kind,
+                                          struct lp_cached_code *cache,
+                                          struct disk_cache_get_job *job)
+{
+   size_t binary_size;
+   uint8_t *buffer = disk_cache_get_job_finish(job, &binary_size);
+   lp_disk_cache_found_shader(screen, kind, cache, buffer, binary_size);
 }
 
 void lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
@@ -924,6 +1002,9 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = 0;
 #endif
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
+   /* Per-thread state is sized for the actual count, this is only a sanity
+    * limit.
+    */
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
    screen->rast = lp_rast_create(screen->num_threads);
@@ -943,6 +1024,16 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    (void) mtx_init(&screen->cs_mutex, mtx_plain);
 
+   /* Nothing waits for these, so leave the CPUs to the rasterizer threads
+    * first. Without the queue, variants are compiled optimized right away.
+    */
+   unsigned num_compile_threads = debug_get_num_option("LP_FS_COMPILE_THREADS", 0);
+   if (num_compile_threads)
+      util_queue_init(&screen->fs_compile_queue, "lpfs", 64,
+                      MIN2(num_compile_threads, util_cpu_caps.nr_cpus),
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                      UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY);
+
    lp_disk_cache_create(screen);
    return &screen->base;
 }
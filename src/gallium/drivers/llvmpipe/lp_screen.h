@@ -37,11 +37,22 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/u_queue.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
 
 struct sw_winsys;
 struct lp_cs_tpool;
+struct disk_cache_get_job;
+
+/* Kinds of JIT variants in the disk cache, for the statistics */
+enum lp_disk_cache_kind {
+   LP_DISK_CACHE_FS,
+   LP_DISK_CACHE_CS,
+   LP_DISK_CACHE_DRAW,
+   LP_DISK_CACHE_SETUP,
+   LP_DISK_CACHE_NUM_KINDS,
+};
 
 struct llvmpipe_screen
 {
@@ -61,20 +72,34 @@ struct llvmpipe_screen
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
 
+   /* Optimized fragment shader variants built in the background, only
+    * initialized with LP_FS_COMPILE_THREADS.
+    */
+   struct util_queue fs_compile_queue;
+
    bool use_tgsi;
    bool allow_cl;
 
    struct disk_cache *disk_shader_cache;
-   unsigned num_disk_shader_cache_hits;
-   unsigned num_disk_shader_cache_misses;
+   unsigned num_disk_shader_cache_hits[LP_DISK_CACHE_NUM_KINDS];
+   unsigned num_disk_shader_cache_misses[LP_DISK_CACHE_NUM_KINDS];
 };
 
+void lp_set_thread_affinity(unsigned thread_index, unsigned num_threads);
+
 void lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                               enum lp_disk_cache_kind kind,
                                struct lp_cached_code *cache,
                                unsigned char ir_sha1_cache_key[20]);
 void lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
                                  struct lp_cached_code *cache,
                                  unsigned char ir_sha1_cache_key[20]);
+struct disk_cache_get_job *lp_disk_cache_prefetch_shader(struct llvmpipe_screen *screen,
+                                                         unsigned char ir_sha1_cache_key[20]);
+void lp_disk_cache_find_prefetched_shader(struct llvmpipe_screen *screen,
+                                          enum lp_disk_cache_kind kind,
+                                          struct lp_cached_code *cache,
+                                          struct disk_cache_get_job *job);
 
 
 static inline struct llvmpipe_screen *
@@ -70,16 +70,31 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
    assert(setup->scene == NULL);
 
    setup->scene_idx++;
-   setup->scene_idx %= ARRAY_SIZE(setup->scenes);
+   setup->scene_idx %= setup->num_scenes;
+
+   if (!setup->scenes[setup->scene_idx]) {
+      setup->scenes[setup->scene_idx] = lp_scene_create(setup->pipe);
+
+      /* Make do with the scenes we have */
+      if (!setup->scenes[setup->scene_idx]) {
+         setup->num_scenes = setup->scene_idx;
+         setup->scene_idx = 0;
+      }
+   }
 
    setup->scene = setup->scenes[setup->scene_idx];
 
+   /* Scenes are used round-robin, so this is the oldest one which may still
+    * be in flight. The rasterizer only signals the fence once it is done
+    * with the scene.
+    */
    if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
                       __FUNCTION__, setup->scene->fence->id);
 
       lp_fence_wait(setup->scene->fence);
+      lp_fence_reference(&setup->scene->fence, NULL);
    }
 
    lp_scene_begin_binning(setup->scene, &setup->fb);
@@ -166,23 +181,14 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   mtx_lock(&screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer, so the next scene can be binned while
+    * this one is rasterized. The rasterizer ends the scene and signals its
+    * fence, anything needing the results waits on that.
     */
+   mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -202,7 +208,7 @@ begin_binning( struct lp_setup_context *setup )
 
    /* Always create a fence:
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -344,6 +350,7 @@ set_scene_state( struct lp_setup_context *setup,
 fail:
    if (setup->scene) {
       lp_scene_end_rasterization(setup->scene);
+      lp_fence_reference(&setup->scene->fence, NULL);
       setup->scene = NULL;
    }
 
@@ -368,6 +375,67 @@ lp_setup_flush( struct lp_setup_context *setup,
 }
 
 
+/**
+ * Wait for the scenes already handed to the rasterizer to complete, without
+ * flushing the one being binned.
+ */
+void
+lp_setup_wait_flushed( struct lp_setup_context *setup )
+{
+   if (setup->last_fence)
+      lp_fence_wait(setup->last_fence);
+}
+
+
+static void
+wait_flushed_references( struct lp_setup_context *setup,
+                         const struct pipe_resource *resource,
+                         unsigned usage )
+{
+   unsigned i;
+
+   if (!resource || !setup->last_fence ||
+       lp_fence_signalled(setup->last_fence))
+      return;
+
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene && scene != setup->scene &&
+          (lp_scene_is_resource_referenced(scene, resource) & usage)) {
+         lp_fence_wait(setup->last_fence);
+         return;
+      }
+   }
+}
+
+
+/**
+ * Wait for the scenes already handed to the rasterizer to complete, if any of
+ * them may write the resource. Used before the draw module reads it on the
+ * CPU, which the rasterizer doesn't order against.
+ */
+void
+lp_setup_wait_flushed_writes( struct lp_setup_context *setup,
+                              const struct pipe_resource *resource )
+{
+   wait_flushed_references(setup, resource, LP_REFERENCED_FOR_WRITE);
+}
+
+
+/**
+ * Like lp_setup_wait_flushed_writes(), but also waits if the scenes only read
+ * the resource. Used before the draw module writes it on the CPU.
+ */
+void
+lp_setup_wait_flushed_references( struct lp_setup_context *setup,
+                                  const struct pipe_resource *resource )
+{
+   wait_flushed_references(setup, resource,
+                           LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE);
+}
+
+
 void
 lp_setup_bind_framebuffer( struct lp_setup_context *setup,
                            const struct pipe_framebuffer_state *fb )
@@ -1070,6 +1138,7 @@ unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
+   unsigned referenced = LP_UNREFERENCED;
    unsigned i;
 
    /* check the render targets */
@@ -1081,13 +1150,16 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+   /* check resources referenced by the scenes, including those in flight */
+   for (i = 0; i < setup->num_scenes; i++) {
+      if (setup->scenes[i])
+         referenced |= lp_scene_is_resource_referenced(setup->scenes[i],
+                                                       texture);
    }
 
+   if (referenced & LP_REFERENCED_FOR_WRITE)
+      return referenced;
+
    for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
       if (setup->ssbos[i].current.buffer == texture)
          return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
@@ -1098,7 +1170,7 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
          return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   return LP_UNREFERENCED;
+   return referenced;
 }
 
 
@@ -1297,7 +1369,32 @@ try_update_scene_state( struct lp_setup_context *setup )
             if (setup->fs.current_tex[i]) {
                if (!lp_scene_add_resource_reference(scene,
                                                     setup->fs.current_tex[i],
-                                                    new_scene)) {
+                                                    new_scene, FALSE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         /* Likewise for the buffers and images the shader may write, so
+          * they are known to be busy until the scene is rasterized.
+          */
+         for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+            if (setup->ssbos[i].current.buffer) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->ssbos[i].current.buffer,
+                                                    new_scene, TRUE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         for (i = 0; i < ARRAY_SIZE(setup->images); i++) {
+            if (setup->images[i].current.resource) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->images[i].current.resource,
+                                                    new_scene, TRUE)) {
                   assert(!new_scene);
                   return FALSE;
                }
@@ -1426,6 +1523,9 @@ lp_setup_destroy( struct lp_setup_context *setup )
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
 
+      if (!scene)
+         continue;
+
       if (scene->fence)
          lp_fence_wait(scene->fence);
 
@@ -1449,7 +1549,6 @@ lp_setup_create( struct pipe_context *pipe,
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_setup_context *setup;
-   unsigned i;
 
    setup = CALLOC_STRUCT(lp_setup_context);
    if (!setup) {
@@ -1464,6 +1563,15 @@ lp_setup_create( struct pipe_context *pipe,
 
 
    setup->num_threads = screen->num_threads;
+
+   /* Without rasterizer threads scenes are rasterized synchronously, so
+    * there is nothing to overlap */
+   if (setup->num_threads)
+      setup->num_scenes = CLAMP(debug_get_num_option("LP_NUM_SCENES",
+                                                     MAX_SCENES),
+                                1, MAX_SCENES);
+   else
+      setup->num_scenes = 1;
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1472,12 +1580,10 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
-   /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
-      setup->scenes[i] = lp_scene_create( pipe );
-      if (!setup->scenes[i]) {
-         goto no_scenes;
-      }
+   /* create the first scene, the others are created as needed */
+   setup->scenes[0] = lp_scene_create( pipe );
+   if (!setup->scenes[0]) {
+      goto no_scenes;
    }
 
    setup->triangle = first_triangle;
@@ -1493,12 +1599,6 @@ lp_setup_create( struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
-      if (setup->scenes[i]) {
-         lp_scene_destroy(setup->scenes[i]);
-      }
-   }
-
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
    FREE(setup);
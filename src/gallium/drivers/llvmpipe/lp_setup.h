@@ -67,6 +67,17 @@ lp_setup_flush( struct lp_setup_context *setup,
                 struct pipe_fence_handle **fence,
                 const char *reason);
 
+void
+lp_setup_wait_flushed( struct lp_setup_context *setup );
+
+void
+lp_setup_wait_flushed_writes( struct lp_setup_context *setup,
+                              const struct pipe_resource *resource );
+
+void
+lp_setup_wait_flushed_references( struct lp_setup_context *setup,
+                                  const struct pipe_resource *resource );
+
 
 void
 lp_setup_bind_framebuffer( struct lp_setup_context *setup,
@@ -54,9 +54,10 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/** Max number of scenes per context. While one scene is rasterized the
+ * next ones can be binned, up to LP_NUM_SCENES (default and maximum
+ * MAX_SCENES). Scenes are created on first use. */
+#define MAX_SCENES 4
 
 
 
@@ -87,6 +88,7 @@ struct lp_setup_context
     */
    struct draw_stage *vbuf;
    unsigned num_threads;
+   unsigned num_scenes;
    unsigned scene_idx;
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
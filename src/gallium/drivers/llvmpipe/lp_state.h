@@ -116,6 +116,9 @@ llvmpipe_update_fs(struct llvmpipe_context *lp);
 void 
 llvmpipe_update_setup(struct llvmpipe_context *lp);
 
+void
+llvmpipe_prefetch_setup(struct llvmpipe_context *lp);
+
 void
 llvmpipe_update_derived(struct llvmpipe_context *llvmpipe);
 
@@ -45,6 +45,7 @@
 #include "lp_memory.h"
 #include "lp_query.h"
 #include "lp_cs_tpool.h"
+#include "lp_setup.h"
 #include "frontend/sw_winsys.h"
 #include "nir/nir_to_tgsi_info.h"
 #include "util/mesa-sha1.h"
@@ -727,7 +728,8 @@ generate_variant(struct llvmpipe_context *lp,
    if (shader->base.ir.nir) {
       lp_cs_get_ir_cache_key(variant, ir_sha1_cache_key);
 
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      lp_disk_cache_find_shader(screen, LP_DISK_CACHE_CS, &cached,
+                                ir_sha1_cache_key);
       if (!cached.data_size)
          needs_caching = true;
    }
@@ -1328,6 +1330,9 @@ static void llvmpipe_launch_grid(struct pipe_context *pipe,
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   /* Flushed scenes may still be rasterizing, make their results visible */
+   lp_setup_wait_flushed(llvmpipe->setup);
+
    memset(&job_info, 0, sizeof(job_info));
 
    llvmpipe_cs_update_derived(llvmpipe, info->input);
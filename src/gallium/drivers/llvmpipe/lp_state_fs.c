@@ -59,6 +59,7 @@
 
 #include <limits.h>
 #include "pipe/p_defines.h"
+#include "util/u_atomic.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
 #include "util/u_pointer.h"
@@ -3467,6 +3468,167 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
    blob_finish(&blob);
 }
 
+/**
+ * Background build of the optimized functions of a variant which was
+ * compiled unoptimized to be usable right away, see LP_FS_COMPILE_THREADS.
+ */
+struct lp_fs_compile_job
+{
+   struct util_queue_fence fence;
+   struct llvmpipe_context *lp;
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+
+   /* Copy of the variant's shader with a NIR of its own, as translating
+    * NIR to LLVM IR modifies it.
+    */
+   struct lp_fragment_shader shader;
+
+   /* Where the optimized functions are generated, owning their code */
+   struct lp_fragment_shader_variant *build;
+
+   bool needs_caching;
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached;
+};
+
+
+/**
+ * Generate the variant's functions in its gallivm and JIT them.
+ */
+static void
+compile_variant(struct llvmpipe_context *lp,
+                struct lp_fragment_shader *shader,
+                struct lp_fragment_shader_variant *variant)
+{
+   lp_jit_init_types(variant);
+   
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(lp, shader, variant, RAST_WHOLE);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+}
+
+
+static void
+lp_fs_compile_job_execute(void *data, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct lp_fragment_shader_variant *build = job->build;
+   struct lp_fragment_shader_variant *variant = job->variant;
+   LLVMContextRef context;
+   char module_name[64];
+
+   /* The context's LLVMContext is in use by the context's thread */
+   context = LLVMContextCreate();
+   if (!context)
+      goto out;
+
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u_opt",
+            job->shader.no, build->no);
+
+   build->gallivm = gallivm_create(module_name, context, &job->cached);
+   if (build->gallivm) {
+      compile_variant(job->lp, &job->shader, build);
+
+      if (job->needs_caching) {
+         lp_disk_cache_insert_shader(job->screen, &job->cached,
+                                     job->ir_sha1_cache_key);
+      }
+
+      gallivm_free_ir(build->gallivm);
+
+      /* Rasterizer threads may be running the unoptimized functions, which
+       * do exactly the same, so there is nothing to synchronize with.
+       */
+      p_atomic_set(&variant->jit_function[RAST_EDGE_TEST],
+                   build->jit_function[RAST_EDGE_TEST]);
+      p_atomic_set(&variant->jit_function[RAST_WHOLE],
+                   build->jit_function[RAST_WHOLE]);
+   }
+
+   LLVMContextDispose(context);
+
+out:
+   ralloc_free(job->shader.base.ir.nir);
+   job->shader.base.ir.nir = NULL;
+}
+
+
+/**
+ * Queue the build of the optimized functions of a variant which got
+ * unoptimized ones. On failure the variant just keeps those.
+ */
+static void
+queue_optimized_variant(struct llvmpipe_context *lp,
+                        struct lp_fragment_shader *shader,
+                        struct lp_fragment_shader_variant *variant,
+                        bool needs_caching,
+                        const unsigned char ir_sha1_cache_key[20])
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fs_compile_job *job;
+
+   job = CALLOC_STRUCT(lp_fs_compile_job);
+   if (!job)
+      return;
+
+   job->build = MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
+   if (!job->build) {
+      FREE(job);
+      return;
+   }
+
+   memset(job->build, 0, sizeof(*job->build));
+   job->build->opaque = variant->opaque;
+   job->build->no = variant->no;
+   memcpy(&job->build->key, &variant->key, shader->variant_key_size);
+
+   job->shader = *shader;
+   if (shader->base.ir.nir)
+      job->shader.base.ir.nir = nir_shader_clone(NULL, shader->base.ir.nir);
+
+   job->lp = lp;
+   job->screen = screen;
+   job->variant = variant;
+   job->needs_caching = needs_caching;
+   memcpy(job->ir_sha1_cache_key, ir_sha1_cache_key, sizeof(job->ir_sha1_cache_key));
+
+   util_queue_fence_init(&job->fence);
+   variant->compile_job = job;
+
+   util_queue_add_job(&screen->fs_compile_queue, job, &job->fence,
+                      lp_fs_compile_job_execute, NULL, 0);
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -3484,6 +3646,7 @@ generate_variant(struct llvmpipe_context *lp,
    unsigned char ir_sha1_cache_key[20];
    struct lp_cached_code cached = { 0 };
    bool needs_caching = false;
+   bool optimize_later;
    variant = MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
       return NULL;
@@ -3500,11 +3663,21 @@ generate_variant(struct llvmpipe_context *lp,
    if (shader->base.ir.nir) {
       lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
 
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      lp_disk_cache_find_shader(screen, LP_DISK_CACHE_FS, &cached,
+                                ir_sha1_cache_key);
       if (!cached.data_size)
          needs_caching = true;
    }
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
+
+   /* Unless the disk cache has it, draw with an unoptimized variant until
+    * the background queue has built the optimized one.
+    */
+   optimize_later = util_queue_is_initialized(&screen->fs_compile_queue) &&
+                    !cached.data_size;
+   if (optimize_later)
+      variant->gallivm = gallivm_create_unoptimized(module_name, lp->context);
+   else
+      variant->gallivm = gallivm_create(module_name, lp->context, &cached);
    if (!variant->gallivm) {
       FREE(variant);
       return NULL;
@@ -3542,41 +3715,12 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
-
-   /*
-    * Compile everything
-    */
-
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
-
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
-   }
+   compile_variant(lp, shader, variant);
 
-   if (needs_caching) {
+   if (optimize_later) {
+      queue_optimized_variant(lp, shader, variant, needs_caching,
+                              ir_sha1_cache_key);
+   } else if (needs_caching) {
       lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
    }
 
@@ -3741,6 +3885,22 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   struct lp_fs_compile_job *job = variant->compile_job;
+
+   if (job) {
+      struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+      /* Unqueue it, or wait for it if it is already running */
+      util_queue_drop_job(&screen->fs_compile_queue, &job->fence);
+      util_queue_fence_destroy(&job->fence);
+
+      if (job->build->gallivm)
+         gallivm_destroy(job->build->gallivm);
+      ralloc_free(job->shader.base.ir.nir);
+      FREE(job->build);
+      FREE(job);
+   }
+
    gallivm_destroy(variant->gallivm);
 
    lp_fs_reference(lp, &variant->shader, NULL);
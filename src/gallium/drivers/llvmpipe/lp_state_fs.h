@@ -127,6 +127,8 @@ lp_fs_variant_key_images(struct lp_fragment_shader_variant_key *key)
       &key->samplers[key->nr_samplers];
 }
 
+struct lp_fs_compile_job;
+
 /** doubly-linked list item */
 struct lp_fs_variant_list_item
 {
@@ -153,6 +155,11 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /* Build of the optimized functions while jit_function[] holds
+    * unoptimized ones, NULL once they are optimized from the start.
+    */
+   struct lp_fs_compile_job *compile_job;
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
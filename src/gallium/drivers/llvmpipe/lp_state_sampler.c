@@ -147,8 +147,12 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
                       "context\n", i);
       }
 
+      /* Only fragment shaders run in the rasterizer, after earlier scenes.
+       * The other stages sample on the CPU, so rendering must be done. */
       if (view)
-         llvmpipe_flush_resource(pipe, view->texture, 0, true, false, false, "sampler_view");
+         llvmpipe_flush_resource(pipe, view->texture, 0, true,
+                                 shader != PIPE_SHADER_FRAGMENT, false,
+                                 "sampler_view");
       pipe_sampler_view_reference(&llvmpipe->sampler_views[shader][start + i],
                                   view);
    }
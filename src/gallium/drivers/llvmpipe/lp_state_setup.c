@@ -30,6 +30,8 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
+#include "util/disk_cache.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
 #include "gallivm/lp_bld_const.h"
@@ -699,6 +701,23 @@ init_args(struct gallivm_state *gallivm,
    emit_linear_coef(gallivm, args, 0, attr_pos);
 }
 
+/**
+ * The generated code only depends on the key, the rest is covered by the
+ * disk cache's own identifier.
+ */
+static void
+lp_setup_get_ir_cache_key(const struct lp_setup_variant_key *key,
+                          unsigned char ir_sha1_cache_key[20])
+{
+   static const char tag[] = "llvmpipe setup";
+   struct mesa_sha1 ctx;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, tag, sizeof(tag));
+   _mesa_sha1_update(&ctx, key, key->size);
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+}
+
 /**
  * Generate the runtime callable function for the coefficient calculation.
  *
@@ -707,10 +726,16 @@ static struct lp_setup_variant *
 generate_setup_variant(struct lp_setup_variant_key *key,
                        struct llvmpipe_context *lp)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_setup_variant *variant = NULL;
    struct gallivm_state *gallivm;
    struct lp_setup_args args;
-   char func_name[64];
+   char module_name[64];
+   /* Same name in every module, so that cached objects can be looked up */
+   const char *func_name = "setup_variant";
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
    LLVMTypeRef vec4f_type;
    LLVMTypeRef func_type;
    LLVMTypeRef arg_types[7];
@@ -727,10 +752,25 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->no = setup_no++;
 
-   snprintf(func_name, sizeof(func_name), "setup_variant_%u",
+   snprintf(module_name, sizeof(module_name), "setup_variant_%u",
             variant->no);
 
-   variant->gallivm = gallivm = gallivm_create(func_name, lp->context, NULL);
+   lp_setup_get_ir_cache_key(key, ir_sha1_cache_key);
+   if (lp->setup_prefetch &&
+       memcmp(lp->setup_prefetch_key, ir_sha1_cache_key,
+              sizeof(ir_sha1_cache_key)) == 0) {
+      lp_disk_cache_find_prefetched_shader(screen, LP_DISK_CACHE_SETUP,
+                                           &cached, lp->setup_prefetch);
+      lp->setup_prefetch = NULL;
+   } else {
+      lp_disk_cache_find_shader(screen, LP_DISK_CACHE_SETUP, &cached,
+                                ir_sha1_cache_key);
+   }
+   if (!cached.data_size)
+      needs_caching = true;
+
+   variant->gallivm = gallivm = gallivm_create(module_name, lp->context,
+                                               &cached);
    if (!variant->gallivm) {
       goto fail;
    }
@@ -805,6 +845,10 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->jit_function)
       goto fail;
 
+   if (needs_caching) {
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   }
+
    gallivm_free_ir(variant->gallivm);
 
    /*
@@ -932,6 +976,56 @@ cull_setup_variants(struct llvmpipe_context *lp)
 }
 
 
+static struct lp_setup_variant *
+lookup_setup_variant(struct llvmpipe_context *lp,
+                     const struct lp_setup_variant_key *key)
+{
+   struct lp_setup_variant_list_item *li;
+
+   foreach(li, &lp->setup_variants_list) {
+      if(li->base->key.size == key->size &&
+         memcmp(&li->base->key, key, key->size) == 0) {
+         return li->base;
+      }
+   }
+
+   return NULL;
+}
+
+
+static void
+drop_setup_prefetch(struct llvmpipe_context *lp)
+{
+   free(disk_cache_get_job_finish(lp->setup_prefetch, NULL));
+   lp->setup_prefetch = NULL;
+}
+
+
+/**
+ * The setup variant only depends on state known before the fragment shader
+ * variant gets updated, so the disk cache can look it up meanwhile, instead
+ * of after.
+ */
+void
+llvmpipe_prefetch_setup(struct llvmpipe_context *lp)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_setup_variant_key key;
+
+   if (!screen->disk_shader_cache || !lp->fs || !lp->rasterizer)
+      return;
+
+   lp_make_setup_variant_key(lp, &key);
+   if (lookup_setup_variant(lp, &key))
+      return;
+
+   drop_setup_prefetch(lp);
+   lp_setup_get_ir_cache_key(&key, lp->setup_prefetch_key);
+   lp->setup_prefetch = lp_disk_cache_prefetch_shader(screen,
+                                                      lp->setup_prefetch_key);
+}
+
+
 /**
  * Update fragment/vertex shader linkage state.  This is called just
  * prior to drawing something when some fragment-related state has
@@ -941,18 +1035,11 @@ void
 llvmpipe_update_setup(struct llvmpipe_context *lp)
 {
    struct lp_setup_variant_key *key = &lp->setup_variant.key;
-   struct lp_setup_variant *variant = NULL;
-   struct lp_setup_variant_list_item *li;
+   struct lp_setup_variant *variant;
 
    lp_make_setup_variant_key(lp, key);
 
-   foreach(li, &lp->setup_variants_list) {
-      if(li->base->key.size == key->size &&
-         memcmp(&li->base->key, key, key->size) == 0) {
-         variant = li->base;
-         break;
-      }
-   }
+   variant = lookup_setup_variant(lp, key);
 
    if (variant) {
       move_to_head(&lp->setup_variants_list, &variant->list_item_global);
@@ -976,6 +1063,9 @@ void
 lp_delete_setup_variants(struct llvmpipe_context *lp)
 {
    struct lp_setup_variant_list_item *li;
+
+   drop_setup_prefetch(lp);
+
    li = first_elem(&lp->setup_variants_list);
    while(!at_end(&lp->setup_variants_list, li)) {
       struct lp_setup_variant_list_item *next = next_elem(li);
@@ -0,0 +1,177 @@
+/**************************************************************************
+ *
+ * Copyright 2020 Collabora, Ltd.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Compute dispatch throughput of the lp_cs_tpool thread pool, with
+ * workgroups doing next to nothing so that the cost of handing them out
+ * dominates. Also checks that every workgroup runs exactly once.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_memory.h"
+#include "util/u_cpu_detect.h"
+#include "util/os_time.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_test.h"
+
+
+struct cs_tpool_test_case {
+   unsigned num_threads;
+   unsigned num_iters;
+};
+
+struct cs_tpool_test_job {
+   uint8_t *runs;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "threads\t"
+           "workgroups\t"
+           "workgroups_per_sec\n");
+
+   fflush(fp);
+}
+
+
+static void
+cs_tpool_test_work(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct cs_tpool_test_job *job = data;
+
+   job->runs[iter_idx]++;
+}
+
+
+static boolean
+test_cs_tpool(unsigned verbose, FILE *fp,
+              const struct cs_tpool_test_case *testcase)
+{
+   struct lp_cs_tpool *pool;
+   struct cs_tpool_test_job job;
+   unsigned repeats = CLAMP((1 << 22) / testcase->num_iters, 4, 4096);
+   boolean success = TRUE;
+   int64_t start, elapsed;
+   double rate;
+
+   pool = lp_cs_tpool_create(testcase->num_threads);
+   if (!pool)
+      return FALSE;
+
+   job.runs = CALLOC(testcase->num_iters, sizeof(*job.runs));
+
+   start = os_time_get_nano();
+
+   for (unsigned r = 0; r < repeats; r++) {
+      struct lp_cs_tpool_task *task;
+
+      memset(job.runs, 0, testcase->num_iters);
+
+      task = lp_cs_tpool_queue_task(pool, cs_tpool_test_work, &job,
+                                    testcase->num_iters);
+      lp_cs_tpool_wait_for_task(pool, &task);
+
+      for (unsigned i = 0; i < testcase->num_iters; i++) {
+         if (job.runs[i] != 1) {
+            success = FALSE;
+            break;
+         }
+      }
+   }
+
+   elapsed = os_time_get_nano() - start;
+   rate = (double)repeats * testcase->num_iters / (elapsed / 1e9);
+
+   if (verbose || !success) {
+      printf("threads=%u workgroups=%u: %.2f M/s%s\n",
+             testcase->num_threads, testcase->num_iters, rate / 1e6,
+             success ? "" : " FAILED");
+      fflush(stdout);
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%u\t%u\t%f\n", success ? "pass" : "fail",
+              testcase->num_threads, testcase->num_iters, rate);
+      fflush(fp);
+   }
+
+   FREE(job.runs);
+   lp_cs_tpool_destroy(pool);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   const unsigned thread_counts[] = { 0, 1, 2, 4, util_cpu_caps.nr_cpus };
+   const unsigned iter_counts[] = { 1, 7, 64, 4096, 1 << 20 };
+   boolean success = TRUE;
+
+   for (unsigned t = 0; t < ARRAY_SIZE(thread_counts); t++) {
+      for (unsigned i = 0; i < ARRAY_SIZE(iter_counts); i++) {
+         struct cs_tpool_test_case testcase = {
+            MIN2(thread_counts[t], LP_MAX_THREADS), iter_counts[i]
+         };
+
+         if (!test_cs_tpool(verbose, fp, &testcase))
+            success = FALSE;
+      }
+   }
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   struct cs_tpool_test_case testcase = {
+      MIN2(util_cpu_caps.nr_cpus, LP_MAX_THREADS), 1 << 20
+   };
+
+   return test_cs_tpool(verbose, fp, &testcase);
+}
@@ -28,6 +28,7 @@
 #include <string.h>
 #include "pan_bo.h"
 #include "pan_context.h"
+#include "pan_screen.h"
 #include "pan_util.h"
 #include "panfrost-quirks.h"
 
@@ -103,9 +104,12 @@ pan_prepare_bifrost_props(struct panfrost_shader_state *state,
         }
 }
 
-static void
-pan_upload_shader_descriptor(struct panfrost_context *ctx,
-                        struct panfrost_shader_state *state)
+/* Renderer state descriptors are uploaded against a context, so this must be
+ * called from the context's thread rather than from the compiler threads. */
+
+void
+panfrost_upload_shader_descriptor(struct panfrost_context *ctx,
+                                  struct panfrost_shader_state *state)
 {
         const struct panfrost_device *dev = pan_device(ctx->base.screen);
         struct mali_state_packed *out;
@@ -223,15 +227,26 @@ bifrost_blend_type_from_nir(nir_alu_type nir_type)
         }
 }
 
+/* Compiles a variant. This only touches screen-level state, so it may be
+ * called from the compiler threads; the caller uploads the renderer state
+ * descriptor for non-fragment shaders with panfrost_upload_shader_descriptor
+ * once it is back on the context's thread. */
+
 void
-panfrost_shader_compile(struct panfrost_context *ctx,
+panfrost_shader_compile(struct pipe_screen *pscreen,
                         enum pipe_shader_ir ir_type,
                         const void *ir,
+                        const unsigned char *nir_sha1,
                         gl_shader_stage stage,
                         struct panfrost_shader_state *state,
                         uint64_t *outputs_written)
 {
-        struct panfrost_device *dev = pan_device(ctx->base.screen);
+        struct panfrost_screen *screen = pan_screen(pscreen);
+        struct panfrost_device *dev = pan_device(pscreen);
+
+        if (panfrost_disk_cache_retrieve(screen, nir_sha1, stage, state,
+                                         outputs_written))
+                return;
 
         nir_shader *s;
 
@@ -239,7 +254,7 @@ panfrost_shader_compile(struct panfrost_context *ctx,
                 s = nir_shader_clone(NULL, ir);
         } else {
                 assert (ir_type == PIPE_SHADER_IR_TGSI);
-                s = tgsi_to_nir(ir, ctx->base.screen, false);
+                s = tgsi_to_nir(ir, pscreen, false);
         }
 
         s->info.stage = stage;
@@ -265,9 +280,9 @@ panfrost_shader_compile(struct panfrost_context *ctx,
         int size = program->compiled.size;
 
         if (size) {
-                state->bo = panfrost_bo_create(dev, size, PAN_BO_EXECUTE);
-                memcpy(state->bo->ptr.cpu, program->compiled.data, size);
-                shader = state->bo->ptr.gpu;
+                state->bin = panfrost_suballoc_create(screen, size, PAN_BO_EXECUTE);
+                memcpy(state->bin->ptr.cpu, program->compiled.data, size);
+                shader = state->bin->ptr.gpu;
         }
 
         /* Midgard needs the first tag on the bottom nibble */
@@ -306,7 +321,7 @@ panfrost_shader_compile(struct panfrost_context *ctx,
                         if (!program->blend_ret_offsets[i])
                                 continue;
 
-                        state->blend_ret_addrs[i] = (state->bo->ptr.gpu & UINT32_MAX) +
+                        state->blend_ret_addrs[i] = (state->bin->ptr.gpu & UINT32_MAX) +
                                                     program->blend_ret_offsets[i];
                         assert(!(state->blend_ret_addrs[i] & 0x7));
                 }
@@ -410,8 +425,9 @@ panfrost_shader_compile(struct panfrost_context *ctx,
                                          MALI_DEPTH_SOURCE_SHADER :
                                          MALI_DEPTH_SOURCE_FIXED_FUNCTION;
 
-        if (stage != MESA_SHADER_FRAGMENT)
-                pan_upload_shader_descriptor(ctx, state);
+        panfrost_disk_cache_store(screen, nir_sha1, stage, state,
+                                  program->compiled.data, size,
+                                  s->info.outputs_written);
 
         ralloc_free(program);
 
@@ -288,8 +288,9 @@ panfrost_emit_bifrost_blend(struct panfrost_batch *batch,
                                  * the same top 32 bit as the fragment shader.
                                  * TODO: Ensure that's always the case.
                                  */
-                                assert((blend[i].shader.gpu & (0xffffffffull << 32)) ==
-                                       (fs->bo->ptr.gpu & (0xffffffffull << 32)));
+                                assert(!fs->bin ||
+                                       (blend[i].shader.gpu & (0xffffffffull << 32)) ==
+                                       (fs->bin->ptr.gpu & (0xffffffffull << 32)));
                                 cfg.bifrost.internal.shader.pc = (u32)blend[i].shader.gpu;
                                 assert(!(fs->blend_ret_addrs[i] & 0x7));
                                 cfg.bifrost.internal.shader.return_value = fs->blend_ret_addrs[i];
@@ -576,10 +577,13 @@ panfrost_emit_compute_shader_meta(struct panfrost_batch *batch, enum pipe_shader
 {
         struct panfrost_shader_state *ss = panfrost_get_shader_state(batch->ctx, stage);
 
-        panfrost_batch_add_bo(batch, ss->bo,
-                              PAN_BO_ACCESS_PRIVATE |
-                              PAN_BO_ACCESS_READ |
-                              PAN_BO_ACCESS_VERTEX_TILER);
+        /* Empty shaders have no binary */
+        if (ss->bin) {
+                panfrost_batch_add_bo(batch, ss->bin->bo,
+                                      PAN_BO_ACCESS_PRIVATE |
+                                      PAN_BO_ACCESS_READ |
+                                      PAN_BO_ACCESS_VERTEX_TILER);
+        }
 
         panfrost_batch_add_bo(batch, pan_resource(ss->upload.rsrc)->bo,
                               PAN_BO_ACCESS_PRIVATE |
@@ -595,11 +599,13 @@ panfrost_emit_frag_shader_meta(struct panfrost_batch *batch)
         struct panfrost_context *ctx = batch->ctx;
         struct panfrost_shader_state *ss = panfrost_get_shader_state(ctx, PIPE_SHADER_FRAGMENT);
 
-        /* Add the shader BO to the batch. */
-        panfrost_batch_add_bo(batch, ss->bo,
-                              PAN_BO_ACCESS_PRIVATE |
-                              PAN_BO_ACCESS_READ |
-                              PAN_BO_ACCESS_FRAGMENT);
+        /* Add the shader BO to the batch, if the shader isn't empty. */
+        if (ss->bin) {
+                panfrost_batch_add_bo(batch, ss->bin->bo,
+                                      PAN_BO_ACCESS_PRIVATE |
+                                      PAN_BO_ACCESS_READ |
+                                      PAN_BO_ACCESS_FRAGMENT);
+        }
 
         struct panfrost_device *dev = pan_device(ctx->base.screen);
         unsigned rt_count = MAX2(ctx->pipe_framebuffer.nr_cbufs, 1);
@@ -1042,11 +1048,11 @@ panfrost_get_tex_desc(struct panfrost_batch *batch,
                               PAN_BO_ACCESS_SHARED | PAN_BO_ACCESS_READ |
                               panfrost_bo_access_for_stage(st));
 
-        panfrost_batch_add_bo(batch, view->bo,
+        panfrost_batch_add_bo(batch, view->desc->bo,
                               PAN_BO_ACCESS_SHARED | PAN_BO_ACCESS_READ |
                               panfrost_bo_access_for_stage(st));
 
-        return view->bo->ptr.gpu;
+        return view->desc->ptr.gpu;
 }
 
 static void
@@ -1056,7 +1062,7 @@ panfrost_update_sampler_view(struct panfrost_sampler_view *view,
         struct panfrost_resource *rsrc = pan_resource(view->base.texture);
         if (view->texture_bo != rsrc->bo->ptr.gpu ||
             view->modifier != rsrc->layout.modifier) {
-                panfrost_bo_unreference(view->bo);
+                panfrost_suballoc_destroy(pan_screen(pctx->screen), view->desc);
                 panfrost_create_sampler_view_bo(view, pctx, &rsrc->base);
         }
 }
@@ -1094,7 +1100,7 @@ panfrost_emit_texture_descriptors(struct panfrost_batch *batch,
                                               PAN_BO_ACCESS_SHARED | PAN_BO_ACCESS_READ |
                                               panfrost_bo_access_for_stage(stage));
 
-                        panfrost_batch_add_bo(batch, view->bo,
+                        panfrost_batch_add_bo(batch, view->desc->bo,
                                               PAN_BO_ACCESS_SHARED | PAN_BO_ACCESS_READ |
                                               panfrost_bo_access_for_stage(stage));
                 }
@@ -64,8 +64,17 @@ panfrost_create_compute_state(
                 so->cbase.ir_type = PIPE_SHADER_IR_NIR;
         }
 
-        panfrost_shader_compile(ctx, so->cbase.ir_type, so->cbase.prog,
-                                MESA_SHADER_COMPUTE, v, NULL);
+        panfrost_disk_cache_init_shader_key(pan_screen(pctx->screen),
+                                            so->cbase.ir_type, so->cbase.prog,
+                                            so->nir_sha1);
+
+        /* Compute shaders are compiled up front, so the ready fence starts
+         * (and stays) signalled */
+        util_queue_fence_init(&so->ready);
+
+        panfrost_shader_compile(pctx->screen, so->cbase.ir_type, so->cbase.prog,
+                                so->nir_sha1, MESA_SHADER_COMPUTE, v, NULL);
+        panfrost_upload_shader_descriptor(ctx, v);
 
         return so;
 }
@@ -84,6 +93,10 @@ panfrost_bind_compute_state(struct pipe_context *pipe, void *cso)
 static void
 panfrost_delete_compute_state(struct pipe_context *pipe, void *cso)
 {
+        struct panfrost_shader_variants *so =
+                (struct panfrost_shader_variants *) cso;
+
+        util_queue_fence_destroy(&so->ready);
         free(cso);
 }
 
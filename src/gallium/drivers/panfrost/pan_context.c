@@ -462,6 +462,9 @@ panfrost_draw_emit_tiler(struct panfrost_batch *batch,
                 pan_section_pack(job, BIFROST_TILER_JOB, DRAW_PADDING, cfg);
 }
 
+static void
+panfrost_update_shader_variants(struct panfrost_context *ctx);
+
 static void
 panfrost_draw_vbo(
         struct pipe_context *pipe,
@@ -516,6 +519,8 @@ panfrost_draw_vbo(
 
         /* Now that we have a guaranteed terminating path, find the job. */
 
+        panfrost_update_shader_variants(ctx);
+
         struct panfrost_batch *batch = panfrost_get_batch_for_fbo(ctx);
 
         /* Don't add too many jobs to a single batch */
@@ -664,6 +669,67 @@ panfrost_bind_vertex_elements_state(
         ctx->vertex = hwcso;
 }
 
+/**
+ * Fix an uncompiled shader's stream output info, and produce a bitmask
+ * of which VARYING_SLOT_* are captured for stream output.
+ *
+ * Core Gallium stores output->register_index as a "slot" number, where
+ * slots are assigned consecutively to all outputs in info->outputs_written.
+ * This naive packing of outputs doesn't work for us - we too have slots,
+ * but the layout is defined by the VUE map, which we won't have until we
+ * compile a specific shader variant.  So, we remap these and simply store
+ * VARYING_SLOT_* in our copy's output->register_index fields.
+ *
+ * We then produce a bitmask of outputs which are used for SO.
+ *
+ * Implementation from iris.
+ */
+
+static uint64_t
+update_so_info(struct pipe_stream_output_info *so_info,
+               uint64_t outputs_written)
+{
+	uint64_t so_outputs = 0;
+	uint8_t reverse_map[64] = {0};
+	unsigned slot = 0;
+
+	while (outputs_written)
+		reverse_map[slot++] = u_bit_scan64(&outputs_written);
+
+	for (unsigned i = 0; i < so_info->num_outputs; i++) {
+		struct pipe_stream_output *output = &so_info->output[i];
+
+		/* Map Gallium's condensed "slots" back to real VARYING_SLOT_* enums */
+		output->register_index = reverse_map[output->register_index];
+
+		so_outputs |= 1ull << output->register_index;
+	}
+
+	return so_outputs;
+}
+
+/* Compiles the default variant of a graphics CSO on a compiler thread */
+
+static void
+panfrost_precompile_shader(void *job, int thread_index)
+{
+        struct panfrost_shader_variants *so = job;
+        struct panfrost_shader_state *v = &so->variants[0];
+        uint64_t outputs_written = 0;
+
+        panfrost_shader_compile(so->screen, so->base.type,
+                                so->base.type == PIPE_SHADER_IR_NIR ?
+                                so->base.ir.nir :
+                                so->base.tokens,
+                                so->nir_sha1,
+                                tgsi_processor_to_shader_stage(so->type),
+                                v, &outputs_written);
+
+        v->stream_output = so->base.stream_output;
+        v->so_mask = update_so_info(&v->stream_output, outputs_written);
+        v->compiled = true;
+}
+
 static void *
 panfrost_create_shader_state(
         struct pipe_context *pctx,
@@ -671,26 +737,35 @@ panfrost_create_shader_state(
         enum pipe_shader_type stage)
 {
         struct panfrost_shader_variants *so = CALLOC_STRUCT(panfrost_shader_variants);
-        struct panfrost_device *dev = pan_device(pctx->screen);
+        struct panfrost_screen *screen = pan_screen(pctx->screen);
         so->base = *cso;
+        so->screen = pctx->screen;
+        so->type = stage;
 
         /* Token deep copy to prevent memory corruption */
 
         if (cso->type == PIPE_SHADER_IR_TGSI)
                 so->base.tokens = tgsi_dup_tokens(so->base.tokens);
 
-        /* Precompile for shader-db if we need to */
-        if (unlikely((dev->debug & PAN_DBG_PRECOMPILE) && cso->type == PIPE_SHADER_IR_NIR)) {
-                struct panfrost_context *ctx = pan_context(pctx);
+        panfrost_disk_cache_init_shader_key(screen,
+                                            so->base.type,
+                                            so->base.type == PIPE_SHADER_IR_NIR ?
+                                            so->base.ir.nir :
+                                            so->base.tokens,
+                                            so->nir_sha1);
 
-                struct panfrost_shader_state state = { 0 };
-                uint64_t outputs_written;
+        /* Precompile a variant with the default key (all render targets
+         * natively blendable), which is what nearly every shader ends up
+         * using, so it is hopefully ready by the time it is bound. This also
+         * serves shader-db with PAN_MESA_DEBUG=precompile. */
 
-                panfrost_shader_compile(ctx, PIPE_SHADER_IR_NIR,
-                                        so->base.ir.nir,
-                                        tgsi_processor_to_shader_stage(stage),
-                                        &state, &outputs_written);
-        }
+        so->variants = calloc(1, sizeof(struct panfrost_shader_state));
+        so->variant_space = 1;
+        so->variant_count = 1;
+
+        util_queue_fence_init(&so->ready);
+        util_queue_add_job(&screen->shader_compiler_queue, so, &so->ready,
+                           panfrost_precompile_shader, NULL, 0);
 
         return so;
 }
@@ -702,18 +777,22 @@ panfrost_delete_shader_state(
 {
         struct panfrost_shader_variants *cso = (struct panfrost_shader_variants *) so;
 
+        /* The compiler thread may still be writing the default variant */
+        util_queue_fence_wait(&cso->ready);
+        util_queue_fence_destroy(&cso->ready);
+
         if (cso->base.type == PIPE_SHADER_IR_TGSI) {
                 /* TODO: leaks TGSI tokens! */
         }
 
         for (unsigned i = 0; i < cso->variant_count; ++i) {
                 struct panfrost_shader_state *shader_state = &cso->variants[i];
-                panfrost_bo_unreference(shader_state->bo);
+                panfrost_suballoc_destroy(pan_screen(pctx->screen), shader_state->bin);
 
                 if (shader_state->upload.rsrc)
                         pipe_resource_reference(&shader_state->upload.rsrc, NULL);
 
-                shader_state->bo = NULL;
+                shader_state->bin = NULL;
         }
         free(cso->variants);
 
@@ -791,61 +870,18 @@ panfrost_variant_matches(
         return true;
 }
 
-/**
- * Fix an uncompiled shader's stream output info, and produce a bitmask
- * of which VARYING_SLOT_* are captured for stream output.
- *
- * Core Gallium stores output->register_index as a "slot" number, where
- * slots are assigned consecutively to all outputs in info->outputs_written.
- * This naive packing of outputs doesn't work for us - we too have slots,
- * but the layout is defined by the VUE map, which we won't have until we
- * compile a specific shader variant.  So, we remap these and simply store
- * VARYING_SLOT_* in our copy's output->register_index fields.
- *
- * We then produce a bitmask of outputs which are used for SO.
- *
- * Implementation from iris.
- */
-
-static uint64_t
-update_so_info(struct pipe_stream_output_info *so_info,
-               uint64_t outputs_written)
-{
-	uint64_t so_outputs = 0;
-	uint8_t reverse_map[64] = {0};
-	unsigned slot = 0;
-
-	while (outputs_written)
-		reverse_map[slot++] = u_bit_scan64(&outputs_written);
-
-	for (unsigned i = 0; i < so_info->num_outputs; i++) {
-		struct pipe_stream_output *output = &so_info->output[i];
-
-		/* Map Gallium's condensed "slots" back to real VARYING_SLOT_* enums */
-		output->register_index = reverse_map[output->register_index];
-
-		so_outputs |= 1ull << output->register_index;
-	}
-
-	return so_outputs;
-}
-
 static void
-panfrost_bind_shader_state(
-        struct pipe_context *pctx,
-        void *hwcso,
+panfrost_select_shader_variant(
+        struct panfrost_context *ctx,
+        struct panfrost_shader_variants *variants,
         enum pipe_shader_type type)
 {
-        struct panfrost_context *ctx = pan_context(pctx);
+        struct pipe_context *pctx = &ctx->base;
         struct panfrost_device *dev = pan_device(ctx->base.screen);
-        ctx->shader[type] = hwcso;
-
-        if (!hwcso) return;
 
         /* Match the appropriate variant */
 
         signed variant = -1;
-        struct panfrost_shader_variants *variants = (struct panfrost_shader_variants *) hwcso;
 
         for (unsigned i = 0; i < variants->variant_count; ++i) {
                 if (panfrost_variant_matches(ctx, &variants->variants[i], type)) {
@@ -910,10 +946,11 @@ panfrost_bind_shader_state(
         if (!shader_state->compiled) {
                 uint64_t outputs_written = 0;
 
-                panfrost_shader_compile(ctx, variants->base.type,
+                panfrost_shader_compile(pctx->screen, variants->base.type,
                                         variants->base.type == PIPE_SHADER_IR_NIR ?
                                         variants->base.ir.nir :
                                         variants->base.tokens,
+                                        variants->nir_sha1,
                                         tgsi_processor_to_shader_stage(type),
                                         shader_state,
                                         &outputs_written);
@@ -927,6 +964,53 @@ panfrost_bind_shader_state(
                 shader_state->so_mask =
                         update_so_info(&shader_state->stream_output, outputs_written);
         }
+
+        if (type != PIPE_SHADER_FRAGMENT && !shader_state->upload.rsrc)
+                panfrost_upload_shader_descriptor(ctx, shader_state);
+}
+
+static void
+panfrost_bind_shader_state(
+        struct pipe_context *pctx,
+        void *hwcso,
+        enum pipe_shader_type type)
+{
+        struct panfrost_context *ctx = pan_context(pctx);
+        struct panfrost_shader_variants *variants = hwcso;
+
+        ctx->shader[type] = hwcso;
+        ctx->deferred_shader_variants &= ~BITFIELD_BIT(type);
+
+        if (!hwcso) return;
+
+        /* Matching needs the compiled default variant, and the array may be
+         * resized, so we can't race the compiler thread. If it is still
+         * compiling, leave that to the next draw. */
+        if (!util_queue_fence_is_signalled(&variants->ready)) {
+                ctx->deferred_shader_variants |= BITFIELD_BIT(type);
+                return;
+        }
+
+        panfrost_select_shader_variant(ctx, variants, type);
+}
+
+/* Selects the variants of shaders bound while their default variant was
+ * still compiling, waiting for it. Called before drawing. */
+
+static void
+panfrost_update_shader_variants(struct panfrost_context *ctx)
+{
+        unsigned mask = ctx->deferred_shader_variants;
+
+        while (mask) {
+                unsigned type = u_bit_scan(&mask);
+                struct panfrost_shader_variants *variants = ctx->shader[type];
+
+                util_queue_fence_wait(&variants->ready);
+                panfrost_select_shader_variant(ctx, variants, type);
+        }
+
+        ctx->deferred_shader_variants = 0;
 }
 
 static void *
@@ -1075,15 +1159,15 @@ panfrost_create_sampler_view_bo(struct panfrost_sampler_view *so,
                                                        type,
                                                        prsrc->layout.modifier);
 
-        so->bo = panfrost_bo_create(device, size, 0);
+        so->desc = panfrost_suballoc_create(pan_screen(pctx->screen), size, 0);
 
         unsigned width = is_buffer ?
                 (so->base.u.buf.size / util_format_get_blocksize(so->base.format)) :
                 texture->width0;
         unsigned offset = is_buffer ? so->base.u.buf.offset : 0;
 
-        struct panfrost_ptr payload = so->bo->ptr;
-        void *tex = is_bifrost ? &so->bifrost_descriptor : so->bo->ptr.cpu;
+        struct panfrost_ptr payload = so->desc->ptr;
+        void *tex = is_bifrost ? &so->bifrost_descriptor : so->desc->ptr.cpu;
 
         if (!is_bifrost) {
                 payload.cpu += MALI_MIDGARD_TEXTURE_LENGTH;
@@ -1160,7 +1244,7 @@ panfrost_sampler_view_destroy(
         struct panfrost_sampler_view *view = (struct panfrost_sampler_view *) pview;
 
         pipe_resource_reference(&pview->texture, NULL);
-        panfrost_bo_unreference(view->bo);
+        panfrost_suballoc_destroy(pan_screen(pctx->screen), view->desc);
         ralloc_free(view);
 }
 
@@ -1191,7 +1275,8 @@ panfrost_set_framebuffer_state(struct pipe_context *pctx,
          * keyed to the framebuffer format (due to EXT_framebuffer_fetch) */
         struct panfrost_shader_variants *fs = ctx->shader[PIPE_SHADER_FRAGMENT];
 
-        if (fs && fs->variant_count && fs->variants[fs->active_variant].outputs_read)
+        if (fs && !(ctx->deferred_shader_variants & BITFIELD_BIT(PIPE_SHADER_FRAGMENT)) &&
+            fs->variant_count && fs->variants[fs->active_variant].outputs_read)
                 ctx->base.bind_fs_state(&ctx->base, fs);
 }
 
@@ -1356,6 +1441,11 @@ panfrost_destroy(struct pipe_context *pipe)
         u_upload_destroy(pipe->stream_uploader);
         u_upload_destroy(panfrost->state_uploader);
 
+        panfrost_batch_fini(panfrost);
+
+        panfrost_pool_ring_fini(&panfrost->transient_ring);
+        panfrost_pool_ring_fini(&panfrost->invisible_ring);
+
         ralloc_free(pipe);
 }
 
@@ -1666,6 +1756,8 @@ panfrost_create_context(struct pipe_screen *screen, void *priv, unsigned flags)
 
         /* Prepare for render! */
 
+        panfrost_pool_ring_init(&ctx->transient_ring, dev, 0);
+        panfrost_pool_ring_init(&ctx->invisible_ring, dev, PAN_BO_INVISIBLE);
         panfrost_batch_init(ctx);
 
         ctx->blit_blend = rzalloc(ctx, struct panfrost_blend_state);
@@ -45,6 +45,7 @@
 #include "pipe/p_state.h"
 #include "util/u_blitter.h"
 #include "util/hash_table.h"
+#include "util/u_queue.h"
 
 #include "midgard/midgard_compile.h"
 #include "compiler/shader_enums.h"
@@ -112,12 +113,24 @@ struct panfrost_context {
         /* Sync obj used to keep track of in-flight jobs. */
         uint32_t syncobj;
 
+        /* Transient slabs recycled between the batches' pools */
+        struct pan_pool_ring transient_ring;
+        struct pan_pool_ring invisible_ring;
+
         /* Bound job batch and map of panfrost_batch_key to job batches */
         struct panfrost_batch *batch;
         struct hash_table *batches;
 
-        /* panfrost_bo -> panfrost_bo_access */
-        struct hash_table *accessed_bos;
+        /* GEM handle -> panfrost_bo_access, with the handles of the entries
+         * in use during the current epoch listed in bo_access_live */
+        struct util_sparse_array bo_access;
+        struct util_dynarray bo_access_live;
+        uint32_t bo_access_epoch;
+
+        /* Storage of the last freed batch's BO arrays, handed to the next
+         * batch so steady-state frames don't reallocate them */
+        struct util_dynarray spare_bo_list;
+        struct util_dynarray spare_bo_handles;
 
         /* Within a launch_grid call.. */
         const struct pipe_grid_info *compute_grid;
@@ -148,6 +161,10 @@ struct panfrost_context {
 
         struct panfrost_rasterizer *rasterizer;
         struct panfrost_shader_variants *shader[PIPE_SHADER_TYPES];
+
+        /* Stages whose shader was bound while its default variant was still
+         * compiling, and still need a variant selected */
+        uint32_t deferred_shader_variants;
         struct panfrost_vertex_state *vertex;
 
         struct pipe_vertex_buffer vertex_buffers[PIPE_MAX_ATTRIBS];
@@ -205,6 +222,12 @@ struct panfrost_shader_state {
                 uint32_t offset;
         } upload;
 
+        /* GPU-executable memory, sub-allocated */
+        struct panfrost_suballoc *bin;
+
+        /* Everything from here on is filled in by the compile and serialized
+         * verbatim to the disk cache, see pan_disk_cache.c */
+
         struct MALI_SHADER shader;
         struct MALI_RENDERER_PROPERTIES properties;
         struct MALI_PRELOAD preload;
@@ -242,9 +265,6 @@ struct panfrost_shader_state {
         /* Should we enable helper invocations */
         bool helper_invocations;
 
-        /* GPU-executable memory */
-        struct panfrost_bo *bo;
-
         BITSET_WORD outputs_read;
         enum pipe_format rt_formats[8];
 
@@ -264,6 +284,17 @@ struct panfrost_shader_variants {
                 struct pipe_compute_state cbase;
         };
 
+        /* Hash of the uncompiled shader, for the disk cache */
+        unsigned char nir_sha1[20];
+
+        /* The first variant is compiled with a default key on the screen's
+         * compiler queue at CSO creation. Signalled once it is ready, and
+         * must be waited on before the variants are inspected or resized,
+         * which binding defers to the next draw when it isn't */
+        struct util_queue_fence ready;
+        struct pipe_screen *screen;
+        enum pipe_shader_type type;
+
         struct panfrost_shader_state *variants;
         unsigned variant_space;
 
@@ -300,7 +331,9 @@ struct panfrost_sampler_state {
 
 struct panfrost_sampler_view {
         struct pipe_sampler_view base;
-        struct panfrost_bo *bo;
+
+        /* Texture descriptor (Midgard only) followed by the payload */
+        struct panfrost_suballoc *desc;
         struct mali_bifrost_texture_packed bifrost_descriptor;
         mali_ptr texture_bo;
         uint64_t modifier;
@@ -366,13 +399,46 @@ mali_ptr
 panfrost_fragment_job(struct panfrost_batch *batch, bool has_draws);
 
 void
-panfrost_shader_compile(struct panfrost_context *ctx,
+panfrost_shader_compile(struct pipe_screen *pscreen,
                         enum pipe_shader_ir ir_type,
                         const void *ir,
+                        const unsigned char *nir_sha1,
                         gl_shader_stage stage,
                         struct panfrost_shader_state *state,
                         uint64_t *outputs_written);
 
+void
+panfrost_upload_shader_descriptor(struct panfrost_context *ctx,
+                                  struct panfrost_shader_state *state);
+
+/* Disk cache */
+
+struct panfrost_screen;
+
+void
+panfrost_disk_cache_init(struct panfrost_screen *screen);
+
+void
+panfrost_disk_cache_init_shader_key(struct panfrost_screen *screen,
+                                    enum pipe_shader_ir ir_type,
+                                    const void *ir,
+                                    unsigned char *nir_sha1);
+
+void
+panfrost_disk_cache_store(struct panfrost_screen *screen,
+                          const unsigned char *nir_sha1,
+                          gl_shader_stage stage,
+                          const struct panfrost_shader_state *state,
+                          const void *binary, unsigned binary_size,
+                          uint64_t outputs_written);
+
+bool
+panfrost_disk_cache_retrieve(struct panfrost_screen *screen,
+                             const unsigned char *nir_sha1,
+                             gl_shader_stage stage,
+                             struct panfrost_shader_state *state,
+                             uint64_t *outputs_written);
+
 void
 panfrost_create_sampler_view_bo(struct panfrost_sampler_view *so,
                                 struct pipe_context *pctx,
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler/nir/nir.h"
+#include "compiler/nir/nir_serialize.h"
+#include "tgsi/tgsi_parse.h"
+#include "util/blob.h"
+#include "util/build_id.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
+
+#include "pan_bo.h"
+#include "pan_context.h"
+#include "pan_screen.h"
+#include "pan_util.h"
+
+/* Everything in panfrost_shader_state from the shader descriptor onwards is
+ * plain data derived from the compile, so it is written to the cache as a
+ * single range. GPU addresses within it are relocated on retrieval. */
+
+#define PAN_SHADER_CACHE_PTR(s) \
+        ((char *) (s) + offsetof(struct panfrost_shader_state, shader))
+
+#define PAN_SHADER_CACHE_SIZE \
+        (sizeof(struct panfrost_shader_state) - \
+         offsetof(struct panfrost_shader_state, shader))
+
+/* Hash the uncompiled shader once at CSO creation. Variant keys are mixed in
+ * later at compile time. */
+
+void
+panfrost_disk_cache_init_shader_key(struct panfrost_screen *screen,
+                                    enum pipe_shader_ir ir_type,
+                                    const void *ir,
+                                    unsigned char *nir_sha1)
+{
+        if (!screen->disk_cache)
+                return;
+
+        struct mesa_sha1 ctx;
+        _mesa_sha1_init(&ctx);
+
+        if (ir_type == PIPE_SHADER_IR_NIR) {
+                /* Drop names and the like so isomorphic shaders share an
+                 * entry, and so the blob we hash is smaller */
+                struct blob blob;
+                blob_init(&blob);
+                nir_serialize(&blob, ir, true);
+                _mesa_sha1_update(&ctx, blob.data, blob.size);
+                blob_finish(&blob);
+        } else {
+                assert(ir_type == PIPE_SHADER_IR_TGSI);
+                _mesa_sha1_update(&ctx, ir, tgsi_num_tokens(ir) *
+                                  sizeof(struct tgsi_token));
+        }
+
+        _mesa_sha1_final(&ctx, nir_sha1);
+}
+
+static void
+panfrost_disk_cache_compute_key(struct disk_cache *cache,
+                                const unsigned char *nir_sha1,
+                                gl_shader_stage stage,
+                                const struct panfrost_shader_state *state,
+                                cache_key cache_key)
+{
+        /* The variant key is just the render target formats for now, which
+         * are filled in before we're called */
+        uint8_t data[20 + sizeof(uint32_t) + sizeof(state->rt_formats)];
+        uint32_t stage32 = stage;
+
+        memcpy(data, nir_sha1, 20);
+        memcpy(data + 20, &stage32, sizeof(stage32));
+        memcpy(data + 20 + sizeof(stage32), state->rt_formats,
+               sizeof(state->rt_formats));
+
+        disk_cache_compute_key(cache, data, sizeof(data), cache_key);
+}
+
+/* Store a freshly compiled variant. The binary is passed in directly rather
+ * than read back from the (write-combined) shader BO */
+
+void
+panfrost_disk_cache_store(struct panfrost_screen *screen,
+                          const unsigned char *nir_sha1,
+                          gl_shader_stage stage,
+                          const struct panfrost_shader_state *state,
+                          const void *binary, unsigned binary_size,
+                          uint64_t outputs_written)
+{
+        struct disk_cache *cache = screen->disk_cache;
+
+        if (!cache || !nir_sha1)
+                return;
+
+        cache_key cache_key;
+        panfrost_disk_cache_compute_key(cache, nir_sha1, stage, state, cache_key);
+
+        struct blob blob;
+        blob_init(&blob);
+
+        /* We write the following data to the cache blob:
+         *
+         * 1. Size of the binary and the binary itself
+         * 2. GPU address the binary was uploaded to, for relocation
+         * 3. Outputs written, for stream output fixups
+         * 4. The compile-derived part of the shader state
+         */
+        blob_write_uint32(&blob, binary_size);
+        blob_write_bytes(&blob, binary, binary_size);
+        blob_write_uint64(&blob, state->bin ? state->bin->ptr.gpu : 0);
+        blob_write_uint64(&blob, outputs_written);
+        blob_write_bytes(&blob, PAN_SHADER_CACHE_PTR(state),
+                         PAN_SHADER_CACHE_SIZE);
+
+        disk_cache_put(cache, cache_key, blob.data, blob.size, NULL);
+        blob_finish(&blob);
+}
+
+/* Search for a compiled variant. On a hit, the binary is uploaded to a fresh
+ * allocation and the state is filled in as if it had been compiled. The caller
+ * remains responsible for uploading the renderer state descriptor. */
+
+bool
+panfrost_disk_cache_retrieve(struct panfrost_screen *screen,
+                             const unsigned char *nir_sha1,
+                             gl_shader_stage stage,
+                             struct panfrost_shader_state *state,
+                             uint64_t *outputs_written)
+{
+        struct disk_cache *cache = screen->disk_cache;
+
+        if (!cache || !nir_sha1)
+                return false;
+
+        cache_key cache_key;
+        panfrost_disk_cache_compute_key(cache, nir_sha1, stage, state, cache_key);
+
+        size_t size;
+        void *buffer = disk_cache_get(cache, cache_key, &size);
+
+        if (!buffer)
+                return false;
+
+        struct blob_reader blob;
+        blob_reader_init(&blob, buffer, size);
+
+        uint32_t binary_size = blob_read_uint32(&blob);
+        const void *binary = blob_read_bytes(&blob, binary_size);
+        uint64_t old_base = blob_read_uint64(&blob);
+        uint64_t written = blob_read_uint64(&blob);
+        const void *cached = blob_read_bytes(&blob, PAN_SHADER_CACHE_SIZE);
+
+        /* Truncated or stale entry, fall back to compiling */
+        if (blob.overrun) {
+                free(buffer);
+                return false;
+        }
+
+        if (binary_size) {
+                state->bin = panfrost_suballoc_create(screen, binary_size,
+                                                      PAN_BO_EXECUTE);
+
+                /* Out of memory, treat it as a miss */
+                if (!state->bin) {
+                        free(buffer);
+                        return false;
+                }
+        }
+
+        memcpy(PAN_SHADER_CACHE_PTR(state), cached, PAN_SHADER_CACHE_SIZE);
+
+        if (binary_size) {
+                memcpy(state->bin->ptr.cpu, binary, binary_size);
+
+                /* Relocate everything that pointed into the old upload,
+                 * keeping the Midgard tag in the bottom bits */
+                uint64_t new_base = state->bin->ptr.gpu;
+                state->shader.shader = new_base + (state->shader.shader - old_base);
+
+                for (unsigned i = 0; i < ARRAY_SIZE(state->blend_ret_addrs); i++) {
+                        if (!state->blend_ret_addrs[i])
+                                continue;
+
+                        state->blend_ret_addrs[i] = (new_base & UINT32_MAX) +
+                                (state->blend_ret_addrs[i] - (old_base & UINT32_MAX));
+                }
+        }
+
+        if (outputs_written)
+                *outputs_written = written;
+
+        free(buffer);
+        return true;
+}
+
+/* Initialize the on-disk shader cache. The GPU ID goes in the renderer name
+ * since Midgard and Bifrost binaries, and quirks within each, differ. */
+
+void
+panfrost_disk_cache_init(struct panfrost_screen *screen)
+{
+#ifdef ENABLE_SHADER_CACHE
+        struct panfrost_device *dev = &screen->dev;
+
+        /* shader-db wants statistics for every compile */
+        if (dev->debug & PAN_DBG_PRECOMPILE)
+                return;
+
+        char renderer[20];
+        UNUSED int len = snprintf(renderer, sizeof(renderer), "panfrost_%04x",
+                                  dev->gpu_id);
+        assert(len < sizeof(renderer));
+
+        const struct build_id_note *note =
+                build_id_find_nhdr_for_addr(panfrost_disk_cache_init);
+        assert(note && build_id_length(note) == 20); /* sha1 */
+
+        const uint8_t *id_sha1 = build_id_data(note);
+        assert(id_sha1);
+
+        char timestamp[41];
+        _mesa_sha1_format(timestamp, id_sha1);
+
+        screen->disk_cache = disk_cache_create(renderer, timestamp, 0);
+#endif
+}
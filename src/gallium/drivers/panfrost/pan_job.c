@@ -45,7 +45,10 @@
  * and build a proper dependency graph such that batches can be pipelined for
  * better GPU utilization.
  *
- * Each accessed BO has a corresponding entry in the ->accessed_bos hash table.
+ * Each BO has an entry in the ->bo_access sparse array, indexed by GEM handle.
+ * Entries touched since the last fence collection are listed in
+ * ->bo_access_live and carry the current ->bo_access_epoch; any other entry
+ * is empty, so bumping the epoch resets them all at once.
  * A BO is either being written or read at any time (see last_is_write).
  * When the last access is a write, the batch writing the BO might have read
  * dependencies (readers that have not been executed yet and want to read the
@@ -57,9 +60,21 @@
  * the old writer (at the batch level), and panfrost_bo_access->writer will be
  * updated to point to the new writer.
  */
+
+/* Few BOs are read by more than a handful of batches in flight, so the
+ * readers are stored inline until they outgrow this */
+#define PAN_BO_ACCESS_INLINE_READERS 4
+
 struct panfrost_bo_access {
-        struct util_dynarray readers;
         struct panfrost_batch_fence *writer;
+
+        /* Points to inline_readers, or to a heap array when there are more
+         * than PAN_BO_ACCESS_INLINE_READERS readers. NULL when empty. */
+        struct panfrost_batch_fence **readers;
+        struct panfrost_batch_fence *inline_readers[PAN_BO_ACCESS_INLINE_READERS];
+        unsigned num_readers, max_readers;
+
+        uint32_t epoch;
         bool last_is_write;
 };
 
@@ -110,6 +125,12 @@ panfrost_create_batch(struct panfrost_context *ctx,
         batch->bos = _mesa_hash_table_create(batch, _mesa_hash_pointer,
                         _mesa_key_pointer_equal);
 
+        /* Take over the storage of the last freed batch */
+        batch->bo_list = ctx->spare_bo_list;
+        batch->bo_handles = ctx->spare_bo_handles;
+        util_dynarray_init(&ctx->spare_bo_list, ctx);
+        util_dynarray_init(&ctx->spare_bo_handles, ctx);
+
         batch->minx = batch->miny = ~0;
         batch->maxx = batch->maxy = 0;
 
@@ -118,12 +139,14 @@ panfrost_create_batch(struct panfrost_context *ctx,
 
         /* Preallocate the main pool, since every batch has at least one job
          * structure so it will be used */
-        panfrost_pool_init(&batch->pool, batch, dev, 0, true);
+        panfrost_pool_init(&batch->pool, batch, dev, 0,
+                           &ctx->transient_ring, true);
 
         /* Don't preallocate the invisible pool, since not every batch will use
          * the pre-allocation, particularly if the varyings are larger than the
          * preallocation and a reallocation is needed after anyway. */
-        panfrost_pool_init(&batch->invisible_pool, batch, dev, PAN_BO_INVISIBLE, false);
+        panfrost_pool_init(&batch->invisible_pool, batch, dev, PAN_BO_INVISIBLE,
+                           &ctx->invisible_ring, false);
 
         panfrost_batch_add_fbo_bos(batch);
 
@@ -148,6 +171,23 @@ panfrost_freeze_batch(struct panfrost_batch *batch)
                 ctx->batch = NULL;
 }
 
+/* Keep whichever of the two arrays has the larger allocation around for the
+ * next batch, releasing the other */
+
+static void
+panfrost_recycle_dynarray(struct util_dynarray *spare,
+                          struct util_dynarray *arr)
+{
+        if (arr->capacity > spare->capacity) {
+                struct util_dynarray tmp = *spare;
+                *spare = *arr;
+                *arr = tmp;
+        }
+
+        util_dynarray_clear(spare);
+        util_dynarray_fini(arr);
+}
+
 #ifdef PAN_BATCH_DEBUG
 static bool panfrost_batch_is_frozen(struct panfrost_batch *batch)
 {
@@ -175,8 +215,13 @@ panfrost_free_batch(struct panfrost_batch *batch)
         assert(panfrost_batch_is_frozen(batch));
 #endif
 
-        hash_table_foreach(batch->bos, entry)
-                panfrost_bo_unreference((struct panfrost_bo *)entry->key);
+        struct panfrost_context *ctx = batch->ctx;
+
+        util_dynarray_foreach(&batch->bo_list, struct panfrost_batch_bo, entry)
+                panfrost_bo_unreference(entry->bo);
+
+        panfrost_recycle_dynarray(&ctx->spare_bo_list, &batch->bo_list);
+        panfrost_recycle_dynarray(&ctx->spare_bo_handles, &batch->bo_handles);
 
         panfrost_pool_cleanup(&batch->pool);
         panfrost_pool_cleanup(&batch->invisible_pool);
@@ -319,31 +364,74 @@ panfrost_get_fresh_batch_for_fbo(struct panfrost_context *ctx)
 }
 
 static void
-panfrost_bo_access_gc_fences(struct panfrost_context *ctx,
-                             struct panfrost_bo_access *access,
-			     const struct panfrost_bo *bo)
+panfrost_bo_access_add_reader(struct panfrost_bo_access *access,
+                              struct panfrost_batch_fence *reader)
+{
+        if (!access->readers) {
+                access->readers = access->inline_readers;
+                access->max_readers = PAN_BO_ACCESS_INLINE_READERS;
+        }
+
+        if (access->num_readers == access->max_readers) {
+                unsigned max = access->max_readers * 2;
+                struct panfrost_batch_fence **readers;
+
+                if (access->readers == access->inline_readers) {
+                        readers = malloc(max * sizeof(*readers));
+                        assert(readers);
+                        memcpy(readers, access->inline_readers,
+                               sizeof(access->inline_readers));
+                } else {
+                        readers = realloc(access->readers,
+                                          max * sizeof(*readers));
+                        assert(readers);
+                }
+
+                access->readers = readers;
+                access->max_readers = max;
+        }
+
+        panfrost_batch_fence_reference(reader);
+        access->readers[access->num_readers++] = reader;
+}
+
+static void
+panfrost_bo_access_clear_readers(struct panfrost_bo_access *access)
+{
+        for (unsigned i = 0; i < access->num_readers; ++i)
+                panfrost_batch_fence_unreference(access->readers[i]);
+
+        access->num_readers = 0;
+}
+
+static void
+panfrost_bo_access_gc_fences(struct panfrost_bo_access *access)
 {
         if (access->writer) {
                 panfrost_batch_fence_unreference(access->writer);
                 access->writer = NULL;
         }
 
-        struct panfrost_batch_fence **readers_array = util_dynarray_begin(&access->readers);
-        struct panfrost_batch_fence **new_readers = readers_array;
+        panfrost_bo_access_clear_readers(access);
 
-        util_dynarray_foreach(&access->readers, struct panfrost_batch_fence *,
-                              reader) {
-                if (!(*reader))
-                        continue;
+        if (access->readers != access->inline_readers)
+                free(access->readers);
 
-                panfrost_batch_fence_unreference(*reader);
-                *reader = NULL;
-        }
+        access->readers = NULL;
+        access->max_readers = 0;
+}
+
+/* Returns the access entry for a BO, or NULL if no batch accessed it since the
+ * fences were last collected */
 
-        if (!util_dynarray_resize(&access->readers, struct panfrost_batch_fence *,
-                                  new_readers - readers_array) &&
-            new_readers != readers_array)
-                unreachable("Invalid dynarray access->readers");
+static struct panfrost_bo_access *
+panfrost_bo_access_lookup(struct panfrost_context *ctx,
+                          const struct panfrost_bo *bo)
+{
+        struct panfrost_bo_access *access =
+                util_sparse_array_get(&ctx->bo_access, bo->gem_handle);
+
+        return access->epoch == ctx->bo_access_epoch ? access : NULL;
 }
 
 /* Collect signaled fences to keep the kernel-side syncobj-map small. The
@@ -358,18 +446,18 @@ panfrost_bo_access_gc_fences(struct panfrost_context *ctx,
 static void
 panfrost_gc_fences(struct panfrost_context *ctx)
 {
-        hash_table_foreach(ctx->accessed_bos, entry) {
-                struct panfrost_bo_access *access = entry->data;
-
-                assert(access);
-                panfrost_bo_access_gc_fences(ctx, access, entry->key);
-                if (!util_dynarray_num_elements(&access->readers,
-                                                struct panfrost_batch_fence *) &&
-                    !access->writer) {
-                        ralloc_free(access);
-                        _mesa_hash_table_remove(ctx->accessed_bos, entry);
-                }
+        util_dynarray_foreach(&ctx->bo_access_live, uint32_t, handle) {
+                struct panfrost_bo_access *access =
+                        util_sparse_array_get(&ctx->bo_access, *handle);
+
+                panfrost_bo_access_gc_fences(access);
         }
+
+        util_dynarray_clear(&ctx->bo_access_live);
+
+        /* Every entry is empty now, start a new epoch so they read as
+         * untouched */
+        ctx->bo_access_epoch++;
 }
 
 #ifdef PAN_BATCH_DEBUG
@@ -377,9 +465,8 @@ static bool
 panfrost_batch_in_readers(struct panfrost_batch *batch,
                           struct panfrost_bo_access *access)
 {
-        util_dynarray_foreach(&access->readers, struct panfrost_batch_fence *,
-                              reader) {
-                if (*reader && (*reader)->batch == batch)
+        for (unsigned i = 0; i < access->num_readers; ++i) {
+                if (access->readers[i]->batch == batch)
                         return true;
         }
 
@@ -395,39 +482,37 @@ panfrost_batch_update_bo_access(struct panfrost_batch *batch,
         struct panfrost_context *ctx = batch->ctx;
         struct panfrost_bo_access *access;
         bool old_writes = false;
-        struct hash_entry *entry;
 
-        entry = _mesa_hash_table_search(ctx->accessed_bos, bo);
-        access = entry ? entry->data : NULL;
-        if (access) {
+        access = util_sparse_array_get(&ctx->bo_access, bo->gem_handle);
+        if (access->epoch == ctx->bo_access_epoch) {
                 old_writes = access->last_is_write;
         } else {
-                access = rzalloc(ctx, struct panfrost_bo_access);
-                util_dynarray_init(&access->readers, access);
-                _mesa_hash_table_insert(ctx->accessed_bos, bo, access);
+                assert(!access->writer && !access->num_readers);
+                access->epoch = ctx->bo_access_epoch;
+                util_dynarray_append(&ctx->bo_access_live, uint32_t,
+                                     bo->gem_handle);
                 /* We are the first to access this BO, let's initialize
                  * old_writes to our own access type in that case.
                  */
                 old_writes = writes;
         }
 
-        assert(access);
-
         if (writes && !old_writes) {
                 /* Previous access was a read and we want to write this BO.
                  * We first need to add explicit deps between our batch and
                  * the previous readers.
                  */
-                util_dynarray_foreach(&access->readers,
-                                      struct panfrost_batch_fence *, reader) {
+                for (unsigned i = 0; i < access->num_readers; ++i) {
+                        struct panfrost_batch_fence *reader = access->readers[i];
+
                         /* We were already reading the BO, no need to add a dep
                          * on ourself (the acyclic check would complain about
                          * that).
                          */
-                        if (!(*reader) || (*reader)->batch == batch)
+                        if (reader->batch == batch)
                                 continue;
 
-                        panfrost_batch_add_dep(batch, *reader);
+                        panfrost_batch_add_dep(batch, reader);
                 }
                 panfrost_batch_fence_reference(batch->out_sync);
 
@@ -438,15 +523,7 @@ panfrost_batch_update_bo_access(struct panfrost_batch *batch,
                 access->writer = batch->out_sync;
 
                 /* Release the previous readers and reset the readers array. */
-                util_dynarray_foreach(&access->readers,
-                                      struct panfrost_batch_fence *,
-                                      reader) {
-                        if (!*reader)
-                                continue;
-                        panfrost_batch_fence_unreference(*reader);
-                }
-
-                util_dynarray_clear(&access->readers);
+                panfrost_bo_access_clear_readers(access);
         } else if (writes && old_writes) {
                 /* First check if we were the previous writer, in that case
                  * there's nothing to do. Otherwise we need to add a
@@ -472,14 +549,10 @@ panfrost_batch_update_bo_access(struct panfrost_batch *batch,
                         /* The previous access was a write, there's no reason
                          * to have entries in the readers array.
                          */
-                        assert(!util_dynarray_num_elements(&access->readers,
-                                                           struct panfrost_batch_fence *));
+                        assert(!access->num_readers);
 
                         /* Add ourselves to the readers array. */
-                        panfrost_batch_fence_reference(batch->out_sync);
-                        util_dynarray_append(&access->readers,
-                                             struct panfrost_batch_fence *,
-                                             batch->out_sync);
+                        panfrost_bo_access_add_reader(access, batch->out_sync);
                 }
         } else {
                 /* We already accessed this BO before, so we should already be
@@ -496,10 +569,7 @@ panfrost_batch_update_bo_access(struct panfrost_batch *batch,
                  * Add ourselves to the readers array and add a dependency on
                  * the previous writer if any.
                  */
-                panfrost_batch_fence_reference(batch->out_sync);
-                util_dynarray_append(&access->readers,
-                                     struct panfrost_batch_fence *,
-                                     batch->out_sync);
+                panfrost_bo_access_add_reader(access, batch->out_sync);
 
                 if (access->writer)
                         panfrost_batch_add_dep(batch, access->writer);
@@ -516,28 +586,44 @@ panfrost_batch_add_bo(struct panfrost_batch *batch, struct panfrost_bo *bo,
                 return;
 
         struct hash_entry *entry;
+        struct panfrost_batch_bo *batch_bo;
         uint32_t old_flags = 0;
 
         entry = _mesa_hash_table_search(batch->bos, bo);
         if (!entry) {
-                entry = _mesa_hash_table_insert(batch->bos, bo,
-                                                (void *)(uintptr_t)flags);
+                unsigned idx = util_dynarray_num_elements(&batch->bo_list,
+                                                          struct panfrost_batch_bo);
+
+                /* The handle list is built up as BOs come in, so submitting
+                 * doesn't need to walk the hash table */
+                assert(bo->gem_handle > 0);
+                util_dynarray_append(&batch->bo_handles, uint32_t,
+                                     bo->gem_handle);
+
+                batch_bo = util_dynarray_grow(&batch->bo_list,
+                                              struct panfrost_batch_bo, 1);
+                batch_bo->bo = bo;
+                batch_bo->flags = 0;
+
+                _mesa_hash_table_insert(batch->bos, bo,
+                                        (void *)(uintptr_t)idx);
                 panfrost_bo_reference(bo);
 	} else {
-                old_flags = (uintptr_t)entry->data;
+                batch_bo = util_dynarray_element(&batch->bo_list,
+                                                 struct panfrost_batch_bo,
+                                                 (uintptr_t)entry->data);
+                old_flags = batch_bo->flags;
 
                 /* All batches have to agree on the shared flag. */
                 assert((old_flags & PAN_BO_ACCESS_SHARED) ==
                        (flags & PAN_BO_ACCESS_SHARED));
         }
 
-        assert(entry);
-
         if (old_flags == flags)
                 return;
 
         flags |= old_flags;
-        entry->data = (void *)(uintptr_t)flags;
+        batch_bo->flags = flags;
 
         /* If this is not a shared BO, we don't really care about dependency
          * tracking.
@@ -915,14 +1001,19 @@ panfrost_batch_draw_wallpaper(struct panfrost_batch *batch)
                 panfrost_load_surface(batch, batch->key.zsbuf, FRAG_RESULT_STENCIL);
 }
 
-static void
-panfrost_batch_record_bo(struct hash_entry *entry, unsigned *bo_handles, unsigned idx)
-{
-        struct panfrost_bo *bo = (struct panfrost_bo *)entry->key;
-        uint32_t flags = (uintptr_t)entry->data;
+/* Complete the batch's handle list with the pool BOs and the tiler heap. The
+ * entries past the BOs added with panfrost_batch_add_bo() are scratch, so
+ * this is done once per submit and is undone by the next call. Returns the
+ * number of handles. */
 
-        assert(bo->gem_handle > 0);
-        bo_handles[idx] = bo->gem_handle;
+static unsigned
+panfrost_batch_finalize_bo_handles(struct panfrost_batch *batch)
+{
+        struct panfrost_device *dev = pan_device(batch->ctx->base.screen);
+        unsigned count = util_dynarray_num_elements(&batch->bo_list,
+                                                    struct panfrost_batch_bo);
+        unsigned num_pool_bos = panfrost_pool_num_bos(&batch->pool);
+        unsigned num_invisible_bos = panfrost_pool_num_bos(&batch->invisible_pool);
 
         /* Update the BO access flags so that panfrost_bo_wait() knows
          * about all pending accesses.
@@ -931,7 +1022,25 @@ panfrost_batch_record_bo(struct hash_entry *entry, unsigned *bo_handles, unsigne
          * We also preserve existing flags as this batch might not
          * be the first one to access the BO.
          */
-        bo->gpu_access |= flags & (PAN_BO_ACCESS_RW);
+        util_dynarray_foreach(&batch->bo_list, struct panfrost_batch_bo, entry)
+                entry->bo->gpu_access |= entry->flags & PAN_BO_ACCESS_RW;
+
+        batch->bo_handles.size = count * sizeof(uint32_t);
+
+        uint32_t *handles = util_dynarray_grow(&batch->bo_handles, uint32_t,
+                                               num_pool_bos +
+                                               num_invisible_bos + 1);
+
+        panfrost_pool_get_bo_handles(&batch->pool, handles);
+        handles += num_pool_bos;
+        panfrost_pool_get_bo_handles(&batch->invisible_pool, handles);
+        handles += num_invisible_bos;
+
+        /* Used by all tiler jobs, and read back by the fragment job through
+         * the polygon list (XXX: skip for compute-only) */
+        *handles = dev->tiler_heap->gem_handle;
+
+        return count + num_pool_bos + num_invisible_bos + 1;
 }
 
 static int
@@ -939,23 +1048,13 @@ panfrost_batch_submit_ioctl(struct panfrost_batch *batch,
                             mali_ptr first_job_desc,
                             uint32_t reqs,
                             uint32_t in_sync,
-                            uint32_t out_sync)
+                            uint32_t out_sync,
+                            unsigned bo_handle_count)
 {
-        struct panfrost_context *ctx = batch->ctx;
-        struct pipe_context *gallium = (struct pipe_context *) ctx;
-        struct panfrost_device *dev = pan_device(gallium->screen);
+        struct panfrost_device *dev = pan_device(batch->ctx->base.screen);
         struct drm_panfrost_submit submit = {0,};
-        uint32_t *bo_handles;
         int ret;
 
-        /* If we trace, we always need a syncobj, so make one of our own if we
-         * weren't given one to use. Remember that we did so, so we can free it
-         * after we're done but preventing double-frees if we were given a
-         * syncobj */
-
-        if (!out_sync && dev->debug & (PAN_DBG_TRACE | PAN_DBG_SYNC))
-                out_sync = ctx->syncobj;
-
         submit.out_sync = out_sync;
         submit.jc = first_job_desc;
         submit.requirements = reqs;
@@ -964,27 +1063,9 @@ panfrost_batch_submit_ioctl(struct panfrost_batch *batch,
                 submit.in_sync_count = 1;
         }
 
-        bo_handles = calloc(panfrost_pool_num_bos(&batch->pool) +
-                            panfrost_pool_num_bos(&batch->invisible_pool) +
-                            batch->bos->entries + 1,
-                            sizeof(*bo_handles));
-        assert(bo_handles);
-
-        hash_table_foreach(batch->bos, entry)
-                panfrost_batch_record_bo(entry, bo_handles, submit.bo_handle_count++);
-
-        panfrost_pool_get_bo_handles(&batch->pool, bo_handles + submit.bo_handle_count);
-        submit.bo_handle_count += panfrost_pool_num_bos(&batch->pool);
-        panfrost_pool_get_bo_handles(&batch->invisible_pool, bo_handles + submit.bo_handle_count);
-        submit.bo_handle_count += panfrost_pool_num_bos(&batch->invisible_pool);
-
-        /* Used by all tiler jobs (XXX: skip for compute-only) */
-        if (!(reqs & PANFROST_JD_REQ_FS))
-                bo_handles[submit.bo_handle_count++] = dev->tiler_heap->gem_handle;
-
-        submit.bo_handles = (u64) (uintptr_t) bo_handles;
+        submit.bo_handles = (u64) (uintptr_t) batch->bo_handles.data;
+        submit.bo_handle_count = bo_handle_count;
         ret = drmIoctl(dev->fd, DRM_IOCTL_PANFROST_SUBMIT, &submit);
-        free(bo_handles);
 
         if (ret) {
                 if (dev->debug & PAN_DBG_MSGS)
@@ -993,53 +1074,79 @@ panfrost_batch_submit_ioctl(struct panfrost_batch *batch,
                 return errno;
         }
 
-        /* Trace the job if we're doing that */
-        if (dev->debug & (PAN_DBG_TRACE | PAN_DBG_SYNC)) {
-                /* Wait so we can get errors reported back */
-                drmSyncobjWait(dev->fd, &out_sync, 1,
-                               INT64_MAX, 0, NULL);
-
-                /* Trace gets priority over sync */
-                bool minimal = !(dev->debug & PAN_DBG_TRACE);
-                pandecode_jc(submit.jc, dev->quirks & IS_BIFROST, dev->gpu_id, minimal);
-        }
-
         return 0;
 }
 
 /* Submit both vertex/tiler and fragment jobs for a batch, possibly with an
  * outsync corresponding to the later of the two (since there will be an
- * implicit dep between them) */
+ * implicit dep between them). The kernel takes a single job chain per
+ * submit and fragment jobs go to their own slot, so this is two ioctls, but
+ * they share one handle list and are issued back-to-back, with any
+ * debug-mode wait deferred until both are queued. */
 
 static int
 panfrost_batch_submit_jobs(struct panfrost_batch *batch, uint32_t in_sync, uint32_t out_sync)
 {
+        struct panfrost_context *ctx = batch->ctx;
+        struct panfrost_device *dev = pan_device(ctx->base.screen);
         bool has_draws = batch->scoreboard.first_job;
         bool has_frag = batch->scoreboard.tiler_dep || batch->clear;
+        mali_ptr fragjob = 0;
         int ret = 0;
 
+        /* If we trace, we always need a syncobj, so make one of our own if we
+         * weren't given one to use. */
+        if (!out_sync && dev->debug & (PAN_DBG_TRACE | PAN_DBG_SYNC))
+                out_sync = ctx->syncobj;
+
+        /* Whether we program the fragment job for draws or not depends on
+         * whether there is any *tiler* activity (so fragment shaders). If
+         * there are draws but entirely RASTERIZER_DISCARD (say, for transform
+         * feedback), we want a fragment job that *only* clears, since
+         * otherwise the tiler structures will be uninitialized leading to
+         * faults (or state leaks). It is emitted before the handle list is
+         * finalized since it may grow the pool. */
+        if (has_frag) {
+                fragjob = panfrost_fragment_job(batch,
+                                batch->scoreboard.tiler_dep != 0);
+        }
+
+        unsigned bo_handle_count = panfrost_batch_finalize_bo_handles(batch);
+
         if (has_draws) {
                 ret = panfrost_batch_submit_ioctl(batch, batch->scoreboard.first_job,
-                                                  0, in_sync, has_frag ? 0 : out_sync);
+                                                  0, in_sync, has_frag ? 0 : out_sync,
+                                                  bo_handle_count);
                 assert(!ret);
         }
 
         if (has_frag) {
-                /* Whether we program the fragment job for draws or not depends
-                 * on whether there is any *tiler* activity (so fragment
-                 * shaders). If there are draws but entirely RASTERIZER_DISCARD
-                 * (say, for transform feedback), we want a fragment job that
-                 * *only* clears, since otherwise the tiler structures will be
-                 * uninitialized leading to faults (or state leaks) */
-
-                mali_ptr fragjob = panfrost_fragment_job(batch,
-                                batch->scoreboard.tiler_dep != 0);
                 ret = panfrost_batch_submit_ioctl(batch, fragjob,
-                                                  PANFROST_JD_REQ_FS, 0,
-                                                  out_sync);
+                                                  PANFROST_JD_REQ_FS,
+                                                  has_draws ? 0 : in_sync,
+                                                  out_sync, bo_handle_count);
                 assert(!ret);
         }
 
+        /* Trace the jobs if we're doing that */
+        if (!ret && dev->debug & (PAN_DBG_TRACE | PAN_DBG_SYNC)) {
+                /* Wait so we can get errors reported back */
+                drmSyncobjWait(dev->fd, &out_sync, 1,
+                               INT64_MAX, 0, NULL);
+
+                /* Trace gets priority over sync */
+                bool minimal = !(dev->debug & PAN_DBG_TRACE);
+                bool bifrost = dev->quirks & IS_BIFROST;
+
+                if (has_draws) {
+                        pandecode_jc(batch->scoreboard.first_job, bifrost,
+                                     dev->gpu_id, minimal);
+                }
+
+                if (has_frag)
+                        pandecode_jc(fragjob, bifrost, dev->gpu_id, minimal);
+        }
+
         return ret;
 }
 
@@ -1137,20 +1244,16 @@ bool
 panfrost_pending_batches_access_bo(struct panfrost_context *ctx,
                                    const struct panfrost_bo *bo)
 {
-        struct panfrost_bo_access *access;
-        struct hash_entry *hentry;
+        struct panfrost_bo_access *access = panfrost_bo_access_lookup(ctx, bo);
 
-        hentry = _mesa_hash_table_search(ctx->accessed_bos, bo);
-        access = hentry ? hentry->data : NULL;
         if (!access)
                 return false;
 
         if (access->writer && access->writer->batch)
                 return true;
 
-        util_dynarray_foreach(&access->readers, struct panfrost_batch_fence *,
-                              reader) {
-                if (*reader && (*reader)->batch)
+        for (unsigned i = 0; i < access->num_readers; ++i) {
+                if (access->readers[i]->batch)
                         return true;
         }
 
@@ -1164,11 +1267,8 @@ panfrost_flush_batches_accessing_bo(struct panfrost_context *ctx,
                                     struct panfrost_bo *bo,
                                     bool flush_readers)
 {
-        struct panfrost_bo_access *access;
-        struct hash_entry *hentry;
+        struct panfrost_bo_access *access = panfrost_bo_access_lookup(ctx, bo);
 
-        hentry = _mesa_hash_table_search(ctx->accessed_bos, bo);
-        access = hentry ? hentry->data : NULL;
         if (!access)
                 return;
 
@@ -1178,10 +1278,13 @@ panfrost_flush_batches_accessing_bo(struct panfrost_context *ctx,
         if (!flush_readers)
                 return;
 
-        util_dynarray_foreach(&access->readers, struct panfrost_batch_fence *,
-                              reader) {
-                if (*reader && (*reader)->batch)
-                        panfrost_batch_submit((*reader)->batch, ctx->syncobj, ctx->syncobj);
+        /* Index rather than hold a pointer: submitting a batch may record
+         * new accesses, which can move the readers array */
+        for (unsigned i = 0; i < access->num_readers; ++i) {
+                struct panfrost_batch_fence *reader = access->readers[i];
+
+                if (reader->batch)
+                        panfrost_batch_submit(reader->batch, ctx->syncobj, ctx->syncobj);
         }
 }
 
@@ -1406,6 +1509,19 @@ panfrost_batch_init(struct panfrost_context *ctx)
         ctx->batches = _mesa_hash_table_create(ctx,
                                                panfrost_batch_hash,
                                                panfrost_batch_compare);
-        ctx->accessed_bos = _mesa_hash_table_create(ctx, _mesa_hash_pointer,
-                                                    _mesa_key_pointer_equal);
+        util_sparse_array_init(&ctx->bo_access,
+                               sizeof(struct panfrost_bo_access), 512);
+        util_dynarray_init(&ctx->bo_access_live, ctx);
+        util_dynarray_init(&ctx->spare_bo_list, ctx);
+        util_dynarray_init(&ctx->spare_bo_handles, ctx);
+
+        /* Zeroed entries belong to epoch 0, so they start out untouched */
+        ctx->bo_access_epoch = 1;
+}
+
+void
+panfrost_batch_fini(struct panfrost_context *ctx)
+{
+        panfrost_gc_fences(ctx);
+        util_sparse_array_finish(&ctx->bo_access);
 }
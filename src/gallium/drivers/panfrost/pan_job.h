@@ -54,6 +54,11 @@ struct panfrost_batch_fence {
 /* A panfrost_batch corresponds to a bound FBO we're rendering to,
  * collecting over multiple draws. */
 
+struct panfrost_batch_bo {
+        struct panfrost_bo *bo;
+        uint32_t flags;
+};
+
 struct panfrost_batch {
         struct panfrost_context *ctx;
         struct pipe_framebuffer_state key;
@@ -92,9 +97,16 @@ struct panfrost_batch {
         unsigned minx, miny;
         unsigned maxx, maxy;
 
-        /* BOs referenced not in the pool */
+        /* BOs referenced not in the pool, mapping each BO to its index in
+         * bo_list */
         struct hash_table *bos;
 
+        /* panfrost_batch_bo entries for those BOs in insertion order, with
+         * the matching GEM handles kept alongside so the submit ioctl can
+         * consume them directly */
+        struct util_dynarray bo_list;
+        struct util_dynarray bo_handles;
+
         /* Pool owned by this batch (released when the batch is released) used for temporary descriptors */
         struct pan_pool pool;
 
@@ -151,6 +163,9 @@ panfrost_get_fresh_batch_for_fbo(struct panfrost_context *ctx);
 void
 panfrost_batch_init(struct panfrost_context *ctx);
 
+void
+panfrost_batch_fini(struct panfrost_context *ctx);
+
 void
 panfrost_batch_add_bo(struct panfrost_batch *batch, struct panfrost_bo *bo,
                       uint32_t flags);
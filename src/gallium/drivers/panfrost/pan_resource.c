@@ -751,7 +751,7 @@ panfrost_resource_create_with_modifier(struct pipe_screen *screen,
         panfrost_resource_set_damage_region(NULL, &so->base, 0, NULL);
 
         if (template->bind & PIPE_BIND_INDEX_BUFFER)
-                so->index_cache = rzalloc(so, struct panfrost_minmax_cache);
+                so->index_cache = panfrost_minmax_cache_create(so, 0);
 
         return (struct pipe_resource *)so;
 }
@@ -802,6 +802,7 @@ panfrost_resource_destroy(struct pipe_screen *screen,
         if (rsrc->checksum_bo)
                 panfrost_bo_unreference(rsrc->checksum_bo);
 
+        panfrost_minmax_cache_destroy(rsrc->index_cache);
         util_range_destroy(&rsrc->valid_buffer_range);
         ralloc_free(rsrc);
 }
@@ -896,6 +897,115 @@ pan_blit_to_staging(struct pipe_context *pctx, struct panfrost_transfer *trans)
         panfrost_blit(pctx, &blit);
 }
 
+/* A horizontal band of a software tiled transfer, made of whole rows of
+ * tiles so no two jobs touch the same tile */
+
+struct panfrost_tiling_job {
+        void *tiled;
+        void *linear;
+        unsigned x, y, w, h;
+        uint32_t tiled_stride;
+        uint32_t linear_stride;
+        enum pipe_format format;
+        bool is_store;
+        struct util_queue_fence fence;
+};
+
+static void
+panfrost_tiling_job_execute(void *data, int thread_index)
+{
+        struct panfrost_tiling_job *job = data;
+
+        if (job->is_store) {
+                panfrost_store_tiled_image(job->tiled, job->linear,
+                                           job->x, job->y, job->w, job->h,
+                                           job->tiled_stride,
+                                           job->linear_stride, job->format);
+        } else {
+                panfrost_load_tiled_image(job->linear, job->tiled,
+                                          job->x, job->y, job->w, job->h,
+                                          job->linear_stride,
+                                          job->tiled_stride, job->format);
+        }
+}
+
+static void
+panfrost_tiled_transfer(struct panfrost_screen *screen,
+                        void *tiled, void *linear,
+                        unsigned x, unsigned y, unsigned w, unsigned h,
+                        uint32_t tiled_stride, uint32_t linear_stride,
+                        enum pipe_format format, bool is_store)
+{
+        struct panfrost_tiling_job jobs[PAN_TILING_MAX_JOBS];
+        size_t size = (size_t) linear_stride * h;
+        unsigned tile_rows = DIV_ROUND_UP(y + h, 16) - (y / 16);
+        unsigned nr_jobs = 1;
+
+        /* Compressed formats take x/y in blocks and w/h in pixels, so keep
+         * them on the calling thread rather than translating the split */
+        if (size >= PAN_TILING_THREAD_THRESHOLD &&
+            util_queue_is_initialized(&screen->tiling_queue) &&
+            !util_format_is_compressed(format)) {
+                nr_jobs = MIN2(screen->tiling_queue.num_threads + 1,
+                               size / PAN_TILING_JOB_SIZE);
+                nr_jobs = MIN3(nr_jobs, tile_rows, PAN_TILING_MAX_JOBS);
+        }
+
+        if (nr_jobs <= 1) {
+                struct panfrost_tiling_job job = {
+                        .tiled = tiled,
+                        .linear = linear,
+                        .x = x, .y = y, .w = w, .h = h,
+                        .tiled_stride = tiled_stride,
+                        .linear_stride = linear_stride,
+                        .format = format,
+                        .is_store = is_store,
+                };
+
+                panfrost_tiling_job_execute(&job, 0);
+                return;
+        }
+
+        unsigned rows_per_job = DIV_ROUND_UP(tile_rows, nr_jobs);
+        unsigned start = y;
+
+        for (unsigned i = 0; i < nr_jobs; ++i) {
+                unsigned end = MIN2(((y / 16) + (i + 1) * rows_per_job) * 16,
+                                    y + h);
+
+                jobs[i] = (struct panfrost_tiling_job) {
+                        .tiled = tiled,
+                        .linear = (uint8_t *) linear + (start - y) * linear_stride,
+                        .x = x, .y = start, .w = w, .h = end - start,
+                        .tiled_stride = tiled_stride,
+                        .linear_stride = linear_stride,
+                        .format = format,
+                        .is_store = is_store,
+                };
+
+                start = end;
+        }
+
+        /* Rounding can leave the last jobs empty */
+        while (!jobs[nr_jobs - 1].h)
+                nr_jobs--;
+
+        /* The first band is done here while the workers take the rest */
+        for (unsigned i = 1; i < nr_jobs; ++i) {
+                util_queue_fence_init(&jobs[i].fence);
+                util_queue_add_job(&screen->tiling_queue, &jobs[i],
+                                   &jobs[i].fence,
+                                   panfrost_tiling_job_execute, NULL, 0);
+        }
+
+        panfrost_tiling_job_execute(&jobs[0], 0);
+
+        for (unsigned i = 1; i < nr_jobs; ++i) {
+                util_queue_fence_wait(&jobs[i].fence);
+                util_queue_fence_destroy(&jobs[i].fence);
+        }
+}
+
 static void *
 panfrost_ptr_map(struct pipe_context *pctx,
                       struct pipe_resource *resource,
@@ -1046,13 +1156,14 @@ panfrost_ptr_map(struct pipe_context *pctx,
                 assert(box->depth == 1);
 
                 if ((usage & PIPE_MAP_READ) && rsrc->layout.slices[level].initialized) {
-                        panfrost_load_tiled_image(
-                                        transfer->map,
+                        panfrost_tiled_transfer(
+                                        pan_screen(pctx->screen),
                                         bo->ptr.cpu + rsrc->layout.slices[level].offset,
+                                        transfer->map,
                                         box->x, box->y, box->width, box->height,
-                                        transfer->base.stride,
                                         rsrc->layout.slices[level].line_stride,
-                                        rsrc->internal_format);
+                                        transfer->base.stride,
+                                        rsrc->internal_format, false);
                 }
 
                 return transfer->map;
@@ -1187,14 +1298,15 @@ panfrost_ptr_unmap(struct pipe_context *pctx,
                                                 transfer->stride,
                                                 0, 0);
                                 } else {
-                                        panfrost_store_tiled_image(
+                                        panfrost_tiled_transfer(
+                                                pan_screen(pctx->screen),
                                                 bo->ptr.cpu + prsrc->layout.slices[transfer->level].offset,
                                                 trans->map,
                                                 transfer->box.x, transfer->box.y,
                                                 transfer->box.width, transfer->box.height,
                                                 prsrc->layout.slices[transfer->level].line_stride,
                                                 transfer->stride,
-                                                prsrc->internal_format);
+                                                prsrc->internal_format, true);
                                 }
                         }
                 }
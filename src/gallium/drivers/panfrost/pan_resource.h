@@ -37,6 +37,13 @@
 
 #define LAYOUT_CONVERT_THRESHOLD 8
 
+/* Software (de)tiling of transfers at least this large (in bytes of linear
+ * data) is split by rows of tiles across the screen's tiling queue, into at
+ * most PAN_TILING_MAX_JOBS pieces of at least PAN_TILING_JOB_SIZE each. */
+#define PAN_TILING_THREAD_THRESHOLD (1024 * 1024)
+#define PAN_TILING_JOB_SIZE (256 * 1024)
+#define PAN_TILING_MAX_JOBS 8
+
 struct panfrost_resource {
         struct pipe_resource base;
         struct {
@@ -34,11 +34,15 @@
 #include "util/u_screen.h"
 #include "util/os_time.h"
 #include "util/u_process.h"
+#include "util/disk_cache.h"
+#include "util/u_queue.h"
+#include "compiler/glsl_types.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
 
 #include <fcntl.h>
+#include <unistd.h>
 
 #include "drm-uapi/drm_fourcc.h"
 #include "drm-uapi/panfrost_drm.h"
@@ -653,10 +657,47 @@ panfrost_get_compute_param(struct pipe_screen *pscreen, enum pipe_shader_ir ir_t
 static void
 panfrost_destroy_screen(struct pipe_screen *pscreen)
 {
+        struct panfrost_screen *screen = pan_screen(pscreen);
+
+        if (util_queue_is_initialized(&screen->shader_compiler_queue)) {
+                util_queue_destroy(&screen->shader_compiler_queue);
+                glsl_type_singleton_decref();
+        }
+
+        if (util_queue_is_initialized(&screen->tiling_queue))
+                util_queue_destroy(&screen->tiling_queue);
+
+        disk_cache_destroy(screen->disk_cache);
+        panfrost_suballoc_fini(screen);
         panfrost_close_device(pan_device(pscreen));
         ralloc_free(pscreen);
 }
 
+static void
+panfrost_set_max_shader_compiler_threads(struct pipe_screen *pscreen,
+                                         unsigned max_threads)
+{
+        /* Can't grow past the thread count the queue was created with */
+        util_queue_adjust_num_threads(&pan_screen(pscreen)->shader_compiler_queue,
+                                      max_threads);
+}
+
+static bool
+panfrost_is_parallel_shader_compilation_finished(struct pipe_screen *pscreen,
+                                                 void *shader,
+                                                 enum pipe_shader_type shader_type)
+{
+        struct panfrost_shader_variants *so = shader;
+
+        return util_queue_fence_is_signalled(&so->ready);
+}
+
+static struct disk_cache *
+panfrost_get_disk_shader_cache(struct pipe_screen *pscreen)
+{
+        return pan_screen(pscreen)->disk_cache;
+}
+
 static uint64_t
 panfrost_get_timestamp(struct pipe_screen *_screen)
 {
@@ -830,10 +871,45 @@ panfrost_create_screen(int fd, struct renderonly *ro)
                panfrost_is_dmabuf_modifier_supported;
         screen->base.context_create = panfrost_create_context;
         screen->base.get_compiler_options = panfrost_screen_get_compiler_options;
+        screen->base.get_disk_shader_cache = panfrost_get_disk_shader_cache;
+        screen->base.set_max_shader_compiler_threads =
+                panfrost_set_max_shader_compiler_threads;
+        screen->base.is_parallel_shader_compilation_finished =
+                panfrost_is_parallel_shader_compilation_finished;
         screen->base.fence_reference = panfrost_fence_reference;
         screen->base.fence_finish = panfrost_fence_finish;
         screen->base.set_damage_region = panfrost_resource_set_damage_region;
 
+        if (!panfrost_suballoc_init(screen)) {
+                panfrost_close_device(dev);
+                ralloc_free(screen);
+                return NULL;
+        }
+
+        /* Leave a core for the application's own threads. The compiler
+         * threads hold a reference on the GLSL types, since they may outlive
+         * the state tracker's. */
+        unsigned num_compiler_threads = MAX2(sysconf(_SC_NPROCESSORS_ONLN) - 1, 1);
+
+        glsl_type_singleton_init_or_ref();
+
+        if (!util_queue_init(&screen->shader_compiler_queue, "pan_sh", 64,
+                             num_compiler_threads,
+                             UTIL_QUEUE_INIT_RESIZE_IF_FULL)) {
+                glsl_type_singleton_decref();
+                panfrost_destroy_screen(&(screen->base));
+                return NULL;
+        }
+
+        /* The mapping thread does a share of each split transfer itself, so
+         * one fewer worker than cores. Failure just means no splitting. */
+        if (sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+                util_queue_init(&screen->tiling_queue, "pan_tile", 16,
+                                MIN2(num_compiler_threads, PAN_TILING_MAX_JOBS - 1),
+                                0);
+        }
+
+        panfrost_disk_cache_init(screen);
         panfrost_resource_screen_init(&screen->base);
         panfrost_init_blit_shaders(dev);
 
@@ -36,17 +36,34 @@
 #include "util/u_dynarray.h"
 #include "util/bitset.h"
 #include "util/set.h"
+#include "util/u_queue.h"
 
 #include "pan_device.h"
 #include "pan_pool.h"
+#include "pan_suballoc.h"
 
 struct panfrost_batch;
 struct panfrost_context;
 struct panfrost_resource;
 
+struct disk_cache;
+
 struct panfrost_screen {
         struct pipe_screen base;
         struct panfrost_device dev;
+
+        /* On-disk cache of compiled shader variants, NULL if disabled */
+        struct disk_cache *disk_cache;
+
+        /* Background compiles of the default shader variants */
+        struct util_queue shader_compiler_queue;
+
+        /* Workers for splitting large software (de)tiling transfers, not
+         * initialized on single core systems */
+        struct util_queue tiling_queue;
+
+        /* Slabs for small long-lived objects, see pan_suballoc.h */
+        struct pb_slabs suballoc;
 };
 
 static inline struct panfrost_screen *
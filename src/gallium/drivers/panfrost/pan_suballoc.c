@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "pan_screen.h"
+#include "pan_suballoc.h"
+
+/* Sub-allocator for small, long-lived objects on top of pb_slab. Heaps
+ * correspond to BO flags, since entries of a slab share its BO */
+
+enum pan_suballoc_heap {
+        PAN_SUBALLOC_HEAP_DEFAULT = 0,
+        PAN_SUBALLOC_HEAP_EXECUTE,
+        PAN_SUBALLOC_NUM_HEAPS,
+};
+
+struct panfrost_slab {
+        struct pb_slab base;
+        struct panfrost_bo *bo;
+        struct panfrost_suballoc *entries;
+};
+
+static enum pan_suballoc_heap
+pan_suballoc_heap(uint32_t flags)
+{
+        /* Anything more exotic (invisible, growable, shared) wants its own BO
+         * anyway */
+        assert(!(flags & ~PAN_BO_EXECUTE));
+
+        return (flags & PAN_BO_EXECUTE) ? PAN_SUBALLOC_HEAP_EXECUTE :
+                                          PAN_SUBALLOC_HEAP_DEFAULT;
+}
+
+static struct pb_slab *
+panfrost_slab_alloc(void *priv, unsigned heap, unsigned entry_size,
+                    unsigned group_index)
+{
+        struct panfrost_screen *screen = priv;
+        struct panfrost_slab *slab = CALLOC_STRUCT(panfrost_slab);
+
+        if (!slab)
+                return NULL;
+
+        uint32_t flags = (heap == PAN_SUBALLOC_HEAP_EXECUTE) ? PAN_BO_EXECUTE : 0;
+        slab->bo = panfrost_bo_create(&screen->dev, PAN_SUBALLOC_SLAB_SIZE, flags);
+
+        if (!slab->bo) {
+                FREE(slab);
+                return NULL;
+        }
+
+        slab->base.num_entries = PAN_SUBALLOC_SLAB_SIZE / entry_size;
+        slab->base.num_free = slab->base.num_entries;
+        slab->entries = CALLOC(slab->base.num_entries, sizeof(*slab->entries));
+
+        if (!slab->entries) {
+                panfrost_bo_unreference(slab->bo);
+                FREE(slab);
+                return NULL;
+        }
+
+        list_inithead(&slab->base.free);
+
+        for (unsigned i = 0; i < slab->base.num_entries; ++i) {
+                struct panfrost_suballoc *alloc = &slab->entries[i];
+
+                alloc->entry.slab = &slab->base;
+                alloc->entry.group_index = group_index;
+                alloc->bo = slab->bo;
+                alloc->ptr.cpu = slab->bo->ptr.cpu + (i * entry_size);
+                alloc->ptr.gpu = slab->bo->ptr.gpu + (i * entry_size);
+
+                list_addtail(&alloc->entry.head, &slab->base.free);
+        }
+
+        return &slab->base;
+}
+
+static void
+panfrost_slab_free(void *priv, struct pb_slab *pslab)
+{
+        struct panfrost_slab *slab = (struct panfrost_slab *) pslab;
+
+        /* In-flight batches hold their own references to the BO */
+        panfrost_bo_unreference(slab->bo);
+        FREE(slab->entries);
+        FREE(slab);
+}
+
+/* A freed entry may still be read by a batch, either one that has not been
+ * submitted yet (and so holds a reference on the slab BO) or one still running
+ * on the GPU. We don't track entries individually, so wait for the whole slab
+ * to go idle. This is only checked when a size class runs out of free entries,
+ * so the WAIT_BO ioctl stays off the common path. As the result is the same
+ * for all entries of a slab, pb_slab is told to ask once per slab, and to look
+ * past busy slabs before creating a new one, so a slab that stays busy only
+ * holds back its own entries. */
+
+static bool
+panfrost_slab_can_reclaim(void *priv, struct pb_slab_entry *entry)
+{
+        struct panfrost_slab *slab = (struct panfrost_slab *) entry->slab;
+
+        if (p_atomic_read(&slab->bo->refcnt) > 1)
+                return false;
+
+        return panfrost_bo_wait(slab->bo, 0, true);
+}
+
+bool
+panfrost_suballoc_init(struct panfrost_screen *screen)
+{
+        if (!pb_slabs_init(&screen->suballoc,
+                           PAN_SUBALLOC_MIN_ORDER, PAN_SUBALLOC_MAX_ORDER,
+                           PAN_SUBALLOC_NUM_HEAPS, screen,
+                           panfrost_slab_can_reclaim,
+                           panfrost_slab_alloc,
+                           panfrost_slab_free))
+                return false;
+
+        screen->suballoc.reclaim_by_slab = true;
+        return true;
+}
+
+void
+panfrost_suballoc_fini(struct panfrost_screen *screen)
+{
+        pb_slabs_deinit(&screen->suballoc);
+}
+
+struct panfrost_suballoc *
+panfrost_suballoc_create(struct panfrost_screen *screen, size_t size,
+                         uint32_t flags)
+{
+        assert(size > 0);
+
+        if (size <= (1 << PAN_SUBALLOC_MAX_ORDER)) {
+                struct pb_slab_entry *entry =
+                        pb_slab_alloc(&screen->suballoc, size,
+                                      pan_suballoc_heap(flags));
+
+                if (entry)
+                        return container_of(entry, struct panfrost_suballoc, entry);
+        }
+
+        /* Too big to share a slab, give it a dedicated BO */
+        struct panfrost_suballoc *alloc = CALLOC_STRUCT(panfrost_suballoc);
+
+        if (!alloc)
+                return NULL;
+
+        alloc->bo = panfrost_bo_create(&screen->dev, size, flags);
+
+        if (!alloc->bo) {
+                FREE(alloc);
+                return NULL;
+        }
+
+        alloc->ptr = alloc->bo->ptr;
+        return alloc;
+}
+
+void
+panfrost_suballoc_destroy(struct panfrost_screen *screen,
+                          struct panfrost_suballoc *alloc)
+{
+        if (!alloc)
+                return;
+
+        if (alloc->entry.slab) {
+                pb_slab_free(&screen->suballoc, &alloc->entry);
+        } else {
+                panfrost_bo_unreference(alloc->bo);
+                FREE(alloc);
+        }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef __PAN_SUBALLOC_H__
+#define __PAN_SUBALLOC_H__
+
+#include "pipebuffer/pb_slab.h"
+#include "pan_bo.h"
+
+struct panfrost_screen;
+
+/* Small, long-lived GPU objects (texture descriptors, shader binaries) are
+ * carved out of larger slab BOs shared between many objects, rather than each
+ * costing a whole page-granular BO and a pair of ioctls. Entries are grouped
+ * into power-of-two size classes from PAN_SUBALLOC_MIN_ORDER to
+ * PAN_SUBALLOC_MAX_ORDER; anything bigger falls back to a dedicated BO. */
+
+#define PAN_SUBALLOC_MIN_ORDER (7)  /* 128 bytes, enough for shader alignment */
+#define PAN_SUBALLOC_MAX_ORDER (14) /* 16KB */
+
+/* Each slab holds at least a few of the largest entries */
+#define PAN_SUBALLOC_SLAB_SIZE (4 << PAN_SUBALLOC_MAX_ORDER)
+
+struct panfrost_suballoc {
+        struct pb_slab_entry entry;
+
+        /* Backing BO, shared with the other entries of the slab unless this
+         * is a dedicated allocation. Batches using the allocation must add
+         * this BO to keep it resident, which also keeps the entry from being
+         * recycled until the batch is done with it. */
+        struct panfrost_bo *bo;
+
+        /* The allocation itself */
+        struct panfrost_ptr ptr;
+};
+
+bool
+panfrost_suballoc_init(struct panfrost_screen *screen);
+
+void
+panfrost_suballoc_fini(struct panfrost_screen *screen);
+
+struct panfrost_suballoc *
+panfrost_suballoc_create(struct panfrost_screen *screen, size_t size,
+                         uint32_t flags);
+
+void
+panfrost_suballoc_destroy(struct panfrost_screen *screen,
+                          struct panfrost_suballoc *alloc);
+
+#endif
@@ -0,0 +1,298 @@
+/**************************************************************************
+ *
+ * Copyright © 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Frame throughput benchmark: every frame clears the render target, draws a
+ * screen-covering grid of triangles and flushes without waiting, so drivers
+ * able to build the next frame while the previous one renders can overlap
+ * them. With llvmpipe, compare LP_NUM_SCENES=1 against the default.
+ *
+ * Usage: tri-bench [frames] [grid size]
+ */
+
+#define WIDTH 1024
+#define HEIGHT 1024
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pipe/p_state.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_inlines.h"
+#include "cso_cache/cso_context.h"
+#include "util/u_draw_quad.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "util/os_time.h"
+#include "pipe-loader/pipe_loader.h"
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct cso_velems_state velem;
+
+	void *vs;
+	void *fs;
+
+	union pipe_color_union clear_color;
+
+	struct pipe_resource *vbuf;
+	unsigned num_verts;
+	struct pipe_resource *target;
+};
+
+/* Two triangles per grid cell, each vertex a position and a color */
+
+static void init_vertices(struct program *p, unsigned grid)
+{
+	float (*vertices)[2][4];
+	unsigned v = 0;
+
+	p->num_verts = grid * grid * 6;
+	vertices = MALLOC(p->num_verts * sizeof(*vertices));
+
+	for (unsigned y = 0; y < grid; y++) {
+		for (unsigned x = 0; x < grid; x++) {
+			float x0 = -1.0f + 2.0f * x / grid;
+			float y0 = -1.0f + 2.0f * y / grid;
+			float x1 = -1.0f + 2.0f * (x + 1) / grid;
+			float y1 = -1.0f + 2.0f * (y + 1) / grid;
+			const float corners[6][2] = {
+				{ x0, y0 }, { x1, y0 }, { x0, y1 },
+				{ x1, y0 }, { x1, y1 }, { x0, y1 },
+			};
+
+			for (unsigned i = 0; i < 6; i++, v++) {
+				vertices[v][0][0] = corners[i][0];
+				vertices[v][0][1] = corners[i][1];
+				vertices[v][0][2] = 0.0f;
+				vertices[v][0][3] = 1.0f;
+
+				vertices[v][1][0] = (float)x / grid;
+				vertices[v][1][1] = (float)y / grid;
+				vertices[v][1][2] = (float)i / 6;
+				vertices[v][1][3] = 1.0f;
+			}
+		}
+	}
+
+	p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+				     PIPE_USAGE_DEFAULT,
+				     p->num_verts * sizeof(*vertices));
+	pipe_buffer_write(p->pipe, p->vbuf, 0,
+			  p->num_verts * sizeof(*vertices), vertices);
+
+	FREE(vertices);
+}
+
+static void init_prog(struct program *p, unsigned grid)
+{
+	struct pipe_surface surf_tmpl;
+	ASSERTED int ret;
+
+	/* find a hardware device */
+	ret = pipe_loader_probe(&p->dev, 1);
+	assert(ret);
+
+	/* init a pipe screen */
+	p->screen = pipe_loader_create_screen(p->dev);
+	assert(p->screen);
+
+	/* create the pipe driver context and cso context */
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	p->cso = cso_create_context(p->pipe, 0);
+
+	p->clear_color.f[0] = 0.3;
+	p->clear_color.f[1] = 0.1;
+	p->clear_color.f[2] = 0.3;
+	p->clear_color.f[3] = 1.0;
+
+	init_vertices(p, grid);
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* disabled blending/masking */
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	/* no-op depth/stencil/alpha */
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	/* rasterizer */
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip_near = 1;
+	p->rasterizer.depth_clip_far = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	/* drawing destination */
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	/* viewport */
+	p->viewport.scale[0] = WIDTH / 2.0f;
+	p->viewport.scale[1] = HEIGHT / 2.0f;
+	p->viewport.scale[2] = 0.5f;
+	p->viewport.translate[0] = WIDTH / 2.0f;
+	p->viewport.translate[1] = HEIGHT / 2.0f;
+	p->viewport.translate[2] = 0.5f;
+
+	/* vertex elements state */
+	memset(&p->velem, 0, sizeof(p->velem));
+	p->velem.count = 2;
+
+	p->velem.velems[0].src_offset = 0 * 4 * sizeof(float);
+	p->velem.velems[0].vertex_buffer_index = 0;
+	p->velem.velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	p->velem.velems[1].src_offset = 1 * 4 * sizeof(float);
+	p->velem.velems[1].vertex_buffer_index = 0;
+	p->velem.velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	/* vertex shader */
+	{
+		const enum tgsi_semantic semantic_names[] =
+			{ TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_COLOR };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes, FALSE);
+	}
+
+	/* fragment shader */
+	p->fs = util_make_fragment_passthrough_shader(p->pipe,
+			TGSI_SEMANTIC_COLOR, TGSI_INTERPOLATE_PERSPECTIVE, TRUE);
+}
+
+static void close_prog(struct program *p)
+{
+	cso_destroy_context(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void draw_frame(struct program *p)
+{
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+
+	p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, NULL, &p->clear_color, 0, 0);
+
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+
+	cso_set_vertex_elements(p->cso, &p->velem);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+				p->vbuf, 0, 0,
+				PIPE_PRIM_TRIANGLES,
+				p->num_verts,
+				2); /* attribs/vert */
+
+	/* Don't wait, as a swap would only wait for an older frame */
+	p->pipe->flush(p->pipe, NULL, 0);
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	unsigned frames = argc > 1 ? atoi(argv[1]) : 200;
+	unsigned grid = argc > 2 ? atoi(argv[2]) : 128;
+	struct pipe_fence_handle *fence = NULL;
+
+	init_prog(p, grid);
+
+	/* Warm up shader compilation */
+	draw_frame(p);
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+
+	int64_t start = os_time_get_nano();
+
+	for (unsigned i = 0; i < frames; i++)
+		draw_frame(p);
+
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+
+	double secs = (os_time_get_nano() - start) / 1e9;
+
+	printf("%s: %u frames of %u triangles at %ux%u in %.3f s, %.1f frames/s\n",
+	       p->screen->get_name(p->screen), frames, grid * grid * 2,
+	       WIDTH, HEIGHT, secs, frames / secs);
+
+	close_prog(p);
+
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "drm-uapi/panfrost_drm.h"
+#include "drm-shim/drm_shim.h"
+#include "util/u_debug.h"
+#include "wrap.h"
+
+bool drm_shim_driver_prefers_first_render_node = true;
+
+struct panfrost_shim_gpu {
+        unsigned gpu_id;
+        unsigned revision;
+        uint32_t shader_present;
+        const char *compatible;
+};
+
+static const struct panfrost_shim_gpu gpus[] = {
+        { 0x720,  0x0000, 0x1, "arm,mali-t720" },
+        { 0x750,  0x0000, 0xf, "arm,mali-t760" },
+        { 0x820,  0x0000, 0x1, "arm,mali-t820" },
+        { 0x860,  0x2000, 0xf, "arm,mali-t860" },
+        { 0x6221, 0x0030, 0x7, "arm,mali-bifrost" },
+        { 0x7093, 0x0000, 0x1, "arm,mali-bifrost" },
+        { 0x7212, 0x0000, 0x3, "arm,mali-bifrost" },
+};
+
+static const struct panfrost_shim_gpu *shim_gpu;
+
+/* When decoding, every BO is also mapped into the shim so pandecode can chase
+ * GPU pointers. GPU addresses are the BO's offset within the shim's memory,
+ * which is unique, page aligned and never zero. Submits may come from several
+ * threads, and pandecode is not thread safe. */
+
+static bool decode;
+static mtx_t decode_lock;
+
+static int
+panfrost_ioctl_noop(int fd, unsigned long request, void *arg)
+{
+        return 0;
+}
+
+static void
+panfrost_shim_bo_free(struct shim_bo *bo)
+{
+        if (!bo->map)
+                return;
+
+        /* The address may be handed out again, with another mapping */
+        mtx_lock(&decode_lock);
+        pandecode_inject_free(bo->mem_addr, bo->size);
+        mtx_unlock(&decode_lock);
+
+        munmap(bo->map, bo->size);
+}
+
+static int
+panfrost_ioctl_create_bo(int fd, unsigned long request, void *arg)
+{
+        struct shim_fd *shim_fd = drm_shim_fd_lookup(fd);
+        struct drm_panfrost_create_bo *create = arg;
+        struct shim_bo *bo = calloc(1, sizeof(*bo));
+
+        drm_shim_bo_init(bo, create->size);
+
+        if (decode) {
+                bo->map = mmap(NULL, create->size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED, shim_device.mem_fd, bo->mem_addr);
+                assert(bo->map != MAP_FAILED);
+
+                mtx_lock(&decode_lock);
+                pandecode_inject_mmap(bo->mem_addr, bo->map, create->size, NULL);
+                mtx_unlock(&decode_lock);
+        }
+
+        create->handle = drm_shim_bo_get_handle(shim_fd, bo);
+        create->offset = bo->mem_addr;
+
+        drm_shim_bo_put(bo);
+
+        return 0;
+}
+
+static int
+panfrost_ioctl_mmap_bo(int fd, unsigned long request, void *arg)
+{
+        struct shim_fd *shim_fd = drm_shim_fd_lookup(fd);
+        struct drm_panfrost_mmap_bo *mmap_bo = arg;
+        struct shim_bo *bo = drm_shim_bo_lookup(shim_fd, mmap_bo->handle);
+
+        mmap_bo->offset = drm_shim_bo_get_mmap_offset(shim_fd, bo);
+
+        drm_shim_bo_put(bo);
+
+        return 0;
+}
+
+static int
+panfrost_ioctl_get_bo_offset(int fd, unsigned long request, void *arg)
+{
+        struct shim_fd *shim_fd = drm_shim_fd_lookup(fd);
+        struct drm_panfrost_get_bo_offset *args = arg;
+        struct shim_bo *bo = drm_shim_bo_lookup(shim_fd, args->handle);
+
+        args->offset = bo->mem_addr;
+
+        drm_shim_bo_put(bo);
+
+        return 0;
+}
+
+static int
+panfrost_ioctl_get_param(int fd, unsigned long request, void *arg)
+{
+        struct drm_panfrost_get_param *gp = arg;
+
+        switch (gp->param) {
+        case DRM_PANFROST_PARAM_GPU_PROD_ID:
+                gp->value = shim_gpu->gpu_id;
+                return 0;
+        case DRM_PANFROST_PARAM_GPU_REVISION:
+                gp->value = shim_gpu->revision;
+                return 0;
+        case DRM_PANFROST_PARAM_SHADER_PRESENT:
+                gp->value = shim_gpu->shader_present;
+                return 0;
+        case DRM_PANFROST_PARAM_TEXTURE_FEATURES0:
+        case DRM_PANFROST_PARAM_THREAD_TLS_ALLOC:
+                /* Optional, as on older kernels, so the driver falls back to
+                 * its defaults */
+                return -1;
+        default:
+                fprintf(stderr, "Unknown DRM_IOCTL_PANFROST_GET_PARAM %d\n",
+                        gp->param);
+                return -1;
+        }
+}
+
+static int
+panfrost_ioctl_submit(int fd, unsigned long request, void *arg)
+{
+        struct drm_panfrost_submit *submit = arg;
+
+        /* Nothing executes, so every job completes immediately */
+        if (!decode)
+                return 0;
+
+        mtx_lock(&decode_lock);
+        pandecode_jc(submit->jc, shim_gpu->gpu_id >= 0x6000,
+                     shim_gpu->gpu_id, false);
+        mtx_unlock(&decode_lock);
+
+        return 0;
+}
+
+static int
+panfrost_ioctl_madvise(int fd, unsigned long request, void *arg)
+{
+        struct drm_panfrost_madvise *args = arg;
+
+        /* Never purged */
+        args->retained = 1;
+
+        return 0;
+}
+
+static ioctl_fn_t driver_ioctls[] = {
+        [DRM_PANFROST_SUBMIT] = panfrost_ioctl_submit,
+        [DRM_PANFROST_WAIT_BO] = panfrost_ioctl_noop,
+        [DRM_PANFROST_CREATE_BO] = panfrost_ioctl_create_bo,
+        [DRM_PANFROST_MMAP_BO] = panfrost_ioctl_mmap_bo,
+        [DRM_PANFROST_GET_PARAM] = panfrost_ioctl_get_param,
+        [DRM_PANFROST_GET_BO_OFFSET] = panfrost_ioctl_get_bo_offset,
+        [DRM_PANFROST_PERFCNT_ENABLE] = panfrost_ioctl_noop,
+        [DRM_PANFROST_PERFCNT_DUMP] = panfrost_ioctl_noop,
+        [DRM_PANFROST_MADVISE] = panfrost_ioctl_madvise,
+};
+
+void
+drm_shim_driver_init(void)
+{
+        shim_device.bus_type = DRM_BUS_PLATFORM;
+        shim_device.driver_name = "panfrost";
+        shim_device.driver_ioctls = driver_ioctls;
+        shim_device.driver_ioctl_count = ARRAY_SIZE(driver_ioctls);
+        shim_device.driver_bo_free = panfrost_shim_bo_free;
+
+        /* 1.1 for heap and no-exec BOs */
+        shim_device.version_major = 1;
+        shim_device.version_minor = 1;
+        shim_device.version_patchlevel = 0;
+
+        /* Same variable the driver honours in debug builds, so both agree */
+        unsigned gpu_id = strtol(debug_get_option("PAN_GPU_ID", "860"), NULL, 16);
+
+        for (unsigned i = 0; i < ARRAY_SIZE(gpus); i++) {
+                if (gpus[i].gpu_id == gpu_id) {
+                        shim_gpu = &gpus[i];
+                        break;
+                }
+        }
+
+        if (!shim_gpu) {
+                fprintf(stderr, "Unknown PAN_GPU_ID %x, using T860\n", gpu_id);
+                shim_gpu = &gpus[3];
+        }
+
+        char uevent[128];
+        snprintf(uevent, sizeof(uevent),
+                 "OF_FULLNAME=/soc/gpu\n"
+                 "OF_COMPATIBLE_N=1\n"
+                 "OF_COMPATIBLE_0=%s\n", shim_gpu->compatible);
+
+        drm_shim_override_file(uevent, "/sys/dev/char/%d:%d/device/uevent",
+                               DRM_MAJOR, render_node_minor);
+
+        decode = debug_get_bool_option("PAN_SHIM_DECODE", false);
+
+        if (decode) {
+                mtx_init(&decode_lock, mtx_plain);
+                pandecode_initialize(debug_get_bool_option("PAN_SHIM_DECODE_STDERR",
+                                                           false));
+        }
+}
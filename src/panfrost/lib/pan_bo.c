@@ -45,13 +45,19 @@
  * solves both of these problems and does not require kernel updates.
  *
  * Cached BOs are sorted into a bucket based on rounding their size down to the
- * nearest power-of-two. Each bucket contains a linked list of free panfrost_bo
- * objects. Putting a BO into the cache is accomplished by adding it to the
+ * nearest size class (a quarter of a power-of-two). Each bucket contains a
+ * linked list of free panfrost_bo objects and its own lock, so allocations of
+ * different sizes from different contexts don't serialize on each other.
+ * Putting a BO into the cache is accomplished by adding it to the
  * corresponding bucket. Getting a BO from the cache consists of finding the
  * appropriate bucket and sorting. A cache eviction is a kernel-level free of a
  * BO and removing it from the bucket. We special case evicting all BOs from
  * the cache, since that's what helpful in practice and avoids extra logic
  * around the linked list.
+ *
+ * Locks are only held to link and unlink BOs. Anything involving the kernel
+ * (waiting for the GPU, madvise, freeing) happens on BOs that have been taken
+ * out of their bucket, outside the critical section.
  */
 
 static struct panfrost_bo *
@@ -91,16 +97,19 @@ static void
 panfrost_bo_free(struct panfrost_bo *bo)
 {
         struct drm_gem_close gem_close = { .handle = bo->gem_handle };
+        int fd = bo->dev->fd;
         int ret;
 
-        ret = drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+        /* BO will be freed with the sparse array, but zero to indicate free.
+         * This must happen before the handle is closed, since the kernel may
+         * hand it out again to a concurrent allocation right away. */
+        memset(bo, 0, sizeof(*bo));
+
+        ret = drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
         if (ret) {
                 fprintf(stderr, "DRM_IOCTL_GEM_CLOSE failed: %m\n");
                 assert(0);
         }
-
-        /* BO will be freed with the sparse array, but zero to indicate free */
-        memset(bo, 0, sizeof(*bo));
 }
 
 /* Returns true if the BO is ready, false otherwise.
@@ -156,26 +165,31 @@ panfrost_bo_wait(struct panfrost_bo *bo, int64_t timeout_ns, bool wait_readers)
 static unsigned
 pan_bucket_index(unsigned size)
 {
-        /* Round down to POT to compute a bucket index */
+        /* Round down to POT to find the level */
 
-        unsigned bucket_index = util_logbase2(size);
+        unsigned level = util_logbase2(size);
 
-        /* Clamp the bucket index; all huge allocations will be
-         * sorted into the largest bucket */
+        /* The minimum bucket size must equal the minimum allocation
+         * size */
 
-        bucket_index = MIN2(bucket_index, MAX_BO_CACHE_BUCKET);
+        assert(level >= MIN_BO_CACHE_BUCKET);
 
-        /* The minimum bucket size must equal the minimum allocation
-         * size; the maximum we clamped */
+        /* Clamp; all huge allocations will be sorted into the largest
+         * bucket */
 
-        assert(bucket_index >= MIN_BO_CACHE_BUCKET);
-        assert(bucket_index <= MAX_BO_CACHE_BUCKET);
+        if (level > MAX_BO_CACHE_BUCKET)
+                return NR_BO_CACHE_BUCKETS - 1;
+
+        /* The bits below the leading one select the class within the level */
+
+        unsigned class = (size >> (level - BO_CACHE_CLASS_BITS)) &
+                         ((1 << BO_CACHE_CLASS_BITS) - 1);
 
         /* Reindex from 0 */
-        return (bucket_index - MIN_BO_CACHE_BUCKET);
+        return ((level - MIN_BO_CACHE_BUCKET) << BO_CACHE_CLASS_BITS) | class;
 }
 
-static struct list_head *
+static struct panfrost_bo_cache_bucket *
 pan_bucket(struct panfrost_device *dev, unsigned size)
 {
         return &dev->bo_cache.buckets[pan_bucket_index(size)];
@@ -190,67 +204,108 @@ static struct panfrost_bo *
 panfrost_bo_cache_fetch(struct panfrost_device *dev,
                         size_t size, uint32_t flags, bool dontwait)
 {
-        pthread_mutex_lock(&dev->bo_cache.lock);
-        struct list_head *bucket = pan_bucket(dev, size);
+        struct panfrost_bo_cache_bucket *bucket = pan_bucket(dev, size);
         struct panfrost_bo *bo = NULL;
+        struct list_head busy;
 
-        /* Iterate the bucket looking for something suitable */
-        list_for_each_entry_safe(struct panfrost_bo, entry, bucket,
-                                 bucket_link) {
-                if (entry->size < size || entry->flags != flags)
-                        continue;
+        list_inithead(&busy);
+
+        while (!bo) {
+                struct panfrost_bo *candidate = NULL;
+
+                /* Splice the first suitable BO out of the cache, so we can
+                 * poke the kernel about it without holding the lock */
+                pthread_mutex_lock(&bucket->lock);
+                list_for_each_entry(struct panfrost_bo, entry, &bucket->list,
+                                    bucket_link) {
+                        if (entry->size < size || entry->flags != flags)
+                                continue;
+
+                        list_del(&entry->bucket_link);
+                        candidate = entry;
+                        break;
+                }
+                pthread_mutex_unlock(&bucket->lock);
+
+                if (!candidate)
+                        break;
 
-                if (!panfrost_bo_wait(entry, dontwait ? 0 : INT64_MAX,
-                                      PAN_BO_ACCESS_RW))
+                /* Still in use, set aside and try the next one */
+                if (!panfrost_bo_wait(candidate, dontwait ? 0 : INT64_MAX,
+                                      PAN_BO_ACCESS_RW)) {
+                        list_addtail(&candidate->bucket_link, &busy);
                         continue;
+                }
 
                 struct drm_panfrost_madvise madv = {
-                        .handle = entry->gem_handle,
+                        .handle = candidate->gem_handle,
                         .madv = PANFROST_MADV_WILLNEED,
                 };
-                int ret;
-
-                /* This one works, splice it out of the cache */
-                list_del(&entry->bucket_link);
-                list_del(&entry->lru_link);
 
-                ret = drmIoctl(dev->fd, DRM_IOCTL_PANFROST_MADVISE, &madv);
+                int ret = drmIoctl(dev->fd, DRM_IOCTL_PANFROST_MADVISE, &madv);
                 if (!ret && !madv.retained) {
-                        panfrost_bo_free(entry);
+                        panfrost_bo_free(candidate);
                         continue;
                 }
+
                 /* Let's go! */
-                bo = entry;
-                break;
+                bo = candidate;
+        }
+
+        /* Put back whatever was busy. These came from the front of the
+         * list, so they go back there to keep it in LRU order. */
+        if (!list_is_empty(&busy)) {
+                pthread_mutex_lock(&bucket->lock);
+                list_splice(&busy, &bucket->list);
+                pthread_mutex_unlock(&bucket->lock);
         }
-        pthread_mutex_unlock(&dev->bo_cache.lock);
 
         return bo;
 }
 
 static void
-panfrost_bo_cache_evict_stale_bos(struct panfrost_device *dev)
+panfrost_bo_cache_evict_stale_bos(struct panfrost_device *dev, time_t now)
 {
-        struct timespec time;
+        time_t last = p_atomic_read(&dev->bo_cache.last_evict);
 
-        clock_gettime(CLOCK_MONOTONIC, &time);
-        list_for_each_entry_safe(struct panfrost_bo, entry,
-                                 &dev->bo_cache.lru, lru_link) {
-                /* We want all entries that have been used more than 1 sec
-                 * ago to be dropped, others can be kept.
-                 * Note the <= 2 check and not <= 1. It's here to account for
-                 * the fact that we're only testing ->tv_sec, not ->tv_nsec.
-                 * That means we might keep entries that are between 1 and 2
-                 * seconds old, but we don't really care, as long as unused BOs
-                 * are dropped at some point.
-                 */
-                if (time.tv_sec - entry->last_used <= 2)
-                        break;
+        /* Sweeping every bucket on each put would cost more than the cache
+         * saves, so do it at most once a second, from whichever thread gets
+         * there first */
+        if (now == last ||
+            p_atomic_cmpxchg(&dev->bo_cache.last_evict, last, now) != last)
+                return;
 
-                list_del(&entry->bucket_link);
-                list_del(&entry->lru_link);
-                panfrost_bo_free(entry);
+        struct list_head stale;
+        list_inithead(&stale);
+
+        for (unsigned i = 0; i < ARRAY_SIZE(dev->bo_cache.buckets); ++i) {
+                struct panfrost_bo_cache_bucket *bucket =
+                        &dev->bo_cache.buckets[i];
+
+                pthread_mutex_lock(&bucket->lock);
+                list_for_each_entry_safe(struct panfrost_bo, entry,
+                                         &bucket->list, bucket_link) {
+                        /* We want all entries that have been used more than 1
+                         * sec ago to be dropped, others can be kept.
+                         * Note the <= 2 check and not <= 1. It's here to
+                         * account for the fact that we're only testing
+                         * ->tv_sec, not ->tv_nsec. That means we might keep
+                         * entries that are between 1 and 2 seconds old, but we
+                         * don't really care, as long as unused BOs are dropped
+                         * at some point.
+                         */
+                        if (now - entry->last_used <= 2)
+                                break;
+
+                        list_del(&entry->bucket_link);
+                        list_addtail(&entry->bucket_link, &stale);
+                }
+                pthread_mutex_unlock(&bucket->lock);
         }
+
+        list_for_each_entry_safe(struct panfrost_bo, entry, &stale,
+                                 bucket_link)
+                panfrost_bo_free(entry);
 }
 
 /* Tries to add a BO to the cache. Returns if it was
@@ -264,30 +319,28 @@ panfrost_bo_cache_put(struct panfrost_bo *bo)
         if (bo->flags & PAN_BO_SHARED)
                 return false;
 
-        pthread_mutex_lock(&dev->bo_cache.lock);
-        struct list_head *bucket = pan_bucket(dev, MAX2(bo->size, 4096));
+        struct panfrost_bo_cache_bucket *bucket =
+                pan_bucket(dev, MAX2(bo->size, 4096));
         struct drm_panfrost_madvise madv;
         struct timespec time;
 
         madv.handle = bo->gem_handle;
         madv.madv = PANFROST_MADV_DONTNEED;
-	madv.retained = 0;
+        madv.retained = 0;
 
         drmIoctl(dev->fd, DRM_IOCTL_PANFROST_MADVISE, &madv);
 
-        /* Add us to the bucket */
-        list_addtail(&bo->bucket_link, bucket);
-
-        /* Add us to the LRU list and update the last_used field. */
-        list_addtail(&bo->lru_link, &dev->bo_cache.lru);
+        /* Update the last_used field for LRU eviction */
         clock_gettime(CLOCK_MONOTONIC, &time);
         bo->last_used = time.tv_sec;
 
-        /* Let's do some cleanup in the BO cache while we hold the
-         * lock.
-         */
-        panfrost_bo_cache_evict_stale_bos(dev);
-        pthread_mutex_unlock(&dev->bo_cache.lock);
+        /* Add us to the bucket */
+        pthread_mutex_lock(&bucket->lock);
+        list_addtail(&bo->bucket_link, &bucket->list);
+        pthread_mutex_unlock(&bucket->lock);
+
+        /* Let's do some cleanup in the BO cache */
+        panfrost_bo_cache_evict_stale_bos(dev, time.tv_sec);
 
         return true;
 }
@@ -302,18 +355,20 @@ void
 panfrost_bo_cache_evict_all(
                 struct panfrost_device *dev)
 {
-        pthread_mutex_lock(&dev->bo_cache.lock);
         for (unsigned i = 0; i < ARRAY_SIZE(dev->bo_cache.buckets); ++i) {
-                struct list_head *bucket = &dev->bo_cache.buckets[i];
+                struct panfrost_bo_cache_bucket *bucket =
+                        &dev->bo_cache.buckets[i];
+                struct list_head evicted;
 
-                list_for_each_entry_safe(struct panfrost_bo, entry, bucket,
-                                         bucket_link) {
-                        list_del(&entry->bucket_link);
-                        list_del(&entry->lru_link);
+                pthread_mutex_lock(&bucket->lock);
+                list_replace(&bucket->list, &evicted);
+                list_inithead(&bucket->list);
+                pthread_mutex_unlock(&bucket->lock);
+
+                list_for_each_entry_safe(struct panfrost_bo, entry, &evicted,
+                                         bucket_link)
                         panfrost_bo_free(entry);
-                }
         }
-        pthread_mutex_unlock(&dev->bo_cache.lock);
 }
 
 void
@@ -382,10 +437,10 @@ panfrost_bo_create(struct panfrost_device *dev, size_t size,
         if (!bo)
                 bo = panfrost_bo_cache_fetch(dev, size, flags, false);
 
-        if (!bo)
+        if (!bo) {
                 fprintf(stderr, "BO creation failed\n");
-
-        assert(bo);
+                return NULL;
+        }
 
         /* Only mmap now if we know we need to. For CPU-invisible buffers, we
          * never map since we don't care about their contents; they're purely
@@ -427,6 +482,16 @@ panfrost_bo_unreference(struct panfrost_bo *bo)
 
         struct panfrost_device *dev = bo->dev;
 
+        /* Only a BO that has been exported can be imported again behind our
+         * back, and exporting requires a reference, so private BOs can skip
+         * the device-wide lock and go straight back to the cache */
+        if (!(bo->flags & PAN_BO_SHARED)) {
+                panfrost_bo_munmap(bo);
+                if (!panfrost_bo_cache_put(bo))
+                        panfrost_bo_free(bo);
+                return;
+        }
+
         pthread_mutex_lock(&dev->bo_map_lock);
 
         /* Someone might have imported this BO while we were waiting for the
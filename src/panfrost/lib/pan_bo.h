@@ -80,9 +80,6 @@ struct panfrost_bo {
         /* Must be first for casting */
         struct list_head bucket_link;
 
-        /* Used to link the BO to the BO cache LRU list. */
-        struct list_head lru_link;
-
         /* Store the time this BO was use last, so the BO cache logic can evict
          * stale BOs.
          */
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Measures BO allocation throughput through the BO cache with several
+ * threads sharing one device, as several contexts would. Each thread keeps a
+ * small ring of live BOs of mixed sizes and replaces the oldest one on every
+ * iteration, so once warm nearly every allocation is served by the cache.
+ *
+ * Usage: panfrost_bo_bench [threads] [iterations per thread]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+#include "pan_bo.h"
+#include "pan_device.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+
+#define RING_SIZE (16)
+
+struct bench_thread {
+        pthread_t thread;
+        struct panfrost_device *dev;
+        unsigned iterations;
+        unsigned seed;
+};
+
+static size_t
+bench_size(unsigned *seed)
+{
+        /* Mostly small transient-sized BOs, with the odd large one */
+        unsigned r = rand_r(seed);
+
+        if ((r & 0xf) == 0)
+                return (1 + (r >> 4) % 256) * 4096;
+        else
+                return (1 + (r >> 4) % 32) * 4096;
+}
+
+static void *
+bench_thread_main(void *data)
+{
+        struct bench_thread *t = data;
+        struct panfrost_bo *ring[RING_SIZE] = { NULL };
+
+        for (unsigned i = 0; i < t->iterations; ++i) {
+                unsigned slot = i % RING_SIZE;
+
+                panfrost_bo_unreference(ring[slot]);
+                ring[slot] = panfrost_bo_create(t->dev, bench_size(&t->seed),
+                                                PAN_BO_DELAY_MMAP);
+        }
+
+        for (unsigned i = 0; i < RING_SIZE; ++i)
+                panfrost_bo_unreference(ring[i]);
+
+        return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+        unsigned nr_threads = argc > 1 ? atoi(argv[1]) : 4;
+        unsigned iterations = argc > 2 ? atoi(argv[2]) : 100000;
+
+        if (!nr_threads || !iterations) {
+                fprintf(stderr, "usage: %s [threads] [iterations]\n", argv[0]);
+                return 1;
+        }
+
+        int fd = drmOpenWithType("panfrost", NULL, DRM_NODE_RENDER);
+
+        if (fd < 0) {
+                fprintf(stderr, "no panfrost render node found\n");
+                return 1;
+        }
+
+        void *memctx = ralloc_context(NULL);
+        struct panfrost_device *dev = rzalloc(memctx, struct panfrost_device);
+        panfrost_open_device(memctx, fd, dev);
+
+        struct bench_thread *threads = rzalloc_array(memctx, struct bench_thread,
+                                                     nr_threads);
+
+        int64_t start = os_time_get_nano();
+
+        for (unsigned i = 0; i < nr_threads; ++i) {
+                threads[i].dev = dev;
+                threads[i].iterations = iterations;
+                threads[i].seed = i;
+                pthread_create(&threads[i].thread, NULL, bench_thread_main,
+                               &threads[i]);
+        }
+
+        for (unsigned i = 0; i < nr_threads; ++i)
+                pthread_join(threads[i].thread, NULL);
+
+        int64_t elapsed = os_time_get_nano() - start;
+        double ops = (double) nr_threads * iterations;
+
+        printf("%u threads, %u iterations each: %.3f s, %.0f allocs/s\n",
+               nr_threads, iterations, elapsed / 1e9, ops * 1e9 / elapsed);
+
+        panfrost_close_device(dev);
+        ralloc_free(memctx);
+        close(fd);
+        return 0;
+}
@@ -30,6 +30,7 @@
 #ifndef PAN_DEVICE_H
 #define PAN_DEVICE_H
 
+#include <time.h>
 #include <xf86drm.h>
 #include "renderonly/renderonly.h"
 #include "util/u_dynarray.h"
@@ -65,8 +66,22 @@
 #define MIN_BO_CACHE_BUCKET (12) /* 2^12 = 4KB */
 #define MAX_BO_CACHE_BUCKET (22) /* 2^22 = 4MB */
 
-/* Fencepost problem, hence the off-by-one */
-#define NR_BO_CACHE_BUCKETS (MAX_BO_CACHE_BUCKET - MIN_BO_CACHE_BUCKET + 1)
+/* Each power-of-two level is further split into 2^BO_CACHE_CLASS_BITS
+ * linearly spaced size classes, so a lookup only skips over BOs within 25% of
+ * the requested size. Fencepost problem, hence the off-by-one */
+#define BO_CACHE_CLASS_BITS (2)
+#define NR_BO_CACHE_BUCKETS \
+        ((MAX_BO_CACHE_BUCKET - MIN_BO_CACHE_BUCKET + 1) << BO_CACHE_CLASS_BITS)
+
+struct panfrost_bo_cache_bucket {
+        /* Protects the list only. Kernel calls on cached BOs (waits,
+         * madvise, frees) are made after unlinking them. */
+        pthread_mutex_t lock;
+
+        /* Free BOs of this size class, in LRU (Least Recently Used)
+         * order, oldest first */
+        struct list_head list;
+};
 
 /* Cache for blit shaders. Defined here so they can be cached with the device */
 
@@ -126,20 +141,15 @@ struct panfrost_device {
         struct util_sparse_array bo_map;
 
         struct {
-                pthread_mutex_t lock;
-
-                /* List containing all cached BOs sorted in LRU (Least
-                 * Recently Used) order. This allows us to quickly evict BOs
-                 * that are more than 1 second old.
-                 */
-                struct list_head lru;
-
-                /* The BO cache is a set of buckets with power-of-two sizes
+                /* The BO cache is a set of buckets with size classes
                  * ranging from 2^12 (4096, the page size) to
-                 * 2^(12 + MAX_BO_CACHE_BUCKETS).
-                 * Each bucket is a linked list of free panfrost_bo objects. */
+                 * 2^MAX_BO_CACHE_BUCKET, each locked separately so
+                 * allocations of different sizes don't contend. */
+
+                struct panfrost_bo_cache_bucket buckets[NR_BO_CACHE_BUCKETS];
 
-                struct list_head buckets[NR_BO_CACHE_BUCKETS];
+                /* Time of the last sweep for stale BOs, in seconds */
+                time_t last_evict;
         } bo_cache;
 
         struct pan_blit_shaders blit_shaders;
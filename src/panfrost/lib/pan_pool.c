@@ -30,17 +30,134 @@
  * into whereever we left off. If there isn't space, we allocate a new entry
  * into the pool and copy there */
 
+void
+panfrost_pool_ring_init(struct pan_pool_ring *ring,
+                        struct panfrost_device *dev,
+                        unsigned create_flags)
+{
+        memset(ring, 0, sizeof(*ring));
+        ring->dev = dev;
+        ring->create_flags = create_flags;
+}
+
+static struct panfrost_bo *
+panfrost_pool_ring_pop(struct pan_pool_ring *ring)
+{
+        struct pan_pool_ring_entry *entry = &ring->entries[ring->head];
+
+        ring->head = (ring->head + 1) % PAN_POOL_RING_SIZE;
+        ring->count--;
+        return entry->bo;
+}
+
+void
+panfrost_pool_ring_fini(struct pan_pool_ring *ring)
+{
+        while (ring->count)
+                panfrost_bo_unreference(panfrost_pool_ring_pop(ring));
+}
+
+/* Returns an idle slab from the ring if the oldest one is, or NULL */
+
+static struct panfrost_bo *
+panfrost_pool_ring_acquire(struct pan_pool_ring *ring)
+{
+        if (!ring->count)
+                return NULL;
+
+        /* Slabs are retired in submission order, so if the oldest is still
+         * busy, the others are too */
+        struct pan_pool_ring_entry *entry = &ring->entries[ring->head];
+
+        if ((int32_t) (entry->seq - ring->idle_seq) > 0) {
+                if (!panfrost_bo_wait(entry->bo, 0, true))
+                        return NULL;
+
+                ring->idle_seq = entry->seq;
+        }
+
+        /* Everything retired alongside it is idle too, even if its access
+         * flags don't know that yet */
+        entry->bo->gpu_access = 0;
+        return panfrost_pool_ring_pop(ring);
+}
+
+static void
+panfrost_pool_ring_retire(struct pan_pool_ring *ring, struct panfrost_bo *bo)
+{
+        /* Keep enough idle slabs to cover a couple of batches at the
+         * high-water mark, release anything beyond that (or beyond what the
+         * ring holds at all) to the BO cache, oldest first */
+        unsigned keep = MIN2(MAX2(2 * ring->high_water, 1), PAN_POOL_RING_SIZE);
+
+        while (ring->count >= keep)
+                panfrost_bo_unreference(panfrost_pool_ring_pop(ring));
+
+        unsigned tail = (ring->head + ring->count) % PAN_POOL_RING_SIZE;
+
+        ring->entries[tail].bo = bo;
+        ring->entries[tail].seq = ring->seq;
+        ring->count++;
+}
+
+static void
+panfrost_pool_ring_retire_pool(struct pan_pool_ring *ring,
+                               struct pan_pool *pool)
+{
+        ring->seq++;
+
+        util_dynarray_foreach(&pool->bos, struct panfrost_bo *, bo) {
+                /* Oversized backings are one-offs and go straight back to
+                 * the BO cache */
+                if ((*bo)->size != TRANSIENT_SLAB_SIZE) {
+                        panfrost_bo_unreference(*bo);
+                        continue;
+                }
+
+                assert(ring->outstanding > 0);
+                ring->outstanding--;
+                panfrost_pool_ring_retire(ring, *bo);
+        }
+
+        /* Roll the high-water mark over periodically so it tracks the
+         * recent workload rather than the worst frame ever seen */
+        if (++ring->retired_in_period >= 256) {
+                ring->high_water = ring->peak;
+                ring->peak = ring->outstanding;
+                ring->retired_in_period = 0;
+        }
+}
+
 static struct panfrost_bo *
 panfrost_pool_alloc_backing(struct pan_pool *pool, size_t bo_sz)
 {
+        struct pan_pool_ring *ring = pool->ring;
+        struct panfrost_bo *bo = NULL;
+
+        /* Standard slabs come from the ring when possible, which spares us
+         * the BO cache lookup and the mmap */
+        if (ring && bo_sz == TRANSIENT_SLAB_SIZE)
+                bo = panfrost_pool_ring_acquire(ring);
+
         /* We don't know what the BO will be used for, so let's flag it
          * RW and attach it to both the fragment and vertex/tiler jobs.
          * TODO: if we want fine grained BO assignment we should pass
          * flags to this function and keep the read/write,
          * fragment/vertex+tiler pools separate.
          */
-        struct panfrost_bo *bo = panfrost_bo_create(pool->dev, bo_sz,
-                        pool->create_flags);
+        if (!bo)
+                bo = panfrost_bo_create(pool->dev, bo_sz, pool->create_flags);
+
+        if (!bo)
+                return NULL;
+
+        /* The BO cache may hand out something bigger, which we don't recycle
+         * since the ring only deals in standard slabs */
+        if (ring && bo->size == TRANSIENT_SLAB_SIZE) {
+                ring->outstanding++;
+                ring->peak = MAX2(ring->peak, ring->outstanding);
+                ring->high_water = MAX2(ring->high_water, ring->peak);
+        }
 
         util_dynarray_append(&pool->bos, struct panfrost_bo *, bo);
         pool->transient_bo = bo;
@@ -52,10 +169,14 @@ panfrost_pool_alloc_backing(struct pan_pool *pool, size_t bo_sz)
 void
 panfrost_pool_init(struct pan_pool *pool, void *memctx,
                    struct panfrost_device *dev,
-                   unsigned create_flags, bool prealloc)
+                   unsigned create_flags, struct pan_pool_ring *ring,
+                   bool prealloc)
 {
+        assert(!ring || ring->create_flags == create_flags);
+
         memset(pool, 0, sizeof(*pool));
         pool->dev = dev;
+        pool->ring = ring;
         pool->create_flags = create_flags;
         util_dynarray_init(&pool->bos, memctx);
 
@@ -66,6 +187,12 @@ panfrost_pool_init(struct pan_pool *pool, void *memctx,
 void
 panfrost_pool_cleanup(struct pan_pool *pool)
 {
+        if (pool->ring) {
+                panfrost_pool_ring_retire_pool(pool->ring, pool);
+                util_dynarray_fini(&pool->bos);
+                return;
+        }
+
         util_dynarray_foreach(&pool->bos, struct panfrost_bo *, bo)
                 panfrost_bo_unreference(*bo);
 
@@ -105,6 +232,9 @@ panfrost_pool_alloc_aligned(struct pan_pool *pool, size_t sz, unsigned alignment
                 bo = panfrost_pool_alloc_backing(pool,
                                 ALIGN_POT(MAX2(TRANSIENT_SLAB_SIZE, sz), 4096));
                 offset = 0;
+
+                if (!bo)
+                        return (struct panfrost_ptr) { 0 };
         }
 
         pool->transient_offset = offset + sz;
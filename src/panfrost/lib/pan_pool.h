@@ -31,6 +31,50 @@
 
 #include "util/u_dynarray.h"
 
+/* Recycles transient slabs across pools with the same BO flags. Pools are
+ * short-lived (one per batch in OpenGL), so rather than handing their slabs
+ * back to the BO cache and fetching them again for the next batch, retired
+ * slabs are queued here in retirement order and reused as soon as the GPU is
+ * done with them. Slabs stay mapped while in the ring. */
+
+#define PAN_POOL_RING_SIZE (64)
+
+struct pan_pool_ring_entry {
+        struct panfrost_bo *bo;
+
+        /* Retirement sequence number of the pool the slab came from */
+        uint32_t seq;
+};
+
+struct pan_pool_ring {
+        struct panfrost_device *dev;
+        unsigned create_flags;
+
+        /* Circular queue of retired slabs, oldest first */
+        struct pan_pool_ring_entry entries[PAN_POOL_RING_SIZE];
+        unsigned head, count;
+
+        /* Sequence number of the last retired pool, and of the newest pool
+         * known to be idle. Slabs of a pool are retired together, so once one
+         * is idle the others can be reused without asking the kernel. */
+        uint32_t seq, idle_seq;
+
+        /* Slabs currently handed out to pools, the peak of that during the
+         * current period, and the peak of the previous period. Idle slabs in
+         * excess of twice the high-water mark go back to the BO cache, so
+         * the ring shrinks again after a heavy burst. */
+        unsigned outstanding, peak, high_water;
+        unsigned retired_in_period;
+};
+
+void
+panfrost_pool_ring_init(struct pan_pool_ring *ring,
+                        struct panfrost_device *dev,
+                        unsigned create_flags);
+
+void
+panfrost_pool_ring_fini(struct pan_pool_ring *ring);
+
 /* Represents a pool of memory that can only grow, used to allocate objects
  * with the same lifetime as the pool itself. In OpenGL, a pool is owned by the
  * batch for transient structures. In Vulkan, it may be owned by e.g. the
@@ -40,6 +84,9 @@ struct pan_pool {
         /* Parent device for allocation */
         struct panfrost_device *dev;
 
+        /* Optional ring to recycle transient slabs through */
+        struct pan_pool_ring *ring;
+
         /* BOs allocated by this pool */
         struct util_dynarray bos;
 
@@ -56,7 +103,7 @@ struct pan_pool {
 void
 panfrost_pool_init(struct pan_pool *pool, void *memctx,
                    struct panfrost_device *dev, unsigned create_flags,
-                   bool prealloc);
+                   struct pan_pool_ring *ring, bool prealloc);
 
 void
 panfrost_pool_cleanup(struct pan_pool *pool);
@@ -235,11 +235,10 @@ panfrost_open_device(void *memctx, int fd, struct panfrost_device *dev)
 
         util_sparse_array_init(&dev->bo_map, sizeof(struct panfrost_bo), 512);
 
-        pthread_mutex_init(&dev->bo_cache.lock, NULL);
-        list_inithead(&dev->bo_cache.lru);
-
-        for (unsigned i = 0; i < ARRAY_SIZE(dev->bo_cache.buckets); ++i)
-                list_inithead(&dev->bo_cache.buckets[i]);
+        for (unsigned i = 0; i < ARRAY_SIZE(dev->bo_cache.buckets); ++i) {
+                pthread_mutex_init(&dev->bo_cache.buckets[i].lock, NULL);
+                list_inithead(&dev->bo_cache.buckets[i].list);
+        }
 
         /* Tiler heap is internally required by the tiler, which can only be
          * active for a single job chain at once, so a single heap can be
@@ -255,7 +254,10 @@ panfrost_close_device(struct panfrost_device *dev)
         panfrost_bo_unreference(dev->blit_shaders.bo);
         panfrost_bo_unreference(dev->tiler_heap);
         panfrost_bo_cache_evict_all(dev);
-        pthread_mutex_destroy(&dev->bo_cache.lock);
+
+        for (unsigned i = 0; i < ARRAY_SIZE(dev->bo_cache.buckets); ++i)
+                pthread_mutex_destroy(&dev->bo_cache.buckets[i].lock);
+
         drmFreeVersion(dev->kernel_version);
         util_sparse_array_finish(&dev->bo_map);
 
@@ -51,6 +51,9 @@ void pandecode_close(void);
 void
 pandecode_inject_mmap(uint64_t gpu_va, void *cpu, unsigned sz, const char *name);
 
+void
+pandecode_inject_free(uint64_t gpu_va, unsigned sz);
+
 void pandecode_jc(uint64_t jc_gpu_va, bool bifrost, unsigned gpu_id, bool minimal);
 
 #endif /* __MMAP_TRACE_H__ */
@@ -28,63 +28,226 @@
  * slices (start, start + count) of the index buffer at drawtime. As this can
  * be quite expensive, we cache. Conceptually, we just use a hash table mapping
  * the key (start, count) to the value (min, max). In practice, mesa's hash
- * table implementation is higher overhead than we would like and makes
- * handling memory usage a little complicated. So we use this data structure
- * instead. Searching is O(n) to the size, but the size is capped at the
- * PANFROST_MINMAX_SIZE constant (so this is a tradeoff between cache hit/miss
- * ratio and cache search speed). Note that keys are adjacent so we get cache
- * line alignment benefits. Insertion is O(1) and in-order until the cache
- * fills up, after that it evicts the oldest cached value in a ring facilitated
- * by index.
+ * table implementation is higher overhead than we would like (an allocation
+ * per entry and a pointer chase per probe), so we use a fixed-size
+ * open-addressed table with linear probing over a flat array of entries. The
+ * table is kept at most half full, so probes are short. Once every entry is in
+ * use, the oldest is evicted in a ring facilitated by clock.
+ *
+ * Writes to the index buffer must drop every cached range they overlap. Live
+ * entries are also kept in a tree ordered by start, and we track an upper
+ * bound on their counts, so the overlapping entries of a write to [x, x + w)
+ * are exactly those with start in (x - max_count, x + w) that reach x. Only
+ * that part of the tree is walked, rather than the whole cache.
  */
 
+#include <inttypes.h>
+#include <stdio.h>
+
 #include "pan_minmax_cache.h"
+#include "util/ralloc.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+
+DEBUG_GET_ONCE_NUM_OPTION(minmax_cache_size, "PAN_MINMAX_CACHE_SIZE", PANFROST_MINMAX_SIZE)
+DEBUG_GET_ONCE_BOOL_OPTION(minmax_cache_stats, "PAN_MINMAX_CACHE_STATS", false)
+
+/* Capacity of zero picks the default */
+
+struct panfrost_minmax_cache *
+panfrost_minmax_cache_create(void *memctx, unsigned capacity)
+{
+        struct panfrost_minmax_cache *cache =
+                rzalloc(memctx, struct panfrost_minmax_cache);
+
+        if (!capacity)
+                capacity = debug_get_option_minmax_cache_size();
+
+        cache->capacity = MAX2(capacity, 1);
+        cache->slot_mask = util_next_power_of_two(cache->capacity * 2) - 1;
+        rb_tree_init(&cache->ranges);
+
+        return cache;
+}
+
+void
+panfrost_minmax_cache_destroy(struct panfrost_minmax_cache *cache)
+{
+        if (!cache)
+                return;
+
+        if (debug_get_option_minmax_cache_stats()) {
+                struct panfrost_minmax_cache_stats *s = &cache->stats;
+                uint64_t lookups = s->hits + s->misses;
+
+                fprintf(stderr, "minmax cache %p: %" PRIu64 " hits, %" PRIu64
+                        " misses (%.1f%% hit rate), %" PRIu64 " evictions, %"
+                        PRIu64 " invalidations\n", cache, s->hits, s->misses,
+                        lookups ? (100.0 * s->hits) / lookups : 0.0,
+                        s->evictions, s->invalidations);
+        }
+
+        ralloc_free(cache);
+}
+
+static inline unsigned
+panfrost_minmax_hash(const struct panfrost_minmax_cache *cache,
+                     uint32_t start, uint32_t count)
+{
+        /* Fibonacci hashing of the packed key */
+        uint64_t key = (((uint64_t) count) << 32) | start;
+
+        return ((key * 0x9e3779b97f4a7c15ull) >> 40) & cache->slot_mask;
+}
+
+/* Returns the slot holding (start, count), or the empty slot it would go in */
+
+static unsigned
+panfrost_minmax_find_slot(const struct panfrost_minmax_cache *cache,
+                          uint32_t start, uint32_t count)
+{
+        unsigned i = panfrost_minmax_hash(cache, start, count);
+
+        for (;; i = (i + 1) & cache->slot_mask) {
+                uint32_t slot = cache->slots[i];
+
+                if (!slot)
+                        return i;
+
+                const struct panfrost_minmax_entry *e = &cache->entries[slot - 1];
+
+                if (e->start == start && e->count == count)
+                        return i;
+        }
+}
+
+static int
+panfrost_minmax_entry_cmp(const struct rb_node *a, const struct rb_node *b)
+{
+        const struct panfrost_minmax_entry *ea =
+                rb_node_data(struct panfrost_minmax_entry, a, node);
+        const struct panfrost_minmax_entry *eb =
+                rb_node_data(struct panfrost_minmax_entry, b, node);
+
+        return (eb->start > ea->start) - (eb->start < ea->start);
+}
+
+/* Drop an entry from the table, the tree and onto the free list */
+
+static void
+panfrost_minmax_remove(struct panfrost_minmax_cache *cache,
+                       struct panfrost_minmax_entry *e)
+{
+        unsigned mask = cache->slot_mask;
+        unsigned i = panfrost_minmax_find_slot(cache, e->start, e->count);
+
+        assert(cache->slots[i] == (e - cache->entries) + 1);
+
+        /* Backward shift deletion, so lookups never need tombstones. Move
+         * later entries of the run down into the hole unless that would put
+         * them before their home slot. */
+        for (unsigned j = (i + 1) & mask; cache->slots[j]; j = (j + 1) & mask) {
+                const struct panfrost_minmax_entry *m =
+                        &cache->entries[cache->slots[j] - 1];
+                unsigned home = panfrost_minmax_hash(cache, m->start, m->count);
+
+                if (((j - home) & mask) >= ((j - i) & mask)) {
+                        cache->slots[i] = cache->slots[j];
+                        i = j;
+                }
+        }
+
+        cache->slots[i] = 0;
+
+        rb_tree_remove(&cache->ranges, &e->node);
+
+        if (rb_tree_is_empty(&cache->ranges))
+                cache->max_count = 0;
+
+        e->next_free = cache->free_head;
+        cache->free_head = (e - cache->entries) + 1;
+}
 
 bool
 panfrost_minmax_cache_get(struct panfrost_minmax_cache *cache, unsigned start, unsigned count,
                      unsigned *min_index, unsigned *max_index)
 {
-        uint64_t ht_key = (((uint64_t)count) << 32) | start;
-        bool found = false;
-
         if (!cache)
-           return false;
+                return false;
 
-        for (unsigned i = 0; i < cache->size; ++i) {
-                if (cache->keys[i] == ht_key) {
-                        uint64_t hit = cache->values[i];
+        if (cache->slots) {
+                uint32_t slot = cache->slots[panfrost_minmax_find_slot(cache, start, count)];
 
-                        *min_index = hit & 0xffffffff;
-                        *max_index = hit >> 32;
-                        found = true;
-                        break;
+                if (slot) {
+                        const struct panfrost_minmax_entry *e = &cache->entries[slot - 1];
+
+                        *min_index = e->min_index;
+                        *max_index = e->max_index;
+                        cache->stats.hits++;
+                        return true;
                 }
         }
 
-        return found;
+        cache->stats.misses++;
+        return false;
 }
 
 void
 panfrost_minmax_cache_add(struct panfrost_minmax_cache *cache, unsigned start, unsigned count,
                      unsigned min_index, unsigned max_index)
 {
-        uint64_t ht_key = (((uint64_t)count) << 32) | start;
-        uint64_t value = min_index | (((uint64_t)max_index) << 32);
-        unsigned index = 0;
-
         if (!cache)
                 return;
 
-        if (cache->size == PANFROST_MINMAX_SIZE) {
-                index = cache->index++;
-                cache->index = cache->index % PANFROST_MINMAX_SIZE;
+        if (!cache->slots) {
+                cache->entries = ralloc_array(cache, struct panfrost_minmax_entry,
+                                              cache->capacity);
+                cache->slots = rzalloc_array(cache, uint32_t, cache->slot_mask + 1);
+
+                if (!cache->entries || !cache->slots) {
+                        ralloc_free(cache->entries);
+                        ralloc_free(cache->slots);
+                        cache->entries = NULL;
+                        cache->slots = NULL;
+                        return;
+                }
+        }
+
+        unsigned i = panfrost_minmax_find_slot(cache, start, count);
+        struct panfrost_minmax_entry *e;
+
+        /* Already cached, just refresh the value */
+        if (cache->slots[i]) {
+                e = &cache->entries[cache->slots[i] - 1];
+                e->min_index = min_index;
+                e->max_index = max_index;
+                return;
+        }
+
+        if (!cache->free_head && cache->used == cache->capacity) {
+                panfrost_minmax_remove(cache, &cache->entries[cache->clock]);
+                cache->clock = (cache->clock + 1) % cache->capacity;
+                cache->stats.evictions++;
+
+                /* Removal may have moved our slot */
+                i = panfrost_minmax_find_slot(cache, start, count);
+        }
+
+        if (cache->free_head) {
+                e = &cache->entries[cache->free_head - 1];
+                cache->free_head = e->next_free;
         } else {
-                index = cache->size++;
+                e = &cache->entries[cache->used++];
         }
 
-        cache->keys[index] =  ht_key;
-        cache->values[index] = value;
+        e->start = start;
+        e->count = count;
+        e->min_index = min_index;
+        e->max_index = max_index;
 
+        cache->slots[i] = (e - cache->entries) + 1;
+        rb_tree_insert(&cache->ranges, &e->node, panfrost_minmax_entry_cmp);
+        cache->max_count = MAX2(cache->max_count, count);
 }
 
 /* If we've been caching min/max indices and we update the index
@@ -101,23 +264,42 @@ panfrost_minmax_cache_invalidate(struct panfrost_minmax_cache *cache, struct pip
         if (!(transfer->usage & PIPE_MAP_WRITE))
                 return;
 
-        unsigned valid_count = 0;
+        uint32_t start = transfer->box.x;
+        uint32_t end = transfer->box.x + transfer->box.width;
 
-        for (unsigned i = 0; i < cache->size; ++i) {
-                uint64_t key = cache->keys[i];
+        /* Nothing starting at or before this can reach the write */
+        int64_t lo = (int64_t) start - cache->max_count;
 
-                uint32_t start = key & 0xffffffff;
-                uint32_t count = key >> 32;
+        /* Find the first entry starting after lo */
+        struct rb_node *first = NULL;
 
-                /* 1D range intersection */
-                bool invalid = MAX2(transfer->box.x, start) < MIN2(transfer->box.x + transfer->box.width, start + count);
-                if (!invalid) {
-                        cache->keys[valid_count] = key;
-                        cache->values[valid_count] = cache->values[i];
-                        valid_count++;
+        for (struct rb_node *n = cache->ranges.root; n; ) {
+                const struct panfrost_minmax_entry *e =
+                        rb_node_data(struct panfrost_minmax_entry, n, node);
+
+                if (e->start > lo) {
+                        first = n;
+                        n = n->left;
+                } else {
+                        n = n->right;
                 }
         }
 
-        cache->size = valid_count;
-        cache->index = 0;
+        struct rb_node *next;
+
+        for (struct rb_node *n = first; n; n = next) {
+                struct panfrost_minmax_entry *e =
+                        rb_node_data(struct panfrost_minmax_entry, n, node);
+
+                if (e->start >= end)
+                        break;
+
+                next = rb_node_next(n);
+
+                /* 1D range intersection */
+                if (MAX2(start, e->start) < MIN2(end, e->start + e->count)) {
+                        panfrost_minmax_remove(cache, e);
+                        cache->stats.invalidations++;
+                }
+        }
 }
@@ -27,17 +27,60 @@
 #ifndef H_PAN_MINMAX_CACHE
 #define H_PAN_MINMAX_CACHE
 
+#include "util/rb_tree.h"
 #include "util/u_transfer.h"
 
-#define PANFROST_MINMAX_SIZE 64
+/* Default number of cached ranges per index buffer, overridable with the
+ * PAN_MINMAX_CACHE_SIZE environment variable */
+#define PANFROST_MINMAX_SIZE 512
+
+struct panfrost_minmax_entry {
+        /* In the cache's range tree, ordered by start */
+        struct rb_node node;
+
+        uint32_t start, count;
+        uint32_t min_index, max_index;
+
+        /* Next free entry plus one, when not in use */
+        uint32_t next_free;
+};
+
+struct panfrost_minmax_cache_stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t invalidations;
+};
 
 struct panfrost_minmax_cache {
-        uint64_t keys[PANFROST_MINMAX_SIZE];
-        uint64_t values[PANFROST_MINMAX_SIZE];
-        unsigned size;
-        unsigned index;
+        /* Storage for up to capacity entries and a twice as large
+         * open-addressed table of entry indices plus one (zero is empty).
+         * Both are allocated on first insertion. */
+        struct panfrost_minmax_entry *entries;
+        uint32_t *slots;
+        unsigned capacity;
+        unsigned slot_mask;
+
+        /* Entries handed out so far, free list head plus one, and the next
+         * entry to evict once full */
+        unsigned used;
+        unsigned free_head;
+        unsigned clock;
+
+        /* Live entries by start, and an upper bound on their counts, so
+         * writes find overlapping ranges without a full scan */
+        struct rb_tree ranges;
+        uint32_t max_count;
+
+        struct panfrost_minmax_cache_stats stats;
 };
 
+struct panfrost_minmax_cache *
+panfrost_minmax_cache_create(void *memctx, unsigned capacity);
+
+void
+panfrost_minmax_cache_destroy(struct panfrost_minmax_cache *cache);
+
 bool
 panfrost_minmax_cache_get(struct panfrost_minmax_cache *cache, unsigned start, unsigned count,
                      unsigned *min_index, unsigned *max_index);
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* The draw path takes its index bounds from the cache, and sizes vertex jobs
+ * from them. A hit must therefore only ever return the bounds of exactly the
+ * requested range, never those of another or a stale one. */
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdbool.h>
+
+#include "pan_minmax_cache.h"
+
+static void
+check_hit(struct panfrost_minmax_cache *cache, unsigned start, unsigned count,
+          unsigned min, unsigned max)
+{
+        unsigned out_min = ~0, out_max = ~0;
+
+        assert(panfrost_minmax_cache_get(cache, start, count, &out_min, &out_max));
+        assert(out_min == min && out_max == max);
+}
+
+static void
+check_miss(struct panfrost_minmax_cache *cache, unsigned start, unsigned count)
+{
+        unsigned out_min, out_max;
+
+        assert(!panfrost_minmax_cache_get(cache, start, count, &out_min, &out_max));
+}
+
+static void
+write_range(struct panfrost_minmax_cache *cache, unsigned x, unsigned width)
+{
+        struct pipe_transfer transfer = {
+                .usage = PIPE_MAP_WRITE,
+                .box = { .x = x, .width = width, .height = 1, .depth = 1 },
+        };
+
+        panfrost_minmax_cache_invalidate(cache, &transfer);
+}
+
+int
+main(void)
+{
+        struct panfrost_minmax_cache *cache =
+                panfrost_minmax_cache_create(NULL, 4);
+
+        /* Only the exact range of a result hits */
+        panfrost_minmax_cache_add(cache, 0, 65536, 3, 1000);
+        check_hit(cache, 0, 65536, 3, 1000);
+        check_miss(cache, 0, 1024);
+        check_miss(cache, 1024, 65536);
+        check_miss(cache, 1, 65535);
+
+        /* Ranges sharing a start don't alias */
+        panfrost_minmax_cache_add(cache, 0, 1024, 7, 9);
+        check_hit(cache, 0, 1024, 7, 9);
+        check_hit(cache, 0, 65536, 3, 1000);
+
+        /* A write drops every range it overlaps, and only those */
+        panfrost_minmax_cache_add(cache, 100000, 16, 1, 2);
+        write_range(cache, 2000, 4);
+        check_miss(cache, 0, 65536);
+        check_hit(cache, 0, 1024, 7, 9);
+        check_hit(cache, 100000, 16, 1, 2);
+
+        /* Eviction drops the oldest range rather than returning it */
+        for (unsigned i = 0; i < 8; ++i)
+                panfrost_minmax_cache_add(cache, 200000 + i, 1, i, i);
+
+        check_miss(cache, 0, 1024);
+        check_hit(cache, 200007, 1, 7, 7);
+
+        panfrost_minmax_cache_destroy(cache);
+        return 0;
+}
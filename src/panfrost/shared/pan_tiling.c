@@ -28,6 +28,7 @@
 #include "pan_tiling.h"
 #include <stdbool.h>
 #include "util/macros.h"
+#include "util/u_cpu_detect.h"
 
 /* This file implements software encode/decode of the tiling format used for
  * textures and framebuffers primarily on Utgard GPUs. Names for this format
@@ -177,9 +178,13 @@ typedef struct {
  * Finally, we iterate each row in source order. In the outer loop, we iterate
  * each 16 pixel tile. Within each tile, we iterate the 16 pixels (this should
  * be unrolled), calculating the index within the tile and writing.
+ *
+ * Where the CPU supports it, full tiles are instead handled a 4x4 block at a
+ * time by the vectorized kernels in pan_tiling_simd.c. This path remains the
+ * fallback, and handles 24bpp formats which don't map well onto vectors.
  */
 
-#define TILED_ACCESS_TYPE(pixel_t, shift) \
+#define TILED_ACCESS_TYPE(pixel_t) \
 static ALWAYS_INLINE void \
 panfrost_access_tiled_image_##pixel_t \
                               (void *dst, void *src, \
@@ -195,10 +200,10 @@ panfrost_access_tiled_image_##pixel_t \
       uint8_t *dest = (uint8_t *) (dest_start + (block_y * dst_stride)); \
       pixel_t *source = src + (src_y * src_stride); \
       pixel_t *source_end = source + w; \
-      unsigned expanded_y = bit_duplication[y & 0xF] << shift; \
-      for (; source < source_end; dest += (PIXELS_PER_TILE << shift)) { \
+      unsigned expanded_y = bit_duplication[y & 0xF]; \
+      for (; source < source_end; dest += (PIXELS_PER_TILE * sizeof(pixel_t))) { \
          for (uint8_t i = 0; i < 16; ++i) { \
-            unsigned index = expanded_y ^ (space_4[i] << shift); \
+            unsigned index = (expanded_y ^ space_4[i]) * sizeof(pixel_t); \
             if (is_store) \
                 *((pixel_t *) (dest + index)) = *(source++); \
             else \
@@ -208,11 +213,12 @@ panfrost_access_tiled_image_##pixel_t \
    } \
 } \
 
-TILED_ACCESS_TYPE(uint8_t, 0);
-TILED_ACCESS_TYPE(uint16_t, 1);
-TILED_ACCESS_TYPE(uint32_t, 2);
-TILED_ACCESS_TYPE(uint64_t, 3);
-TILED_ACCESS_TYPE(pan_uint128_t, 4);
+TILED_ACCESS_TYPE(uint8_t);
+TILED_ACCESS_TYPE(uint16_t);
+TILED_ACCESS_TYPE(pan_uint24_t);
+TILED_ACCESS_TYPE(uint32_t);
+TILED_ACCESS_TYPE(uint64_t);
+TILED_ACCESS_TYPE(pan_uint128_t);
 
 #define TILED_UNALIGNED_TYPE(pixel_t, is_store, tile_shift) { \
    const unsigned mask = (1 << tile_shift) - 1; \
@@ -250,21 +256,18 @@ TILED_ACCESS_TYPE(pan_uint128_t, 4);
       TILED_UNALIGNED_TYPE(pan_uint128_t, store, shift) \
 }
 
+/* Handles any region, with w and h in units of format blocks */
+
 static void
 panfrost_access_tiled_image_generic(void *dst, void *src,
                                unsigned sx, unsigned sy,
                                unsigned w, unsigned h,
                                uint32_t dst_stride,
                                uint32_t src_stride,
-                               const struct util_format_description *desc,
+                               unsigned bpp, unsigned tile_shift,
                                bool _is_store)
 {
-   unsigned bpp = desc->block.bits;
-
-   if (desc->block.width > 1) {
-      w = DIV_ROUND_UP(w, desc->block.width);
-      h = DIV_ROUND_UP(h, desc->block.height);
-
+   if (tile_shift == 2) {
       if (_is_store)
          TILED_UNALIGNED_TYPES(true, 2)
       else
@@ -277,6 +280,32 @@ panfrost_access_tiled_image_generic(void *dst, void *src,
    }
 }
 
+/* Whether full tiles go through the vectorized kernels, decided on first use
+ * unless overriden */
+
+static int pan_tiling_simd = -1;
+
+void
+panfrost_tiling_enable_simd(bool enable)
+{
+   pan_tiling_simd = enable;
+}
+
+static bool
+panfrost_tiling_has_simd(void)
+{
+   if (unlikely(pan_tiling_simd < 0)) {
+#ifdef PAN_TILING_SIMD
+      util_cpu_detect();
+      pan_tiling_simd = util_cpu_caps.has_sse2 || util_cpu_caps.has_neon;
+#else
+      pan_tiling_simd = false;
+#endif
+   }
+
+   return pan_tiling_simd;
+}
+
 #define OFFSET(src, _x, _y) (void *) ((uint8_t *) src + ((_y) - orig_y) * src_stride + (((_x) - orig_x) * (bpp / 8)))
 
 static ALWAYS_INLINE void
@@ -289,20 +318,34 @@ panfrost_access_tiled_image(void *dst, void *src,
                            bool is_store)
 {
    const struct util_format_description *desc = util_format_description(format);
+   unsigned bpp = desc->block.bits;
 
-   if (desc->block.width > 1 || desc->block.bits == 24) {
+   /* Compressed formats are tiled in 4x4 tiles of blocks. Everything
+    * below works in units of blocks */
+   unsigned tile_shift = 4;
+
+   if (desc->block.width > 1) {
+      w = DIV_ROUND_UP(w, desc->block.width);
+      h = DIV_ROUND_UP(h, desc->block.height);
+      tile_shift = 2;
+   }
+
+   bool simd = panfrost_tiling_has_simd() && bpp != 24;
+
+   /* Without vectors, only uncompressed formats have full-tile kernels */
+   if (!simd && tile_shift != 4) {
       panfrost_access_tiled_image_generic(dst, (void *) src,
             x, y, w, h,
-            dst_stride, src_stride, desc, is_store);
+            dst_stride, src_stride, bpp, tile_shift, is_store);
 
       return;
    }
 
-   unsigned bpp = desc->block.bits;
-   unsigned first_full_tile_x = DIV_ROUND_UP(x, TILE_WIDTH) * TILE_WIDTH;
-   unsigned first_full_tile_y = DIV_ROUND_UP(y, TILE_HEIGHT) * TILE_HEIGHT;
-   unsigned last_full_tile_x = ((x + w) / TILE_WIDTH) * TILE_WIDTH;
-   unsigned last_full_tile_y = ((y + h) / TILE_HEIGHT) * TILE_HEIGHT;
+   unsigned tile_dim = 1 << tile_shift;
+   unsigned first_full_tile_x = DIV_ROUND_UP(x, tile_dim) * tile_dim;
+   unsigned first_full_tile_y = DIV_ROUND_UP(y, tile_dim) * tile_dim;
+   unsigned last_full_tile_x = ((x + w) / tile_dim) * tile_dim;
+   unsigned last_full_tile_y = ((y + h) / tile_dim) * tile_dim;
 
    /* First, tile the top portion */
 
@@ -313,7 +356,7 @@ panfrost_access_tiled_image(void *dst, void *src,
 
       panfrost_access_tiled_image_generic(dst, OFFSET(src, x, y),
             x, y, w, dist,
-            dst_stride, src_stride, desc, is_store);
+            dst_stride, src_stride, bpp, tile_shift, is_store);
 
       if (dist == h)
          return;
@@ -328,7 +371,7 @@ panfrost_access_tiled_image(void *dst, void *src,
 
       panfrost_access_tiled_image_generic(dst, OFFSET(src, x, last_full_tile_y),
             x, last_full_tile_y, w, dist,
-            dst_stride, src_stride, desc, is_store);
+            dst_stride, src_stride, bpp, tile_shift, is_store);
 
       h -= dist;
    }
@@ -339,7 +382,7 @@ panfrost_access_tiled_image(void *dst, void *src,
 
       panfrost_access_tiled_image_generic(dst, OFFSET(src, x, y),
             x, y, dist, h,
-            dst_stride, src_stride, desc, is_store);
+            dst_stride, src_stride, bpp, tile_shift, is_store);
 
       if (dist == w)
          return;
@@ -354,15 +397,26 @@ panfrost_access_tiled_image(void *dst, void *src,
 
       panfrost_access_tiled_image_generic(dst, OFFSET(src, last_full_tile_x, y),
             last_full_tile_x, y, dist, h,
-            dst_stride, src_stride, desc, is_store);
+            dst_stride, src_stride, bpp, tile_shift, is_store);
 
       w -= dist;
    }
 
+   if (!w || !h)
+      return;
+
+   if (simd && panfrost_access_tiled_image_simd(dst, OFFSET(src, x, y),
+                                                x, y, w, h,
+                                                dst_stride, src_stride,
+                                                bpp, tile_shift, is_store))
+      return;
+
    if (bpp == 8)
       panfrost_access_tiled_image_uint8_t(dst,  OFFSET(src, x, y), x, y, w, h, dst_stride, src_stride, is_store);
    else if (bpp == 16)
       panfrost_access_tiled_image_uint16_t(dst, OFFSET(src, x, y), x, y, w, h, dst_stride, src_stride, is_store);
+   else if (bpp == 24)
+      panfrost_access_tiled_image_pan_uint24_t(dst, OFFSET(src, x, y), x, y, w, h, dst_stride, src_stride, is_store);
    else if (bpp == 32)
       panfrost_access_tiled_image_uint32_t(dst, OFFSET(src, x, y), x, y, w, h, dst_stride, src_stride, is_store);
    else if (bpp == 64)
@@ -27,6 +27,7 @@
 #ifndef H_PANFROST_TILING
 #define H_PANFROST_TILING
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <util/format/u_format.h>
 
@@ -44,4 +45,20 @@ void panfrost_store_tiled_image(void *dst, const void *src,
                                 uint32_t src_stride,
                                 enum pipe_format format);
 
+/* Full tiles use vectorized kernels when the CPU supports them. This allows
+ * forcing the scalar path instead, for testing and benchmarking. */
+
+void panfrost_tiling_enable_simd(bool enable);
+
+/* Vectorized access to a tile-aligned region, w and h in units of format
+ * blocks. Returns false if the element size isn't handled. */
+
+bool panfrost_access_tiled_image_simd(void *tiled, void *linear,
+                                      unsigned x, unsigned y,
+                                      unsigned w, unsigned h,
+                                      uint32_t tiled_stride,
+                                      uint32_t linear_stride,
+                                      unsigned bpp, unsigned tile_shift,
+                                      bool is_store);
+
 #endif
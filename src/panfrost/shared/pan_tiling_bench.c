@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Throughput of u-interleaved tiling and detiling, scalar against vectorized
+ * full-tile kernels, for a range of formats. Both paths are also checked to
+ * produce identical results. No GPU needed.
+ *
+ * Usage: panfrost_tiling_bench [width] [height] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pan_tiling.h"
+#include "util/os_time.h"
+#include "util/u_math.h"
+
+static const enum pipe_format formats[] = {
+   PIPE_FORMAT_R8_UNORM,
+   PIPE_FORMAT_B5G6R5_UNORM,
+   PIPE_FORMAT_R8G8B8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+   PIPE_FORMAT_R16G16B16A16_FLOAT,
+   PIPE_FORMAT_R32G32B32A32_FLOAT,
+   PIPE_FORMAT_ETC2_RGB8,
+   PIPE_FORMAT_ETC2_RGBA8,
+};
+
+/* Returns the throughput in MB/s of the linear side */
+
+static double
+bench(bool simd, bool store, void *tiled, void *linear,
+      unsigned width, unsigned height,
+      uint32_t tiled_stride, uint32_t linear_stride,
+      enum pipe_format format, unsigned iterations)
+{
+   panfrost_tiling_enable_simd(simd);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < iterations; ++i) {
+      if (store) {
+         panfrost_store_tiled_image(tiled, linear, 0, 0, width, height,
+                                    tiled_stride, linear_stride, format);
+      } else {
+         panfrost_load_tiled_image(linear, tiled, 0, 0, width, height,
+                                   linear_stride, tiled_stride, format);
+      }
+   }
+
+   int64_t elapsed = os_time_get_nano() - start;
+   double bytes = (double) linear_stride *
+                  DIV_ROUND_UP(height, util_format_get_blockheight(format)) *
+                  iterations;
+
+   return bytes / (elapsed / 1e9) / (1024 * 1024);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned width = argc > 1 ? atoi(argv[1]) : 1024;
+   unsigned height = argc > 2 ? atoi(argv[2]) : 1024;
+   unsigned iterations = argc > 3 ? atoi(argv[3]) : 20;
+   int ret = 0;
+
+   printf("%-32s %12s %12s %12s %12s\n", "format",
+          "store", "store simd", "load", "load simd");
+
+   for (unsigned f = 0; f < ARRAY_SIZE(formats); ++f) {
+      enum pipe_format format = formats[f];
+      const struct util_format_description *desc =
+         util_format_description(format);
+
+      unsigned bw = desc->block.width, bh = desc->block.height;
+      unsigned bytes = desc->block.bits / 8;
+
+      /* Tiled images are padded to whole 16x16 tiles of blocks */
+      unsigned tiled_w = ALIGN_POT(DIV_ROUND_UP(width, bw), 16);
+      unsigned tiled_h = ALIGN_POT(DIV_ROUND_UP(height, bh), 16);
+      uint32_t tiled_stride = tiled_w * bytes;
+      uint32_t linear_stride = DIV_ROUND_UP(width, bw) * bytes;
+      size_t linear_size = (size_t) linear_stride * DIV_ROUND_UP(height, bh);
+
+      uint8_t *linear = malloc(linear_size);
+      uint8_t *check = malloc(linear_size);
+      uint8_t *tiled = calloc(1, (size_t) tiled_stride * tiled_h);
+      uint8_t *tiled_ref = calloc(1, (size_t) tiled_stride * tiled_h);
+
+      for (size_t i = 0; i < linear_size; ++i)
+         linear[i] = rand();
+
+      double results[4];
+      results[0] = bench(false, true, tiled_ref, linear, width, height,
+                         tiled_stride, linear_stride, format, iterations);
+      results[1] = bench(true, true, tiled, linear, width, height,
+                         tiled_stride, linear_stride, format, iterations);
+      results[2] = bench(false, false, tiled, check, width, height,
+                         tiled_stride, linear_stride, format, iterations);
+      results[3] = bench(true, false, tiled, check, width, height,
+                         tiled_stride, linear_stride, format, iterations);
+
+      bool ok = !memcmp(tiled, tiled_ref, (size_t) tiled_stride * tiled_h) &&
+                !memcmp(linear, check, linear_size);
+
+      printf("%-32s %7.0f MB/s %7.0f MB/s %7.0f MB/s %7.0f MB/s%s\n",
+             desc->short_name, results[0], results[1], results[2],
+             results[3], ok ? "" : "  MISMATCH");
+
+      if (!ok)
+         ret = 1;
+
+      free(linear);
+      free(check);
+      free(tiled);
+      free(tiled_ref);
+   }
+
+   return ret;
+}
@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Vectorized full-tile kernels for u-interleaved tiling, see pan_tiling.c for
+ * a description of the format. This file is built with whatever flags the
+ * target needs for SSE2 or NEON, and only called when util_cpu_caps says the
+ * CPU has them.
+ *
+ * Rather than computing a swizzled index per pixel, we note that each 4x4
+ * block of pixels (4x4 blocks of compressed blocks for compressed formats) is
+ * stored as 16 contiguous elements, in the order
+ *
+ *    | y1 | (y1 ^ x1) | y0 | (y0 ^ x0) |
+ *
+ * and that the blocks of a 16x16 tile follow the same pattern one level up.
+ * Within a block, pixels come in horizontal pairs from the same row, which
+ * are swapped on odd rows. Letting Prx be the pair x of row r, a block is
+ * thus laid out as
+ *
+ *    P00 P10' P01 P11' P21 P31' P20 P30'
+ *
+ * where ' denotes a swapped pair. Every element size maps onto a handful of
+ * interleaves and in-register swaps, operating on a whole block at once. */
+
+#include <string.h>
+#include "util/macros.h"
+#include "pan_tiling.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PAN_TILING_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PAN_TILING_NEON
+#endif
+
+/* Index of each 4x4 block within a 16x16 tile, in units of blocks */
+
+static const uint8_t block_index[4][4] = {
+   { 0x0, 0x1, 0x4, 0x5 },
+   { 0x3, 0x2, 0x7, 0x6 },
+   { 0xc, 0xd, 0x8, 0x9 },
+   { 0xf, 0xe, 0xb, 0xa },
+};
+
+#if defined(PAN_TILING_SSE2)
+
+typedef __m128i pan_vec;
+
+#define LOAD(p) _mm_loadu_si128((const __m128i *) (p))
+#define STORE(p, v) _mm_storeu_si128((__m128i *) (p), v)
+
+static ALWAYS_INLINE pan_vec
+load_32(const uint8_t *p)
+{
+   uint32_t v;
+   memcpy(&v, p, sizeof(v));
+   return _mm_cvtsi32_si128(v);
+}
+
+static ALWAYS_INLINE void
+store_32(uint8_t *p, pan_vec v)
+{
+   uint32_t x = _mm_cvtsi128_si32(v);
+   memcpy(p, &x, sizeof(x));
+}
+
+#define LOAD_64(p) _mm_loadl_epi64((const __m128i *) (p))
+#define STORE_64(p, v) _mm_storel_epi64((__m128i *) (p), v)
+
+/* Swap adjacent elements of the given size */
+
+static ALWAYS_INLINE pan_vec
+swap_8(pan_vec v)
+{
+   return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static ALWAYS_INLINE pan_vec
+swap_16(pan_vec v)
+{
+   return _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+}
+
+static ALWAYS_INLINE pan_vec
+swap_32(pan_vec v)
+{
+   return _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+static ALWAYS_INLINE pan_vec
+swap_64(pan_vec v)
+{
+   return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+static ALWAYS_INLINE void
+store_block_8(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   /* Pairs are 16-bit */
+   pan_vec lo = _mm_unpacklo_epi16(load_32(l + 0 * stride),
+                                   swap_8(load_32(l + 1 * stride)));
+   pan_vec hi = _mm_unpacklo_epi16(load_32(l + 2 * stride),
+                                   swap_8(load_32(l + 3 * stride)));
+
+   /* P20 P30' P21 P31' -> P21 P31' P20 P30' */
+   hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 2, 0, 1));
+
+   STORE(t, _mm_unpacklo_epi64(lo, hi));
+}
+
+static ALWAYS_INLINE void
+load_block_8(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   pan_vec v = LOAD(t);
+
+   /* Gather each row's pair into the low and high dwords */
+   pan_vec lo = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0));
+   pan_vec hi = _mm_shufflehi_epi16(v, _MM_SHUFFLE(1, 3, 0, 2));
+
+   store_32(l + 0 * stride, lo);
+   store_32(l + 1 * stride, swap_8(_mm_srli_si128(lo, 4)));
+   store_32(l + 2 * stride, _mm_srli_si128(hi, 8));
+   store_32(l + 3 * stride, swap_8(_mm_srli_si128(hi, 12)));
+}
+
+static ALWAYS_INLINE void
+store_block_16(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   /* Pairs are 32-bit */
+   pan_vec lo = _mm_unpacklo_epi32(LOAD_64(l + 0 * stride),
+                                   swap_16(LOAD_64(l + 1 * stride)));
+   pan_vec hi = _mm_unpacklo_epi32(LOAD_64(l + 2 * stride),
+                                   swap_16(LOAD_64(l + 3 * stride)));
+
+   STORE(t + 0, lo);
+   STORE(t + 16, swap_64(hi));
+}
+
+static ALWAYS_INLINE void
+load_block_16(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   /* P00 P10' P01 P11' -> P00 P01 P10' P11' */
+   pan_vec lo = _mm_shuffle_epi32(LOAD(t + 0), _MM_SHUFFLE(3, 1, 2, 0));
+
+   /* P21 P31' P20 P30' -> P20 P21 P30' P31' */
+   pan_vec hi = _mm_shuffle_epi32(LOAD(t + 16), _MM_SHUFFLE(1, 3, 0, 2));
+
+   STORE_64(l + 0 * stride, lo);
+   STORE_64(l + 1 * stride, swap_16(_mm_srli_si128(lo, 8)));
+   STORE_64(l + 2 * stride, hi);
+   STORE_64(l + 3 * stride, swap_16(_mm_srli_si128(hi, 8)));
+}
+
+static ALWAYS_INLINE void
+store_block_32(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   /* Pairs are 64-bit */
+   pan_vec r0 = LOAD(l + 0 * stride);
+   pan_vec r1 = swap_32(LOAD(l + 1 * stride));
+   pan_vec r2 = LOAD(l + 2 * stride);
+   pan_vec r3 = swap_32(LOAD(l + 3 * stride));
+
+   STORE(t + 0, _mm_unpacklo_epi64(r0, r1));
+   STORE(t + 16, _mm_unpackhi_epi64(r0, r1));
+   STORE(t + 32, _mm_unpackhi_epi64(r2, r3));
+   STORE(t + 48, _mm_unpacklo_epi64(r2, r3));
+}
+
+static ALWAYS_INLINE void
+load_block_32(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   pan_vec q0 = LOAD(t + 0);
+   pan_vec q1 = LOAD(t + 16);
+   pan_vec q2 = LOAD(t + 32);
+   pan_vec q3 = LOAD(t + 48);
+
+   STORE(l + 0 * stride, _mm_unpacklo_epi64(q0, q1));
+   STORE(l + 1 * stride, swap_32(_mm_unpackhi_epi64(q0, q1)));
+   STORE(l + 2 * stride, _mm_unpacklo_epi64(q3, q2));
+   STORE(l + 3 * stride, swap_32(_mm_unpackhi_epi64(q3, q2)));
+}
+
+#elif defined(PAN_TILING_NEON)
+
+typedef uint8x16_t pan_vec;
+
+#define LOAD(p) vld1q_u8(p)
+#define STORE(p, v) vst1q_u8(p, v)
+
+static ALWAYS_INLINE uint8x8_t
+load_32(const uint8_t *p)
+{
+   uint32_t v;
+   memcpy(&v, p, sizeof(v));
+   return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static ALWAYS_INLINE void
+store_32(uint8_t *p, uint8x8_t v)
+{
+   uint32_t x = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+   memcpy(p, &x, sizeof(x));
+}
+
+static ALWAYS_INLINE pan_vec
+swap_32(pan_vec v)
+{
+   return vreinterpretq_u8_u32(vrev64q_u32(vreinterpretq_u32_u8(v)));
+}
+
+static ALWAYS_INLINE pan_vec
+swap_64(pan_vec v)
+{
+   return vextq_u8(v, v, 8);
+}
+
+static ALWAYS_INLINE void
+store_block_8(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   /* Pairs are 16-bit */
+   uint16x4x2_t lo = vzip_u16(vreinterpret_u16_u8(load_32(l + 0 * stride)),
+                              vreinterpret_u16_u8(vrev16_u8(load_32(l + 1 * stride))));
+   uint16x4x2_t hi = vzip_u16(vreinterpret_u16_u8(load_32(l + 2 * stride)),
+                              vreinterpret_u16_u8(vrev16_u8(load_32(l + 3 * stride))));
+
+   /* P20 P30' P21 P31' -> P21 P31' P20 P30' */
+   uint32x2_t hi_swapped = vrev64_u32(vreinterpret_u32_u16(hi.val[0]));
+
+   STORE(t, vcombine_u8(vreinterpret_u8_u16(lo.val[0]),
+                        vreinterpret_u8_u32(hi_swapped)));
+}
+
+static ALWAYS_INLINE void
+load_block_8(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   pan_vec v = LOAD(t);
+   uint16x4_t lo = vreinterpret_u16_u8(vget_low_u8(v));
+   uint16x4_t hi = vreinterpret_u16_u32(vrev64_u32(vreinterpret_u32_u8(vget_high_u8(v))));
+
+   /* Gather each row's pair */
+   uint16x4x2_t r01 = vuzp_u16(lo, lo);
+   uint16x4x2_t r23 = vuzp_u16(hi, hi);
+
+   store_32(l + 0 * stride, vreinterpret_u8_u16(r01.val[0]));
+   store_32(l + 1 * stride, vrev16_u8(vreinterpret_u8_u16(r01.val[1])));
+   store_32(l + 2 * stride, vreinterpret_u8_u16(r23.val[0]));
+   store_32(l + 3 * stride, vrev16_u8(vreinterpret_u8_u16(r23.val[1])));
+}
+
+static ALWAYS_INLINE void
+store_block_16(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   /* Pairs are 32-bit */
+   uint32x2x2_t lo = vzip_u32(vreinterpret_u32_u8(vld1_u8(l + 0 * stride)),
+                              vreinterpret_u32_u16(vrev32_u16(vreinterpret_u16_u8(vld1_u8(l + 1 * stride)))));
+   uint32x2x2_t hi = vzip_u32(vreinterpret_u32_u8(vld1_u8(l + 2 * stride)),
+                              vreinterpret_u32_u16(vrev32_u16(vreinterpret_u16_u8(vld1_u8(l + 3 * stride)))));
+
+   vst1q_u32((uint32_t *) (t + 0), vcombine_u32(lo.val[0], lo.val[1]));
+   vst1q_u32((uint32_t *) (t + 16), vcombine_u32(hi.val[1], hi.val[0]));
+}
+
+static ALWAYS_INLINE void
+load_block_16(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   uint32x4_t lo = vreinterpretq_u32_u8(LOAD(t + 0));
+   uint32x4_t hi = vreinterpretq_u32_u8(LOAD(t + 16));
+
+   uint32x2x2_t r01 = vtrn_u32(vget_low_u32(lo), vget_high_u32(lo));
+   uint32x2x2_t r23 = vtrn_u32(vget_high_u32(hi), vget_low_u32(hi));
+
+   vst1_u8(l + 0 * stride, vreinterpret_u8_u32(r01.val[0]));
+   vst1_u8(l + 1 * stride, vreinterpret_u8_u16(vrev32_u16(vreinterpret_u16_u32(r01.val[1]))));
+   vst1_u8(l + 2 * stride, vreinterpret_u8_u32(r23.val[0]));
+   vst1_u8(l + 3 * stride, vreinterpret_u8_u16(vrev32_u16(vreinterpret_u16_u32(r23.val[1]))));
+}
+
+static ALWAYS_INLINE void
+store_block_32(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   /* Pairs are 64-bit */
+   pan_vec r0 = LOAD(l + 0 * stride);
+   pan_vec r1 = swap_32(LOAD(l + 1 * stride));
+   pan_vec r2 = LOAD(l + 2 * stride);
+   pan_vec r3 = swap_32(LOAD(l + 3 * stride));
+
+   STORE(t + 0, vcombine_u8(vget_low_u8(r0), vget_low_u8(r1)));
+   STORE(t + 16, vcombine_u8(vget_high_u8(r0), vget_high_u8(r1)));
+   STORE(t + 32, vcombine_u8(vget_high_u8(r2), vget_high_u8(r3)));
+   STORE(t + 48, vcombine_u8(vget_low_u8(r2), vget_low_u8(r3)));
+}
+
+static ALWAYS_INLINE void
+load_block_32(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   pan_vec q0 = LOAD(t + 0);
+   pan_vec q1 = LOAD(t + 16);
+   pan_vec q2 = LOAD(t + 32);
+   pan_vec q3 = LOAD(t + 48);
+
+   STORE(l + 0 * stride, vcombine_u8(vget_low_u8(q0), vget_low_u8(q1)));
+   STORE(l + 1 * stride, swap_32(vcombine_u8(vget_high_u8(q0), vget_high_u8(q1))));
+   STORE(l + 2 * stride, vcombine_u8(vget_low_u8(q3), vget_low_u8(q2)));
+   STORE(l + 3 * stride, swap_32(vcombine_u8(vget_high_u8(q3), vget_high_u8(q2))));
+}
+
+#endif
+
+#if defined(PAN_TILING_SSE2) || defined(PAN_TILING_NEON)
+
+/* With 64-bit and 128-bit elements, pairs span whole vectors and the swaps
+ * are plain moves, so these are shared */
+
+static ALWAYS_INLINE void
+store_block_64(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   const uint8_t *r0 = l + 0 * stride, *r1 = l + 1 * stride;
+   const uint8_t *r2 = l + 2 * stride, *r3 = l + 3 * stride;
+
+   STORE(t + 0, LOAD(r0));
+   STORE(t + 16, swap_64(LOAD(r1)));
+   STORE(t + 32, LOAD(r0 + 16));
+   STORE(t + 48, swap_64(LOAD(r1 + 16)));
+   STORE(t + 64, LOAD(r2 + 16));
+   STORE(t + 80, swap_64(LOAD(r3 + 16)));
+   STORE(t + 96, LOAD(r2));
+   STORE(t + 112, swap_64(LOAD(r3)));
+}
+
+static ALWAYS_INLINE void
+load_block_64(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   uint8_t *r0 = l + 0 * stride, *r1 = l + 1 * stride;
+   uint8_t *r2 = l + 2 * stride, *r3 = l + 3 * stride;
+
+   STORE(r0, LOAD(t + 0));
+   STORE(r1, swap_64(LOAD(t + 16)));
+   STORE(r0 + 16, LOAD(t + 32));
+   STORE(r1 + 16, swap_64(LOAD(t + 48)));
+   STORE(r2 + 16, LOAD(t + 64));
+   STORE(r3 + 16, swap_64(LOAD(t + 80)));
+   STORE(r2, LOAD(t + 96));
+   STORE(r3, swap_64(LOAD(t + 112)));
+}
+
+/* Element order of a block, as (row, column) of the linear source */
+
+static const uint8_t block_order[16][2] = {
+   { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 },
+   { 0, 2 }, { 0, 3 }, { 1, 3 }, { 1, 2 },
+   { 2, 2 }, { 2, 3 }, { 3, 3 }, { 3, 2 },
+   { 2, 0 }, { 2, 1 }, { 3, 1 }, { 3, 0 },
+};
+
+static ALWAYS_INLINE void
+store_block_128(uint8_t *t, const uint8_t *l, uint32_t stride)
+{
+   for (unsigned i = 0; i < 16; ++i) {
+      STORE(t + (i * 16), LOAD(l + block_order[i][0] * stride +
+                                   block_order[i][1] * 16));
+   }
+}
+
+static ALWAYS_INLINE void
+load_block_128(const uint8_t *t, uint8_t *l, uint32_t stride)
+{
+   for (unsigned i = 0; i < 16; ++i) {
+      STORE(l + block_order[i][0] * stride + block_order[i][1] * 16,
+            LOAD(t + (i * 16)));
+   }
+}
+
+/* Walks a tile-aligned region, calling the block kernel for every 4x4 block.
+ * Tiles are 4x4 blocks (16x16 elements) or, for compressed formats, a single
+ * block. */
+
+#define TILED_ACCESS_SIMD(bpp, op) \
+static void \
+panfrost_##op##_tiled_simd_##bpp(uint8_t *tiled, uint8_t *linear, \
+                                 unsigned x, unsigned y, \
+                                 unsigned w, unsigned h, \
+                                 uint32_t tiled_stride, \
+                                 uint32_t linear_stride, \
+                                 unsigned tile_shift) \
+{ \
+   const unsigned tile_dim = 1 << tile_shift; \
+   const unsigned blocks = tile_dim / 4; \
+   const unsigned tile_size = (tile_dim * tile_dim * bpp) / 8; \
+   const unsigned block_size = (16 * bpp) / 8; \
+ \
+   for (unsigned ty = 0; ty < h; ty += tile_dim) { \
+      uint8_t *tile = tiled + ((y + ty) * tiled_stride) + \
+                      ((x >> tile_shift) * tile_size); \
+      uint8_t *row = linear + (ty * linear_stride); \
+ \
+      for (unsigned tx = 0; tx < w; tx += tile_dim, tile += tile_size) { \
+         for (unsigned by = 0; by < blocks; ++by) { \
+            for (unsigned bx = 0; bx < blocks; ++bx) { \
+               uint8_t *t = tile + (block_index[by][bx] * block_size); \
+               uint8_t *l = row + ((by * 4) * linear_stride) + \
+                            (((tx + bx * 4) * bpp) / 8); \
+ \
+               op##_block_##bpp(t, l, linear_stride); \
+            } \
+         } \
+      } \
+   } \
+}
+
+TILED_ACCESS_SIMD(8, store)
+TILED_ACCESS_SIMD(16, store)
+TILED_ACCESS_SIMD(32, store)
+TILED_ACCESS_SIMD(64, store)
+TILED_ACCESS_SIMD(128, store)
+TILED_ACCESS_SIMD(8, load)
+TILED_ACCESS_SIMD(16, load)
+TILED_ACCESS_SIMD(32, load)
+TILED_ACCESS_SIMD(64, load)
+TILED_ACCESS_SIMD(128, load)
+
+bool
+panfrost_access_tiled_image_simd(void *tiled, void *linear,
+                                 unsigned x, unsigned y,
+                                 unsigned w, unsigned h,
+                                 uint32_t tiled_stride,
+                                 uint32_t linear_stride,
+                                 unsigned bpp, unsigned tile_shift,
+                                 bool is_store)
+{
+#define CASE(n) \
+   case n: \
+      if (is_store) \
+         panfrost_store_tiled_simd_##n(tiled, linear, x, y, w, h, \
+                                       tiled_stride, linear_stride, \
+                                       tile_shift); \
+      else \
+         panfrost_load_tiled_simd_##n(tiled, linear, x, y, w, h, \
+                                      tiled_stride, linear_stride, \
+                                      tile_shift); \
+      return true;
+
+   switch (bpp) {
+   CASE(8)
+   CASE(16)
+   CASE(32)
+   CASE(64)
+   CASE(128)
+   default:
+      return false;
+   }
+
+#undef CASE
+}
+
+#else
+
+bool
+panfrost_access_tiled_image_simd(void *tiled, void *linear,
+                                 unsigned x, unsigned y,
+                                 unsigned w, unsigned h,
+                                 uint32_t tiled_stride,
+                                 uint32_t linear_stride,
+                                 unsigned bpp, unsigned tile_shift,
+                                 bool is_store)
+{
+   return false;
+}
+
+#endif
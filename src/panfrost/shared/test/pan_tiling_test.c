@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* The vectorized full-tile kernels must produce exactly what the scalar path
+ * does, including around the partial tiles at the edges of a misaligned
+ * region. Tile and untile regions of odd sized images both ways and compare
+ * whole buffers, so writes outside the region are caught as well. On CPUs
+ * without vectors both runs take the scalar path. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pan_tiling.h"
+#include "util/u_math.h"
+
+static const enum pipe_format formats[] = {
+        PIPE_FORMAT_R8_UNORM,
+        PIPE_FORMAT_B5G6R5_UNORM,
+        PIPE_FORMAT_R8G8B8_UNORM,
+        PIPE_FORMAT_R8G8B8A8_UNORM,
+        PIPE_FORMAT_R16G16B16A16_FLOAT,
+        PIPE_FORMAT_R32G32B32A32_FLOAT,
+        PIPE_FORMAT_ETC2_RGB8,
+        PIPE_FORMAT_ETC2_RGBA8,
+};
+
+/* Image sizes in pixels */
+static const struct {
+        unsigned w, h;
+} sizes[] = {
+        { 1, 1 },
+        { 15, 17 },
+        { 64, 32 },
+        { 100, 70 },
+        { 257, 33 },
+};
+
+/* Regions in blocks, clamped to the image. ~0 extends to the edge. */
+static const struct {
+        unsigned x, y, w, h;
+} regions[] = {
+        { 0, 0, ~0, ~0 },
+        { 1, 1, ~0, ~0 },
+        { 16, 16, 32, 32 },
+        { 3, 5, 37, 29 },
+        { 17, 3, 33, 47 },
+        { 15, 17, 1, 1 },
+        { 0, 7, ~0, 1 },
+        { 7, 0, 1, ~0 },
+};
+
+struct image {
+        const struct util_format_description *desc;
+        unsigned bytes;
+        uint32_t tiled_stride, linear_stride;
+        size_t tiled_size, linear_size;
+};
+
+static void
+fill_random(uint8_t *data, size_t size)
+{
+        for (size_t i = 0; i < size; ++i)
+                data[i] = rand();
+}
+
+/* Runs one access with the scalar and the vectorized path, each on its own
+ * copy of the same buffers, and returns whether the results match */
+
+static bool
+compare(const struct image *img, enum pipe_format format, bool store,
+        unsigned x, unsigned y, unsigned w, unsigned h)
+{
+        uint8_t *tiled[2], *linear[2];
+        bool ok = true;
+
+        tiled[0] = malloc(img->tiled_size);
+        linear[0] = malloc(img->linear_size);
+        fill_random(tiled[0], img->tiled_size);
+        fill_random(linear[0], img->linear_size);
+
+        tiled[1] = malloc(img->tiled_size);
+        linear[1] = malloc(img->linear_size);
+        memcpy(tiled[1], tiled[0], img->tiled_size);
+        memcpy(linear[1], linear[0], img->linear_size);
+
+        /* w and h are in pixels, x and y in blocks */
+        unsigned pw = w * img->desc->block.width;
+        unsigned ph = h * img->desc->block.height;
+
+        for (unsigned i = 0; i < 2; ++i) {
+                uint8_t *region = linear[i] + y * img->linear_stride +
+                                  x * img->bytes;
+
+                panfrost_tiling_enable_simd(i);
+
+                if (store) {
+                        panfrost_store_tiled_image(tiled[i], region,
+                                                   x, y, pw, ph,
+                                                   img->tiled_stride,
+                                                   img->linear_stride,
+                                                   format);
+                } else {
+                        panfrost_load_tiled_image(region, tiled[i],
+                                                  x, y, pw, ph,
+                                                  img->linear_stride,
+                                                  img->tiled_stride,
+                                                  format);
+                }
+        }
+
+        if (memcmp(tiled[0], tiled[1], img->tiled_size) ||
+            memcmp(linear[0], linear[1], img->linear_size)) {
+                fprintf(stderr, "%s: %s mismatch at %u,%u %ux%u blocks\n",
+                        img->desc->short_name, store ? "store" : "load",
+                        x, y, w, h);
+                ok = false;
+        }
+
+        for (unsigned i = 0; i < 2; ++i) {
+                free(tiled[i]);
+                free(linear[i]);
+        }
+
+        return ok;
+}
+
+int
+main(void)
+{
+        unsigned failures = 0;
+
+        srand(0);
+
+        for (unsigned f = 0; f < ARRAY_SIZE(formats); ++f) {
+                enum pipe_format format = formats[f];
+                struct image img = {
+                        .desc = util_format_description(format),
+                };
+
+                img.bytes = img.desc->block.bits / 8;
+
+                for (unsigned s = 0; s < ARRAY_SIZE(sizes); ++s) {
+                        unsigned bw = DIV_ROUND_UP(sizes[s].w,
+                                                   img.desc->block.width);
+                        unsigned bh = DIV_ROUND_UP(sizes[s].h,
+                                                   img.desc->block.height);
+
+                        /* Tiled images are padded to whole 16x16 tiles of
+                         * blocks */
+                        unsigned tiled_w = ALIGN_POT(bw, 16);
+                        unsigned tiled_h = ALIGN_POT(bh, 16);
+
+                        img.tiled_stride = tiled_w * img.bytes;
+                        img.linear_stride = bw * img.bytes;
+                        img.tiled_size = (size_t) img.tiled_stride * tiled_h;
+                        img.linear_size = (size_t) img.linear_stride * bh;
+
+                        for (unsigned r = 0; r < ARRAY_SIZE(regions); ++r) {
+                                unsigned x = regions[r].x, y = regions[r].y;
+
+                                if (x >= bw || y >= bh)
+                                        continue;
+
+                                unsigned w = MIN2(regions[r].w, bw - x);
+                                unsigned h = MIN2(regions[r].h, bh - y);
+
+                                failures += !compare(&img, format, true,
+                                                     x, y, w, h);
+                                failures += !compare(&img, format, false,
+                                                     x, y, w, h);
+                        }
+                }
+        }
+
+        return failures ? 1 : 0;
+}
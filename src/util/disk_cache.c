@@ -69,8 +69,8 @@ do {                                       \
 } while (0);
 
 struct disk_cache *
-disk_cache_create(const char *gpu_name, const char *driver_id,
-                  uint64_t driver_flags)
+disk_cache_type_create(const char *gpu_name, const char *driver_id,
+                       uint64_t driver_flags, enum disk_cache_type cache_type)
 {
    void *local;
    struct disk_cache *cache = NULL;
@@ -103,6 +103,9 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    goto path_fail;
 #endif
 
+   /* Usable even when the cache directory isn't */
+   disk_cache_load_read_only_dbs(cache);
+
    char *path = disk_cache_generate_cache_dir(local);
    if (!path)
       goto path_fail;
@@ -152,6 +155,11 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
 
    cache->max_size = max_size;
 
+   cache->type = DISK_CACHE_MULTI_FILE;
+   if (cache_type == DISK_CACHE_DATABASE &&
+       disk_cache_db_load_cache_index(local, cache))
+      cache->type = DISK_CACHE_DATABASE;
+
    /* 4 threads were chosen below because just about all modern CPUs currently
     * available that run Mesa have *at least* 4 cores. For these CPUs allowing
     * more threads can result in the queue being processed faster, thus
@@ -209,22 +217,44 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    return cache;
 
  fail:
-   if (cache)
+   if (cache) {
+      disk_cache_destroy_read_only_dbs(cache);
       ralloc_free(cache);
+   }
    ralloc_free(local);
 
    return NULL;
 }
 
+struct disk_cache *
+disk_cache_create(const char *gpu_name, const char *driver_id,
+                  uint64_t driver_flags)
+{
+   enum disk_cache_type cache_type = DISK_CACHE_MULTI_FILE;
+
+   if (env_var_as_boolean("MESA_DISK_CACHE_DATABASE", false))
+      cache_type = DISK_CACHE_DATABASE;
+
+   return disk_cache_type_create(gpu_name, driver_id, driver_flags,
+                                 cache_type);
+}
+
 void
 disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache && !cache->path_init_failed) {
       util_queue_finish(&cache->cache_queue);
       util_queue_destroy(&cache->cache_queue);
+
+      if (cache->type == DISK_CACHE_DATABASE)
+         mesa_cache_db_close(&cache->cache_db);
+
       disk_cache_destroy_mmap(cache);
    }
 
+   if (cache)
+      disk_cache_destroy_read_only_dbs(cache);
+
    ralloc_free(cache);
 }
 
@@ -237,6 +267,11 @@ disk_cache_wait_for_idle(struct disk_cache *cache)
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
+   if (cache->type == DISK_CACHE_DATABASE) {
+      mesa_cache_db_remove_entry(&cache->cache_db, key);
+      return;
+   }
+
    char *filename = disk_cache_get_cache_filename(cache, key);
    if (filename == NULL) {
       return;
@@ -310,6 +345,12 @@ cache_put(void *job, int thread_index)
    char *filename = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   /* The database evicts entries itself */
+   if (dc_job->cache->type == DISK_CACHE_DATABASE) {
+      disk_cache_db_write_item_to_disk(dc_job);
+      return;
+   }
+
    filename = disk_cache_get_cache_filename(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -385,6 +426,16 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return blob;
    }
 
+   for (unsigned i = 0; i < cache->num_read_only_dbs; i++) {
+      void *blob = disk_cache_db_load_item(&cache->read_only_dbs[i], key,
+                                           size);
+      if (blob)
+         return blob;
+   }
+
+   if (cache->type == DISK_CACHE_DATABASE)
+      return disk_cache_db_load_item(&cache->cache_db, key, size);
+
    char *filename = disk_cache_get_cache_filename(cache, key);
    if (filename == NULL)
       return NULL;
@@ -392,6 +443,123 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return disk_cache_load_item(cache, filename, size);
 }
 
+struct disk_cache_get_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   cache_key key;
+
+   /* Set by whoever does the lookup: a cache thread, or the caller of
+    * disk_cache_get_job_finish() if no thread got to it yet.
+    */
+   int claimed;
+
+   /* Held by the caller and by the queue, until the job has gone through
+    * it even if the lookup was done by the caller.
+    */
+   int refcount;
+
+   /* Result of disk_cache_get() */
+   void *data;
+   size_t size;
+};
+
+static void
+cache_get(void *job, int thread_index)
+{
+   struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *) job;
+
+   if (p_atomic_cmpxchg(&dc_job->claimed, 0, 1) != 0)
+      return;
+
+   dc_job->data = disk_cache_get(dc_job->cache, dc_job->key, &dc_job->size);
+}
+
+static void
+cache_get_job_unref(void *job, int thread_index)
+{
+   struct disk_cache_get_job *dc_job = (struct disk_cache_get_job *) job;
+
+   if (p_atomic_dec_zero(&dc_job->refcount)) {
+      util_queue_fence_destroy(&dc_job->fence);
+      free(dc_job);
+   }
+}
+
+struct disk_cache_get_job *
+disk_cache_get_async(struct disk_cache *cache, const cache_key key)
+{
+   struct disk_cache_get_job *dc_job = calloc(1, sizeof(*dc_job));
+   if (!dc_job)
+      return NULL;
+
+   dc_job->cache = cache;
+   memcpy(dc_job->key, key, sizeof(cache_key));
+   dc_job->refcount = 1;
+   util_queue_fence_init(&dc_job->fence);
+
+   /* Without a cache directory there are no threads, and the callbacks
+    * may not expect calls from other threads.
+    */
+   if (cache->path_init_failed || cache->blob_get_cb) {
+      cache_get(dc_job, 0);
+      return dc_job;
+   }
+
+   dc_job->refcount++;
+   util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
+                      cache_get, cache_get_job_unref, 0);
+
+   return dc_job;
+}
+
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, struct disk_cache_get_job **jobs)
+{
+   for (unsigned i = 0; i < num_keys; i++)
+      jobs[i] = disk_cache_get_async(cache, keys[i]);
+}
+
+bool
+disk_cache_get_job_is_done(struct disk_cache_get_job *job)
+{
+   return !job || util_queue_fence_is_signalled(&job->fence);
+}
+
+void *
+disk_cache_get_job_finish(struct disk_cache_get_job *job, size_t *size)
+{
+   void *data;
+
+   if (size)
+      *size = 0;
+
+   if (!job)
+      return NULL;
+
+   /* The cache threads run at the lowest priority, behind compressing puts,
+    * so rather than waiting for one to start the lookup, do it here.
+    */
+   if (p_atomic_cmpxchg(&job->claimed, 0, 1) == 0) {
+      size_t data_size;
+
+      data = disk_cache_get(job->cache, job->key, &data_size);
+      if (data && size)
+         *size = data_size;
+   } else {
+      util_queue_fence_wait(&job->fence);
+
+      data = job->data;
+      if (data && size)
+         *size = job->size;
+   }
+
+   cache_get_job_unref(job, 0);
+   return data;
+}
+
 void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -431,12 +599,19 @@ disk_cache_has_key(struct disk_cache *cache, const cache_key key)
       return cache->blob_get_cb(key, CACHE_KEY_SIZE, &blob, sizeof(uint32_t));
    }
 
-   if (cache->path_init_failed)
-      return false;
+   if (!cache->path_init_failed) {
+      entry = &cache->stored_keys[i * CACHE_KEY_SIZE];
+      if (memcmp(entry, key, CACHE_KEY_SIZE) == 0)
+         return true;
+   }
 
-   entry = &cache->stored_keys[i * CACHE_KEY_SIZE];
+   /* disk_cache_pack() carries the keys over as entries without a blob */
+   for (unsigned j = 0; j < cache->num_read_only_dbs; j++) {
+      if (mesa_cache_db_has_entry(&cache->read_only_dbs[j], key))
+         return true;
+   }
 
-   return memcmp(entry, key, CACHE_KEY_SIZE) == 0;
+   return false;
 }
 
 void
@@ -74,7 +74,15 @@ struct cache_item_metadata {
    uint32_t num_keys;
 };
 
+enum disk_cache_type {
+   /* One file per entry, in a two-level directory tree */
+   DISK_CACHE_MULTI_FILE,
+   /* All entries in one memory-mapped file, see mesa_cache_db.h */
+   DISK_CACHE_DATABASE,
+};
+
 struct disk_cache;
+struct disk_cache_get_job;
 
 static inline char *
 disk_cache_format_hex_id(char *buf, const uint8_t *hex_id, unsigned size)
@@ -174,6 +182,15 @@ struct disk_cache *
 disk_cache_create(const char *gpu_name, const char *timestamp,
                   uint64_t driver_flags);
 
+/**
+ * Like disk_cache_create(), with the layout of the cache on disk chosen by
+ * the caller instead of MESA_DISK_CACHE_DATABASE. A database which can't be
+ * used falls back to one file per entry.
+ */
+struct disk_cache *
+disk_cache_type_create(const char *gpu_name, const char *timestamp,
+                       uint64_t driver_flags, enum disk_cache_type cache_type);
+
 /**
  * Destroy a cache object, (freeing all associated resources).
  */
@@ -222,6 +239,40 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Start retrieving the item stored under the name \key on the cache threads,
+ * so that reading and decompressing it overlaps with the caller's work.
+ *
+ * The result must be collected with disk_cache_get_job_finish() before the
+ * cache is destroyed. NULL may be returned, which
+ * disk_cache_get_job_finish() takes as the item not being found.
+ */
+struct disk_cache_get_job *
+disk_cache_get_async(struct disk_cache *cache, const cache_key key);
+
+/**
+ * Start retrieving the items stored under each of the \num_keys names in
+ * \keys, as with disk_cache_get_async(), storing the jobs in \jobs.
+ */
+void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, struct disk_cache_get_job **jobs);
+
+/**
+ * Test whether disk_cache_get_job_finish() would return without waiting.
+ */
+bool
+disk_cache_get_job_is_done(struct disk_cache_get_job *job);
+
+/**
+ * Wait for a job started by disk_cache_get_async() and free it. A lookup no
+ * cache thread has started yet is done by the caller instead.
+ *
+ * \return What disk_cache_get() would have returned for the key.
+ */
+void *
+disk_cache_get_job_finish(struct disk_cache_get_job *job, size_t *size);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -267,6 +318,13 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
    return NULL;
 }
 
+static inline struct disk_cache *
+disk_cache_type_create(const char *gpu_name, const char *timestamp,
+                       uint64_t driver_flags, enum disk_cache_type cache_type)
+{
+   return NULL;
+}
+
 static inline void
 disk_cache_destroy(struct disk_cache *cache) {
    return;
@@ -292,6 +350,34 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline struct disk_cache_get_job *
+disk_cache_get_async(struct disk_cache *cache, const cache_key key)
+{
+   return NULL;
+}
+
+static inline void
+disk_cache_get_batch(struct disk_cache *cache, const cache_key *keys,
+                     unsigned num_keys, struct disk_cache_get_job **jobs)
+{
+   for (unsigned i = 0; i < num_keys; i++)
+      jobs[i] = NULL;
+}
+
+static inline bool
+disk_cache_get_job_is_done(struct disk_cache_get_job *job)
+{
+   return true;
+}
+
+static inline void *
+disk_cache_get_job_finish(struct disk_cache_get_job *job, size_t *size)
+{
+   if (size)
+      *size = 0;
+   return NULL;
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -142,6 +142,38 @@ deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest)
 # endif
 }
 
+/**
+ * Compresses cache entry into a buffer of at least compress_bound() bytes.
+ * Returns the compressed size, or 0 on failure.
+ */
+static size_t
+compress_bound(size_t in_data_size)
+{
+#ifdef HAVE_ZSTD
+   return ZSTD_compressBound(in_data_size);
+#else
+   return compressBound(in_data_size);
+#endif
+}
+
+static size_t
+deflate_cache_data(const void *in_data, size_t in_data_size,
+                   uint8_t *out_data, size_t out_data_size)
+{
+#ifdef HAVE_ZSTD
+   size_t ret = ZSTD_compress(out_data, out_data_size, in_data, in_data_size,
+                              ZSTD_COMPRESSION_LEVEL);
+   return ZSTD_isError(ret) ? 0 : ret;
+#else
+   uLongf out_size = out_data_size;
+
+   if (compress2(out_data, &out_size, in_data, in_data_size,
+                 Z_BEST_COMPRESSION) != Z_OK)
+      return 0;
+   return out_size;
+#endif
+}
+
 /**
  * Decompresses cache entry, returns true if successful.
  */
@@ -206,8 +238,12 @@ inflate_cache_data(uint8_t *in_data, size_t in_data_size,
 #include "util/debug.h"
 #include "util/disk_cache.h"
 #include "util/disk_cache_os.h"
+#include "util/hash_table.h"
+#include "util/os_file.h"
 #include "util/ralloc.h"
 #include "util/rand_xor.h"
+#include "util/set.h"
+#include "util/u_dynarray.h"
 
 /* Create a directory named 'path' if it does not already exist.
  *
@@ -799,6 +835,451 @@ disk_cache_write_item_to_disk(struct disk_cache_put_job *dc_job,
    free(filename_tmp);
 }
 
+/* Database entries hold the same cache_entry_file_data as files, followed by
+ * the compressed data. The driver keys are part of every key already, and
+ * the item metadata is only useful to tools reading the files.
+ */
+void *
+disk_cache_db_load_item(struct mesa_cache_db *db, const cache_key key,
+                        size_t *size)
+{
+   struct cache_entry_file_data cf_data;
+   uint8_t *uncompressed_data = NULL;
+   size_t blob_size;
+   uint8_t *blob;
+
+   blob = mesa_cache_db_read_entry(db, key, &blob_size);
+   if (!blob)
+      return NULL;
+
+   if (blob_size < sizeof(cf_data))
+      goto fail;
+
+   memcpy(&cf_data, blob, sizeof(cf_data));
+
+   uncompressed_data = malloc(cf_data.uncompressed_size);
+   if (!uncompressed_data)
+      goto fail;
+
+   if (!inflate_cache_data(blob + sizeof(cf_data), blob_size - sizeof(cf_data),
+                           uncompressed_data, cf_data.uncompressed_size))
+      goto fail;
+
+   /* Check the data for corruption */
+   if (cf_data.crc32 != util_hash_crc32(uncompressed_data,
+                                        cf_data.uncompressed_size))
+      goto fail;
+
+   free(blob);
+
+   if (size)
+      *size = cf_data.uncompressed_size;
+
+   return uncompressed_data;
+
+ fail:
+   free(uncompressed_data);
+   free(blob);
+
+   return NULL;
+}
+
+bool
+disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job)
+{
+   struct cache_entry_file_data cf_data;
+   size_t out_size = compress_bound(dc_job->size);
+   bool written = false;
+   uint8_t *blob;
+
+   blob = malloc(sizeof(cf_data) + out_size);
+   if (!blob)
+      return false;
+
+   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
+   cf_data.uncompressed_size = dc_job->size;
+   memcpy(blob, &cf_data, sizeof(cf_data));
+
+   size_t compressed_size = deflate_cache_data(dc_job->data, dc_job->size,
+                                               blob + sizeof(cf_data),
+                                               out_size);
+   if (compressed_size) {
+      written = mesa_cache_db_write_entry(&dc_job->cache->cache_db,
+                                          dc_job->key, blob,
+                                          sizeof(cf_data) + compressed_size);
+   }
+
+   free(blob);
+   return written;
+}
+
+/* The database is a single file in the cache directory, sized after the
+ * maximum size of the cache.
+ */
+bool
+disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache)
+{
+   char *path = ralloc_asprintf(mem_ctx, "%s/mesa_cache.db", cache->path);
+   if (path == NULL)
+      return false;
+
+   return mesa_cache_db_open(&cache->cache_db, path, cache->max_size);
+}
+
+/* MESA_DISK_CACHE_READ_ONLY_DIRS lists directories holding prebuilt caches,
+ * separated by colons, each with a mesa_cache.db file made by
+ * disk_cache_pack() or copied from a cache in database mode.
+ */
+void
+disk_cache_load_read_only_dbs(struct disk_cache *cache)
+{
+   const char *dirs = getenv("MESA_DISK_CACHE_READ_ONLY_DIRS");
+   unsigned max_dbs = 1;
+   char *list, *dir, *save;
+
+   if (!dirs || !*dirs)
+      return;
+
+   for (const char *c = dirs; *c; c++) {
+      if (*c == ':')
+         max_dbs++;
+   }
+
+   cache->read_only_dbs = rzalloc_array(cache, struct mesa_cache_db, max_dbs);
+   list = strdup(dirs);
+   if (!cache->read_only_dbs || !list) {
+      free(list);
+      return;
+   }
+
+   for (dir = strtok_r(list, ":", &save); dir;
+        dir = strtok_r(NULL, ":", &save)) {
+      struct mesa_cache_db *db =
+         &cache->read_only_dbs[cache->num_read_only_dbs];
+      char *path;
+
+      if (asprintf(&path, "%s/mesa_cache.db", dir) == -1)
+         continue;
+
+      if (mesa_cache_db_open_read_only(db, path))
+         cache->num_read_only_dbs++;
+
+      free(path);
+   }
+
+   free(list);
+}
+
+void
+disk_cache_destroy_read_only_dbs(struct disk_cache *cache)
+{
+   for (unsigned i = 0; i < cache->num_read_only_dbs; i++)
+      mesa_cache_db_close(&cache->read_only_dbs[i]);
+
+   cache->num_read_only_dbs = 0;
+}
+
+struct disk_cache_pack_entry {
+   cache_key key;
+   size_t size;
+   uint8_t blob[];
+};
+
+struct disk_cache_pack {
+   void *mem_ctx;
+
+   /* Of the entries, by key */
+   struct set *keys;
+   struct util_dynarray entries;
+
+   bool failed;
+};
+
+static uint32_t
+pack_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, CACHE_KEY_SIZE);
+}
+
+static bool
+pack_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+static int
+pack_cmp_entries(const void *a, const void *b)
+{
+   const struct disk_cache_pack_entry *entry_a =
+      *(const struct disk_cache_pack_entry *const *)a;
+   const struct disk_cache_pack_entry *entry_b =
+      *(const struct disk_cache_pack_entry *const *)b;
+
+   return memcmp(entry_a->key, entry_b->key, CACHE_KEY_SIZE);
+}
+
+static void
+pack_add_entry(void *data, const uint8_t *key, const void *blob, size_t size)
+{
+   struct disk_cache_pack *pack = data;
+   struct disk_cache_pack_entry *entry;
+
+   /* The first directory holding a key wins */
+   if (_mesa_set_search(pack->keys, key))
+      return;
+
+   entry = ralloc_size(pack->mem_ctx, sizeof(*entry) + size);
+   if (!entry) {
+      pack->failed = true;
+      return;
+   }
+
+   memcpy(entry->key, key, CACHE_KEY_SIZE);
+   entry->size = size;
+   if (size)
+      memcpy(entry->blob, blob, size);
+
+   _mesa_set_add(pack->keys, entry->key);
+   util_dynarray_append(&pack->entries, struct disk_cache_pack_entry *, entry);
+}
+
+static bool
+parse_hex_key(const char *hex, cache_key key)
+{
+   for (unsigned i = 0; i < CACHE_KEY_SIZE * 2; i++) {
+      char c = hex[i];
+      unsigned nibble;
+
+      if (c >= '0' && c <= '9')
+         nibble = c - '0';
+      else if (c >= 'a' && c <= 'f')
+         nibble = c - 'a' + 10;
+      else
+         return false;
+
+      if (i % 2)
+         key[i / 2] |= nibble;
+      else
+         key[i / 2] = nibble << 4;
+   }
+
+   return hex[CACHE_KEY_SIZE * 2] == '\0';
+}
+
+/* Adds the entry of a file written by disk_cache_write_item_to_disk(),
+ * without the driver keys and the item metadata, as in a database.
+ */
+static void
+pack_add_file(struct disk_cache_pack *pack, const char *filename,
+              const cache_key key)
+{
+   size_t size;
+   char *data = os_read_file(filename, &size);
+   const char *end = data + size;
+   const char *p = data;
+   uint32_t md_type;
+
+   if (!data)
+      return;
+
+   /* Cache version, then driver id and GPU name */
+   p++;
+   for (unsigned i = 0; i < 2 && p < end; i++) {
+      p = memchr(p, '\0', end - p);
+      if (!p)
+         goto out;
+      p++;
+   }
+
+   /* Pointer size and driver flags */
+   p += sizeof(uint8_t) + sizeof(uint64_t);
+   if (p + sizeof(md_type) > end)
+      goto out;
+
+   memcpy(&md_type, p, sizeof(md_type));
+   p += sizeof(md_type);
+
+   if (md_type == CACHE_ITEM_TYPE_GLSL) {
+      uint32_t num_keys;
+
+      if (p + sizeof(num_keys) > end)
+         goto out;
+
+      memcpy(&num_keys, p, sizeof(num_keys));
+      p += sizeof(num_keys);
+
+      if ((uint64_t)num_keys * sizeof(cache_key) > (uint64_t)(end - p))
+         goto out;
+      p += num_keys * sizeof(cache_key);
+   }
+
+   if (p + sizeof(struct cache_entry_file_data) <= end)
+      pack_add_entry(pack, key, p, end - p);
+
+out:
+   free(data);
+}
+
+/* Walks the two levels of directories of a cache in files */
+static void
+pack_add_files(struct disk_cache_pack *pack, const char *cache_dir)
+{
+   DIR *dir = opendir(cache_dir);
+   struct dirent *dir_ent;
+
+   if (!dir)
+      return;
+
+   while ((dir_ent = readdir(dir)) != NULL) {
+      char hex[CACHE_KEY_SIZE * 2 + 1];
+      struct dirent *file_ent;
+      char *sub_path;
+      DIR *sub_dir;
+
+      if (strlen(dir_ent->d_name) != 2)
+         continue;
+
+      if (asprintf(&sub_path, "%s/%s", cache_dir, dir_ent->d_name) == -1)
+         continue;
+
+      sub_dir = opendir(sub_path);
+      if (!sub_dir) {
+         free(sub_path);
+         continue;
+      }
+
+      while ((file_ent = readdir(sub_dir)) != NULL) {
+         cache_key key;
+         char *filename;
+
+         if (strlen(file_ent->d_name) != CACHE_KEY_SIZE * 2 - 2)
+            continue;
+
+         memcpy(hex, dir_ent->d_name, 2);
+         memcpy(hex + 2, file_ent->d_name, CACHE_KEY_SIZE * 2 - 1);
+         if (!parse_hex_key(hex, key))
+            continue;
+
+         if (asprintf(&filename, "%s/%s", sub_path, file_ent->d_name) == -1)
+            continue;
+
+         pack_add_file(pack, filename, key);
+         free(filename);
+      }
+
+      closedir(sub_dir);
+      free(sub_path);
+   }
+
+   closedir(dir);
+}
+
+/* Adds the keys stored with disk_cache_put_key() as entries without a blob,
+ * for disk_cache_has_key() to find.
+ */
+static void
+pack_add_index_keys(struct disk_cache_pack *pack, const char *cache_dir)
+{
+   static const cache_key zero_key;
+   size_t size;
+   char *path;
+   uint8_t *index;
+
+   if (asprintf(&path, "%s/index", cache_dir) == -1)
+      return;
+
+   index = (uint8_t *) os_read_file(path, &size);
+   free(path);
+   if (!index)
+      return;
+
+   if (size == sizeof(uint64_t) + CACHE_INDEX_MAX_KEYS * CACHE_KEY_SIZE) {
+      const uint8_t *keys = index + sizeof(uint64_t);
+
+      for (unsigned i = 0; i < CACHE_INDEX_MAX_KEYS; i++) {
+         const uint8_t *key = keys + i * CACHE_KEY_SIZE;
+
+         if (memcmp(key, zero_key, CACHE_KEY_SIZE) != 0)
+            pack_add_entry(pack, key, NULL, 0);
+      }
+   }
+
+   free(index);
+}
+
+/* Gathers the entries of caches, in files or in a database, into a read-only
+ * database in out_dir, for MESA_DISK_CACHE_READ_ONLY_DIRS. Returns the
+ * number of entries packed, or -1 on failure.
+ */
+int
+disk_cache_pack(const char *out_dir, const char *const *dirs,
+                unsigned num_dirs)
+{
+   struct disk_cache_pack pack = { 0 };
+   struct disk_cache_pack_entry **entries;
+   struct mesa_cache_db db;
+   unsigned num_entries;
+   uint64_t data_size = 0;
+   int ret = -1;
+   char *path;
+
+   pack.mem_ctx = ralloc_context(NULL);
+   if (!pack.mem_ctx)
+      return -1;
+
+   pack.keys = _mesa_set_create(pack.mem_ctx, pack_key_hash, pack_key_equal);
+   util_dynarray_init(&pack.entries, pack.mem_ctx);
+
+   for (unsigned i = 0; i < num_dirs; i++) {
+      path = ralloc_asprintf(pack.mem_ctx, "%s/mesa_cache.db", dirs[i]);
+      if (path && mesa_cache_db_open_read_only(&db, path)) {
+         mesa_cache_db_foreach_entry(&db, pack_add_entry, &pack);
+         mesa_cache_db_close(&db);
+      }
+
+      pack_add_files(&pack, dirs[i]);
+      pack_add_index_keys(&pack, dirs[i]);
+   }
+
+   if (!pack.keys || pack.failed)
+      goto out;
+
+   /* In key order, so that packing the same entries makes the same file */
+   entries = util_dynarray_begin(&pack.entries);
+   num_entries = util_dynarray_num_elements(&pack.entries,
+                                            struct disk_cache_pack_entry *);
+   qsort(entries, num_entries, sizeof(*entries), pack_cmp_entries);
+
+   for (unsigned i = 0; i < num_entries; i++)
+      data_size += mesa_cache_db_entry_size(entries[i]->size);
+
+   if (mkdir(out_dir, 0755) == -1 && errno != EEXIST)
+      goto out;
+
+   path = ralloc_asprintf(pack.mem_ctx, "%s/mesa_cache.db", out_dir);
+   if (!path || !mesa_cache_db_create_pack(&db, path, num_entries, data_size))
+      goto out;
+
+   ret = num_entries;
+   for (unsigned i = 0; i < num_entries; i++) {
+      if (!mesa_cache_db_write_entry(&db, entries[i]->key, entries[i]->blob,
+                                     entries[i]->size)) {
+         ret = -1;
+         break;
+      }
+   }
+
+   /* Any previous pack stays in place until this one is complete */
+   if (ret != -1 && !mesa_cache_db_finish_pack(&db))
+      ret = -1;
+
+   mesa_cache_db_close(&db);
+
+out:
+   ralloc_free(pack.mem_ctx);
+   return ret;
+}
+
 /* Determine path for cache based on the first defined name as follows:
  *
  *   $MESA_GLSL_CACHE_DIR
@@ -32,6 +32,8 @@
 
 #else
 
+#include "util/mesa_cache_db.h"
+
 /* Number of bits to mask off from a cache key to get an index. */
 #define CACHE_INDEX_KEY_BITS 16
 
@@ -46,6 +48,14 @@ struct disk_cache {
    char *path;
    bool path_init_failed;
 
+   /* How entries are stored, in the database or in files of their own */
+   enum disk_cache_type type;
+   struct mesa_cache_db cache_db;
+
+   /* Prebuilt caches, looked up in order before this one */
+   struct mesa_cache_db *read_only_dbs;
+   unsigned num_read_only_dbs;
+
    /* Thread queue for compressing and writing cache entries to disk */
    struct util_queue cache_queue;
 
@@ -114,6 +124,26 @@ disk_cache_write_item_to_disk(struct disk_cache_put_job *dc_job,
                               struct cache_entry_file_data *cf_data,
                               char *filename);
 
+void *
+disk_cache_db_load_item(struct mesa_cache_db *db, const cache_key key,
+                        size_t *size);
+
+bool
+disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job);
+
+bool
+disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache);
+
+void
+disk_cache_load_read_only_dbs(struct disk_cache *cache);
+
+void
+disk_cache_destroy_read_only_dbs(struct disk_cache *cache);
+
+int
+disk_cache_pack(const char *out_dir, const char *const *dirs,
+                unsigned num_dirs);
+
 bool
 disk_cache_enabled(void);
 
@@ -0,0 +1,940 @@
+/*
+ * Copyright © 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include "util/detect_os.h"
+
+#if !DETECT_OS_WINDOWS
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/disk_cache.h"
+#include "util/mesa_cache_db.h"
+#include "util/u_atomic.h"
+#include "util/u_math.h"
+
+#define MESA_CACHE_DB_MAGIC "MESA_DB"
+#define MESA_CACHE_DB_VERSION 1
+
+/* The file header and the slots are page aligned */
+#define DB_PAGE_SIZE 4096
+
+/* Slot offsets of entries always point past the file header, so these
+ * can't be mistaken for entries.
+ */
+#define DB_SLOT_FREE    0
+#define DB_SLOT_REMOVED 1
+
+/* A process sees a file replaced by another one at most this many times in
+ * a row before giving up, which would take quite a storm of compactions.
+ */
+#define DB_MAX_ATTEMPTS 8
+
+struct mesa_cache_db_file_header {
+   char magic[8];
+   uint32_t version;
+
+   /* Set once the file was replaced by a compacted one */
+   uint32_t stale;
+
+   /* Power of two */
+   uint32_t num_slots;
+
+   /* Slots not free, removed ones included */
+   uint32_t num_used;
+
+   uint64_t data_size;
+
+   /* Bytes of the data area taken by entries */
+   uint64_t data_end;
+};
+
+struct mesa_cache_db_slot {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t size;
+
+   /* Of the entry within the file, written last */
+   uint64_t offset;
+
+   /* In seconds, for compaction to keep the most recently used entries */
+   uint32_t last_access;
+   uint32_t pad;
+};
+
+/* Each entry repeats its key and size, so that a slot being written by
+ * another process can't send a reader to the wrong data.
+ */
+struct mesa_cache_db_entry_header {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t size;
+};
+
+static uint32_t
+db_num_slots(uint64_t data_size)
+{
+   /* Plan on 4K per entry, about the size of a compressed shader */
+   return util_next_power_of_two(CLAMP(data_size / 4096, 1024, 1 << 18));
+}
+
+static uint64_t
+db_slots_offset(void)
+{
+   return align64(sizeof(struct mesa_cache_db_file_header), DB_PAGE_SIZE);
+}
+
+static uint64_t
+db_data_offset(uint32_t num_slots)
+{
+   return db_slots_offset() +
+          align64((uint64_t)num_slots * sizeof(struct mesa_cache_db_slot),
+                  DB_PAGE_SIZE);
+}
+
+static uint64_t
+db_entry_size(uint32_t size)
+{
+   return align64(sizeof(struct mesa_cache_db_entry_header) + size, 8);
+}
+
+static uint32_t
+db_time(void)
+{
+   return (uint32_t)time(NULL);
+}
+
+static bool
+db_pwrite_all(int fd, const void *buf, size_t count, uint64_t offset)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = pwrite(fd, out + done, count - done, offset + done);
+      if (written == -1)
+         return false;
+   }
+   return true;
+}
+
+/* Allocates disk blocks for the start of the file, already sized with
+ * ftruncate(), which is all there is where posix_fallocate() isn't.
+ */
+static bool
+db_reserve(int fd, off_t size)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+   return posix_fallocate(fd, 0, size) == 0;
+#else
+   (void)fd;
+   (void)size;
+   return true;
+#endif
+}
+
+static bool
+db_lock_file(int fd)
+{
+#ifdef HAVE_FLOCK
+   return flock(fd, LOCK_EX) == 0;
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_WRLCK,
+      .l_whence = SEEK_SET
+   };
+   return fcntl(fd, F_SETLKW, &lock) == 0;
+#endif
+}
+
+static void
+db_unlock_file(int fd)
+{
+#ifdef HAVE_FLOCK
+   flock(fd, LOCK_UN);
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_UNLCK,
+      .l_whence = SEEK_SET
+   };
+   fcntl(fd, F_SETLK, &lock);
+#endif
+}
+
+static bool
+db_header_is_valid(int fd)
+{
+   struct mesa_cache_db_file_header header;
+   struct stat sb;
+
+   if (fstat(fd, &sb) == -1 ||
+       pread(fd, &header, sizeof(header), 0) != sizeof(header))
+      return false;
+
+   return memcmp(header.magic, MESA_CACHE_DB_MAGIC, sizeof(header.magic)) == 0 &&
+          header.version == MESA_CACHE_DB_VERSION &&
+          util_is_power_of_two_nonzero(header.num_slots) &&
+          header.num_used <= header.num_slots &&
+          header.data_end <= header.data_size &&
+          (uint64_t)sb.st_size == db_data_offset(header.num_slots) + header.data_size;
+}
+
+/* Whether the path now names another file than the open one */
+static bool
+db_file_replaced(struct mesa_cache_db *db, int fd)
+{
+   struct stat fd_sb, path_sb;
+
+   if (fstat(fd, &fd_sb) == -1 || stat(db->path, &path_sb) == -1)
+      return true;
+
+   return fd_sb.st_dev != path_sb.st_dev || fd_sb.st_ino != path_sb.st_ino;
+}
+
+static bool
+db_map(struct mesa_cache_db *db)
+{
+   struct mesa_cache_db_file_header header;
+   int prot = db->read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+
+   if (pread(db->fd, &header, sizeof(header), 0) != sizeof(header))
+      return false;
+
+   uint64_t file_size = db_data_offset(header.num_slots) + header.data_size;
+   if (file_size > SIZE_MAX)
+      return false;
+
+   void *map = mmap(NULL, file_size, prot, MAP_SHARED, db->fd, 0);
+   if (map == MAP_FAILED)
+      return false;
+
+   db->map = map;
+   db->map_size = file_size;
+   db->header = map;
+   db->slots = (struct mesa_cache_db_slot *)(db->map + db_slots_offset());
+
+   return true;
+}
+
+/* Also closes the file, which releases the lock if held */
+static void
+db_unmap(struct mesa_cache_db *db)
+{
+   if (db->map)
+      munmap(db->map, db->map_size);
+   if (db->fd != -1)
+      close(db->fd);
+
+   db->fd = -1;
+   db->map = NULL;
+   db->map_size = 0;
+   db->header = NULL;
+   db->slots = NULL;
+}
+
+/* Other processes go by the offset of a slot alone, so it is written last
+ * with a release store and read with an acquire load. p_atomic_set() and
+ * p_atomic_read() are plain accesses without USE_GCC_ATOMIC_BUILTINS.
+ */
+static inline uint64_t
+db_slot_offset(const struct mesa_cache_db_slot *slot)
+{
+   return __atomic_load_n(&slot->offset, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+db_slot_set_offset(struct mesa_cache_db_slot *slot, uint64_t offset)
+{
+   __atomic_store_n(&slot->offset, offset, __ATOMIC_RELEASE);
+}
+
+/* Returns the entry of a slot, or NULL if it doesn't hold a valid one for the
+ * key. Lookups pass the key they asked for, as another process may reuse the
+ * slot for a different key once it was found.
+ */
+static const struct mesa_cache_db_entry_header *
+db_slot_entry(struct mesa_cache_db *db, const struct mesa_cache_db_slot *slot,
+              const uint8_t *key)
+{
+   const struct mesa_cache_db_entry_header *entry;
+   uint64_t offset = db_slot_offset(slot);
+   uint32_t size = slot->size;
+
+   if (offset < db_data_offset(db->header->num_slots) ||
+       offset + db_entry_size(size) > db->map_size)
+      return NULL;
+
+   entry = (const struct mesa_cache_db_entry_header *)(db->map + offset);
+   if (entry->size != size ||
+       memcmp(entry->key, key, CACHE_KEY_SIZE) != 0)
+      return NULL;
+
+   return entry;
+}
+
+static uint32_t
+db_key_hash(const uint8_t *key)
+{
+   uint32_t hash;
+
+   /* Keys are SHA-1 hashes already */
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static struct mesa_cache_db_slot *
+db_lookup(struct mesa_cache_db *db, const uint8_t *key)
+{
+   uint32_t mask = db->header->num_slots - 1;
+   uint32_t i = db_key_hash(key) & mask;
+
+   for (uint32_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+      struct mesa_cache_db_slot *slot = &db->slots[i];
+      uint64_t offset = db_slot_offset(slot);
+
+      if (offset == DB_SLOT_FREE)
+         return NULL;
+
+      if (offset != DB_SLOT_REMOVED &&
+          memcmp(slot->key, key, CACHE_KEY_SIZE) == 0)
+         return slot;
+   }
+
+   return NULL;
+}
+
+static struct mesa_cache_db_slot *
+db_free_slot(struct mesa_cache_db *db, const uint8_t *key)
+{
+   uint32_t mask = db->header->num_slots - 1;
+   uint32_t i = db_key_hash(key) & mask;
+
+   for (uint32_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+      struct mesa_cache_db_slot *slot = &db->slots[i];
+
+      if (slot->offset == DB_SLOT_FREE || slot->offset == DB_SLOT_REMOVED)
+         return slot;
+   }
+
+   return NULL;
+}
+
+/* Creates an empty file of the wanted size under a temporary name, and
+ * returns it locked.
+ */
+static int
+db_create_tmp_file(struct mesa_cache_db *db, uint32_t num_slots,
+                   char **tmp_path)
+{
+   struct mesa_cache_db_file_header header = { 0 };
+   uint64_t data_offset = db_data_offset(num_slots);
+   int fd;
+
+   if (asprintf(tmp_path, "%s.XXXXXX", db->path) == -1) {
+      *tmp_path = NULL;
+      return -1;
+   }
+
+#ifdef HAVE_MKOSTEMP
+   fd = mkostemp(*tmp_path, O_CLOEXEC);
+#else
+   fd = mkstemp(*tmp_path);
+#endif
+   if (fd == -1)
+      goto fail;
+
+   memcpy(header.magic, MESA_CACHE_DB_MAGIC, sizeof(header.magic));
+   header.version = MESA_CACHE_DB_VERSION;
+   header.num_slots = num_slots;
+   header.data_size = db->max_size;
+
+   /* The data area stays sparse, as entries get written with pwrite(),
+    * which can fail. The header and the slots are written through the
+    * mapping, so they get their room on the disk reserved up front.
+    */
+   if (ftruncate(fd, data_offset + db->max_size) == -1 ||
+       !db_reserve(fd, data_offset) ||
+       !db_pwrite_all(fd, &header, sizeof(header), 0) ||
+       !db_lock_file(fd)) {
+      close(fd);
+      unlink(*tmp_path);
+      goto fail;
+   }
+
+   return fd;
+
+fail:
+   free(*tmp_path);
+   *tmp_path = NULL;
+   return -1;
+}
+
+static int
+db_cmp_slots_by_access(const void *a, const void *b)
+{
+   const struct mesa_cache_db_slot *slot_a =
+      *(const struct mesa_cache_db_slot *const *)a;
+   const struct mesa_cache_db_slot *slot_b =
+      *(const struct mesa_cache_db_slot *const *)b;
+
+   /* Most recent first */
+   if (slot_a->last_access != slot_b->last_access)
+      return slot_a->last_access < slot_b->last_access ? 1 : -1;
+   return 0;
+}
+
+/* Copies the most recently used entries to the new file, up to half of its
+ * data area and of its slots, so that compactions are far apart, minus the
+ * room needed for the entry about to be written.
+ */
+static void
+db_copy_recent_entries(struct mesa_cache_db *db, struct mesa_cache_db *new_db,
+                       uint64_t reserve)
+{
+   uint32_t num_slots = db->header->num_slots;
+   struct mesa_cache_db_slot **live;
+   uint32_t num_live = 0;
+
+   live = malloc(num_slots * sizeof(*live));
+   if (!live)
+      return;
+
+   for (uint32_t i = 0; i < num_slots; i++) {
+      if (db_slot_entry(db, &db->slots[i], db->slots[i].key))
+         live[num_live++] = &db->slots[i];
+   }
+
+   qsort(live, num_live, sizeof(*live), db_cmp_slots_by_access);
+
+   uint64_t budget = new_db->header->data_size / 2;
+   budget = reserve < budget ? budget - reserve : 0;
+
+   uint64_t data_offset = db_data_offset(new_db->header->num_slots);
+   uint32_t max_entries = new_db->header->num_slots / 2;
+   uint32_t num_used = 0;
+   uint64_t end = 0;
+
+   for (uint32_t i = 0; i < num_live && num_used < max_entries; i++) {
+      const struct mesa_cache_db_entry_header *entry =
+         db_slot_entry(db, live[i], live[i]->key);
+      uint64_t entry_size;
+
+      /* Another process could have reused the slot meanwhile */
+      if (!entry)
+         continue;
+
+      entry_size = db_entry_size(entry->size);
+      if (end + entry_size > budget)
+         continue;
+
+      if (!db_pwrite_all(new_db->fd, entry, sizeof(*entry) + entry->size,
+                         data_offset + end))
+         break;
+
+      struct mesa_cache_db_slot *slot = db_free_slot(new_db, entry->key);
+      memcpy(slot->key, entry->key, CACHE_KEY_SIZE);
+      slot->size = entry->size;
+      slot->last_access = live[i]->last_access;
+      slot->offset = data_offset + end;
+
+      end += entry_size;
+      num_used++;
+   }
+
+   new_db->header->data_end = end;
+   new_db->header->num_used = num_used;
+
+   free(live);
+}
+
+/* Replaces the locked file by a new one of the wanted size, holding the
+ * most recently used entries of the old one if it is mapped. The new file
+ * is returned locked.
+ */
+static bool
+db_replace_file(struct mesa_cache_db *db, uint64_t reserve)
+{
+   struct mesa_cache_db new_db = {
+      .path = db->path,
+      .max_size = db->max_size,
+   };
+   char *tmp_path;
+
+   new_db.fd = db_create_tmp_file(db, db_num_slots(db->max_size), &tmp_path);
+   if (new_db.fd == -1)
+      return false;
+
+   if (!db_map(&new_db))
+      goto fail;
+
+   if (db->header)
+      db_copy_recent_entries(db, &new_db, reserve);
+
+   if (rename(tmp_path, db->path) == -1)
+      goto fail;
+
+   free(tmp_path);
+
+   /* Let other processes know without a syscall. Closing the old file
+    * lets them have its lock, after which they look for the new file.
+    */
+   if (db->header)
+      p_atomic_set(&db->header->stale, 1);
+   db_unmap(db);
+
+   db->fd = new_db.fd;
+   db->map = new_db.map;
+   db->map_size = new_db.map_size;
+   db->header = new_db.header;
+   db->slots = new_db.slots;
+
+   return true;
+
+fail:
+   db_unmap(&new_db);
+   unlink(tmp_path);
+   free(tmp_path);
+   return false;
+}
+
+/* Creates the file when there is none, unless another process beats us
+ * to it.
+ */
+static bool
+db_create_file(struct mesa_cache_db *db)
+{
+   char *tmp_path;
+
+   db->fd = db_create_tmp_file(db, db_num_slots(db->max_size), &tmp_path);
+   if (db->fd == -1)
+      return false;
+
+   /* Unlike rename(), this doesn't replace a file which just appeared */
+   bool created = link(tmp_path, db->path) == 0;
+
+   unlink(tmp_path);
+   free(tmp_path);
+
+   if (!created || !db_map(db)) {
+      db_unmap(db);
+      return false;
+   }
+
+   db_unlock_file(db->fd);
+   return true;
+}
+
+/* Opens and maps the file, creating or replacing it as needed */
+static bool
+db_open_file(struct mesa_cache_db *db)
+{
+   for (unsigned attempt = 0; attempt < DB_MAX_ATTEMPTS; attempt++) {
+      bool mapped;
+
+      db->fd = open(db->path, O_RDWR | O_CLOEXEC);
+      if (db->fd == -1) {
+         if (errno != ENOENT)
+            return false;
+
+         if (db_create_file(db))
+            return true;
+         continue;
+      }
+
+      if (!db_lock_file(db->fd)) {
+         db_unmap(db);
+         return false;
+      }
+
+      if (db_file_replaced(db, db->fd)) {
+         db_unmap(db);
+         continue;
+      }
+
+      /* Files of other versions or sizes get replaced, so processes wanting
+       * different sizes would keep compacting the file on start-up.
+       */
+      if (db_header_is_valid(db->fd)) {
+         mapped = db_map(db);
+         if (mapped && db->header->data_size != db->max_size)
+            mapped = db_replace_file(db, 0);
+      } else {
+         mapped = db_replace_file(db, 0);
+      }
+
+      if (!mapped) {
+         db_unmap(db);
+         return false;
+      }
+
+      db_unlock_file(db->fd);
+      return true;
+   }
+
+   return false;
+}
+
+/* Follows the replacement of the file by another process */
+static bool
+db_refresh(struct mesa_cache_db *db)
+{
+   /* Whoever replaces a read-only file is expected to do so with rename(),
+    * which leaves our mapping of the old one intact.
+    */
+   if (db->read_only ||
+       (db->header && !p_atomic_read(&db->header->stale)))
+      return true;
+
+   db_unmap(db);
+   return db_open_file(db);
+}
+
+/* Locks the file for writing, following replacements which happen before
+ * we get the lock.
+ */
+static bool
+db_lock(struct mesa_cache_db *db)
+{
+   for (unsigned attempt = 0; attempt < DB_MAX_ATTEMPTS; attempt++) {
+      if (!db_refresh(db) || !db_lock_file(db->fd))
+         return false;
+
+      if (!p_atomic_read(&db->header->stale))
+         return true;
+
+      db_unlock_file(db->fd);
+   }
+
+   return false;
+}
+
+bool
+mesa_cache_db_open(struct mesa_cache_db *db, const char *path,
+                   uint64_t max_size)
+{
+   memset(db, 0, sizeof(*db));
+   db->fd = -1;
+   db->max_size = max_size;
+
+   db->path = strdup(path);
+   if (!db->path)
+      return false;
+
+   if (!db_open_file(db)) {
+      free(db->path);
+      return false;
+   }
+
+   simple_mtx_init(&db->mtx, mtx_plain);
+   return true;
+}
+
+bool
+mesa_cache_db_open_read_only(struct mesa_cache_db *db, const char *path)
+{
+   memset(db, 0, sizeof(*db));
+   db->read_only = true;
+
+   db->fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (db->fd == -1)
+      return false;
+
+   if (!db_header_is_valid(db->fd) || !db_map(db)) {
+      db_unmap(db);
+      return false;
+   }
+
+   db->max_size = db->header->data_size;
+   db->path = strdup(path);
+   if (!db->path) {
+      db_unmap(db);
+      return false;
+   }
+
+   simple_mtx_init(&db->mtx, mtx_plain);
+   return true;
+}
+
+/* Enough slots for every entry to be written without a compaction, which
+ * starts once three quarters of the slots are used.
+ */
+static uint32_t
+db_pack_num_slots(uint32_t num_entries)
+{
+   return util_next_power_of_two(MAX2(DIV_ROUND_UP(num_entries, 3) * 4 + 4,
+                                      16));
+}
+
+bool
+mesa_cache_db_create_pack(struct mesa_cache_db *db, const char *path,
+                          uint32_t num_entries, uint64_t data_size)
+{
+   char *tmp_path;
+
+   memset(db, 0, sizeof(*db));
+   db->max_size = data_size;
+   db->pack = true;
+
+   db->path = strdup(path);
+   if (!db->path)
+      return false;
+
+   db->fd = db_create_tmp_file(db, db_pack_num_slots(num_entries), &tmp_path);
+   if (db->fd == -1) {
+      free(db->path);
+      return false;
+   }
+
+   /* Packs get shipped for all users to read */
+   if (fchmod(db->fd, 0644) == -1 || !db_map(db)) {
+      unlink(tmp_path);
+      free(tmp_path);
+      db_unmap(db);
+      free(db->path);
+      return false;
+   }
+
+   /* Entries go to the temporary file until mesa_cache_db_finish_pack() */
+   db->pack_path = db->path;
+   db->path = tmp_path;
+   db_unlock_file(db->fd);
+
+   simple_mtx_init(&db->mtx, mtx_plain);
+   return true;
+}
+
+bool
+mesa_cache_db_finish_pack(struct mesa_cache_db *db)
+{
+   assert(db->pack_path);
+
+   if (fsync(db->fd) == -1 || rename(db->path, db->pack_path) == -1)
+      return false;
+
+   free(db->path);
+   db->path = db->pack_path;
+   db->pack_path = NULL;
+   return true;
+}
+
+uint64_t
+mesa_cache_db_entry_size(size_t size)
+{
+   return db_entry_size(size);
+}
+
+void
+mesa_cache_db_close(struct mesa_cache_db *db)
+{
+   /* A pack that wasn't finished never replaces anything */
+   if (db->pack_path) {
+      unlink(db->path);
+      free(db->pack_path);
+   }
+
+   db_unmap(db);
+   simple_mtx_destroy(&db->mtx);
+   free(db->path);
+}
+
+/* Returns a malloc'ed copy of the blob stored for the key, or NULL */
+void *
+mesa_cache_db_read_entry(struct mesa_cache_db *db, const uint8_t *key,
+                         size_t *size)
+{
+   const struct mesa_cache_db_entry_header *entry;
+   struct mesa_cache_db_slot *slot;
+   void *blob = NULL;
+
+   simple_mtx_lock(&db->mtx);
+
+   if (!db_refresh(db))
+      goto out;
+
+   slot = db_lookup(db, key);
+   if (!slot)
+      goto out;
+
+   entry = db_slot_entry(db, slot, key);
+   if (!entry)
+      goto out;
+
+   /* Unlike the slot, the entry never changes once written */
+   blob = malloc(entry->size);
+   if (!blob)
+      goto out;
+
+   *size = entry->size;
+   memcpy(blob, entry + 1, *size);
+
+   /* Concurrent updates by other processes just lose one of the times */
+   if (!db->read_only)
+      slot->last_access = db_time();
+
+out:
+   simple_mtx_unlock(&db->mtx);
+   return blob;
+}
+
+bool
+mesa_cache_db_has_entry(struct mesa_cache_db *db, const uint8_t *key)
+{
+   struct mesa_cache_db_slot *slot;
+   bool found = false;
+
+   simple_mtx_lock(&db->mtx);
+
+   if (!db_refresh(db))
+      goto out;
+
+   slot = db_lookup(db, key);
+   found = slot && db_slot_entry(db, slot, key);
+
+out:
+   simple_mtx_unlock(&db->mtx);
+   return found;
+}
+
+bool
+mesa_cache_db_write_entry(struct mesa_cache_db *db, const uint8_t *key,
+                          const void *blob, size_t size)
+{
+   struct mesa_cache_db_entry_header entry;
+   struct mesa_cache_db_slot *slot;
+   uint64_t entry_size = db_entry_size(size);
+   uint64_t offset;
+   bool written = false;
+
+   if (db->read_only || size > UINT32_MAX || entry_size > db->max_size)
+      return false;
+
+   simple_mtx_lock(&db->mtx);
+
+   if (!db_lock(db))
+      goto out;
+
+   if (db_lookup(db, key)) {
+      written = true;
+      goto unlock;
+   }
+
+   /* Keep a quarter of the slots free, for short probe sequences */
+   if (db->header->data_end + entry_size > db->header->data_size ||
+       db->header->num_used + 1 > db->header->num_slots / 4 * 3) {
+      if (!db_replace_file(db, entry_size))
+         goto unlock;
+   }
+
+   memcpy(entry.key, key, CACHE_KEY_SIZE);
+   entry.size = size;
+
+   offset = db_data_offset(db->header->num_slots) + db->header->data_end;
+   if (!db_pwrite_all(db->fd, &entry, sizeof(entry), offset) ||
+       !db_pwrite_all(db->fd, blob, size, offset + sizeof(entry)))
+      goto unlock;
+
+   slot = db_free_slot(db, key);
+   if (slot->offset == DB_SLOT_FREE)
+      db->header->num_used++;
+
+   /* Readers in other processes go by the offset, so publish it last */
+   memcpy(slot->key, key, CACHE_KEY_SIZE);
+   slot->size = size;
+   slot->last_access = db->pack ? 0 : db_time();
+   db_slot_set_offset(slot, offset);
+
+   db->header->data_end += entry_size;
+   written = true;
+
+unlock:
+   db_unlock_file(db->fd);
+out:
+   simple_mtx_unlock(&db->mtx);
+   return written;
+}
+
+void
+mesa_cache_db_remove_entry(struct mesa_cache_db *db, const uint8_t *key)
+{
+   struct mesa_cache_db_slot *slot;
+
+   if (db->read_only)
+      return;
+
+   simple_mtx_lock(&db->mtx);
+
+   if (!db_lock(db))
+      goto out;
+
+   /* The data stays until the next compaction */
+   slot = db_lookup(db, key);
+   if (slot)
+      db_slot_set_offset(slot, DB_SLOT_REMOVED);
+
+   db_unlock_file(db->fd);
+out:
+   simple_mtx_unlock(&db->mtx);
+}
+
+void
+mesa_cache_db_foreach_entry(struct mesa_cache_db *db,
+                            mesa_cache_db_entry_cb callback, void *data)
+{
+   simple_mtx_lock(&db->mtx);
+
+   if (!db_refresh(db))
+      goto out;
+
+   for (uint32_t i = 0; i < db->header->num_slots; i++) {
+      const struct mesa_cache_db_entry_header *entry;
+
+      if (db->slots[i].offset == DB_SLOT_FREE ||
+          db->slots[i].offset == DB_SLOT_REMOVED)
+         continue;
+
+      entry = db_slot_entry(db, &db->slots[i], db->slots[i].key);
+      if (entry)
+         callback(data, entry->key, entry + 1, entry->size);
+   }
+
+out:
+   simple_mtx_unlock(&db->mtx);
+}
+
+#endif /* !DETECT_OS_WINDOWS */
+
+#endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,139 @@
+/*
+ * Copyright © 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MESA_CACHE_DB_H
+#define MESA_CACHE_DB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "simple_mtx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A single file key/value store for the disk cache: entries are appended
+ * to a data area, and found through an open addressing hash table at the
+ * start of the same file. The whole file is mapped, so lookups don't need
+ * any syscall. When the data area or the table fills up, the most recently
+ * used entries are copied to a new file, which replaces the old one.
+ *
+ * Several processes may use the same file. Writers serialize on a lock of
+ * the file, readers validate what they find instead.
+ */
+
+struct mesa_cache_db_file_header;
+struct mesa_cache_db_slot;
+
+struct mesa_cache_db {
+   /* Serializes the threads of this process, as the file may be replaced */
+   simple_mtx_t mtx;
+
+   char *path;
+   int fd;
+
+   uint8_t *map;
+   size_t map_size;
+
+   struct mesa_cache_db_file_header *header;
+   struct mesa_cache_db_slot *slots;
+
+   /* Size of the data area wanted, which a file made by a process asking
+    * for a different size gets converted to.
+    */
+   uint64_t max_size;
+
+   /* Prebuilt file, mapped read-only and never locked, compacted nor
+    * written to.
+    */
+   bool read_only;
+
+   /* Made by mesa_cache_db_create_pack(), whose entries get no access time
+    * so that packing the same entries makes the same file.
+    */
+   bool pack;
+
+   /* Where a pack being written goes once finished, path being the
+    * temporary file until then.
+    */
+   char *pack_path;
+};
+
+typedef void (*mesa_cache_db_entry_cb)(void *data, const uint8_t *key,
+                                       const void *blob, size_t size);
+
+bool
+mesa_cache_db_open(struct mesa_cache_db *db, const char *path,
+                   uint64_t max_size);
+
+/* Opens a file made by mesa_cache_db_create_pack(), or a copy of a cache */
+bool
+mesa_cache_db_open_read_only(struct mesa_cache_db *db, const char *path);
+
+/* Creates a temporary file next to the path, with exactly the room for
+ * num_entries entries taking data_size bytes, as counted by
+ * mesa_cache_db_entry_size(). Once the entries are written,
+ * mesa_cache_db_finish_pack() moves it over any file at the path. Closing
+ * the database before that deletes it.
+ */
+bool
+mesa_cache_db_create_pack(struct mesa_cache_db *db, const char *path,
+                          uint32_t num_entries, uint64_t data_size);
+
+bool
+mesa_cache_db_finish_pack(struct mesa_cache_db *db);
+
+/* Bytes of the data area an entry with a blob of that size takes */
+uint64_t
+mesa_cache_db_entry_size(size_t size);
+
+void
+mesa_cache_db_close(struct mesa_cache_db *db);
+
+void *
+mesa_cache_db_read_entry(struct mesa_cache_db *db, const uint8_t *key,
+                         size_t *size);
+
+/* Whether the key has an entry, without reading it */
+bool
+mesa_cache_db_has_entry(struct mesa_cache_db *db, const uint8_t *key);
+
+bool
+mesa_cache_db_write_entry(struct mesa_cache_db *db, const uint8_t *key,
+                          const void *blob, size_t size);
+
+void
+mesa_cache_db_remove_entry(struct mesa_cache_db *db, const uint8_t *key);
+
+/* Calls back with each entry, the blob pointing into the file */
+void
+mesa_cache_db_foreach_entry(struct mesa_cache_db *db,
+                            mesa_cache_db_entry_cb callback, void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESA_CACHE_DB_H */
@@ -31,6 +31,11 @@
 #define SLAB_MAGIC_ALLOCATED 0xcafe4321
 #define SLAB_MAGIC_FREE 0x7ee01234
 
+/* Elements of other pools that a pool collects before taking the parent
+ * mutex to return them.
+ */
+#define SLAB_MAGAZINE_SIZE 32
+
 #ifndef NDEBUG
 #define SET_MAGIC(element, value)   (element)->magic = (value)
 #define CHECK_MAGIC(element, value) assert((element)->magic == (value))
@@ -95,6 +100,31 @@ slab_free_orphaned(struct slab_element_header *elt)
       free(page);
 }
 
+/* Moves the elements in the magazine of the pool to the migrated lists of
+ * their owners, or frees them if their owner was destroyed meanwhile. The
+ * parent mutex must be held.
+ */
+static void
+slab_return_magazine_locked(struct slab_child_pool *pool)
+{
+   while (pool->magazine) {
+      struct slab_element_header *elt = pool->magazine;
+      intptr_t owner_int = p_atomic_read(&elt->owner);
+
+      pool->magazine = elt->next;
+
+      if (!(owner_int & 1)) {
+         struct slab_child_pool *owner = (struct slab_child_pool *)owner_int;
+         elt->next = owner->migrated;
+         p_atomic_set(&owner->migrated, elt);
+      } else {
+         slab_free_orphaned(elt);
+      }
+   }
+
+   pool->num_magazine = 0;
+}
+
 /**
  * Create a parent pool for the allocation of same-sized objects.
  *
@@ -128,6 +158,9 @@ void slab_create_child(struct slab_child_pool *pool,
    pool->pages = NULL;
    pool->free = NULL;
    pool->migrated = NULL;
+   pool->magazine = NULL;
+   pool->num_magazine = 0;
+   memset(&pool->stats, 0, sizeof(pool->stats));
 }
 
 /**
@@ -143,6 +176,8 @@ void slab_destroy_child(struct slab_child_pool *pool)
 
    mtx_lock(&pool->parent->mutex);
 
+   slab_return_magazine_locked(pool);
+
    while (pool->pages) {
       struct slab_page_header *page = pool->pages;
       pool->pages = page->u.next;
@@ -193,6 +228,7 @@ slab_add_new_page(struct slab_child_pool *pool)
 
    page->u.next = pool->pages;
    pool->pages = page;
+   pool->stats.num_pages++;
 
    return true;
 }
@@ -209,12 +245,17 @@ slab_alloc(struct slab_child_pool *pool)
 
    if (!pool->free) {
       /* First, collect elements that belong to us but were freed from a
-       * different child pool.
+       * different child pool. Return the elements of other pools we hold
+       * while we have the lock, but don't take it just for that.
        */
-      mtx_lock(&pool->parent->mutex);
-      pool->free = pool->migrated;
-      pool->migrated = NULL;
-      mtx_unlock(&pool->parent->mutex);
+      if (p_atomic_read(&pool->migrated)) {
+         mtx_lock(&pool->parent->mutex);
+         pool->stats.num_parent_locks++;
+         pool->free = pool->migrated;
+         pool->migrated = NULL;
+         slab_return_magazine_locked(pool);
+         mtx_unlock(&pool->parent->mutex);
+      }
 
       /* Now allocate a new page. */
       if (!pool->free && !slab_add_new_page(pool))
@@ -223,6 +264,7 @@ slab_alloc(struct slab_child_pool *pool)
 
    elt = pool->free;
    pool->free = elt->next;
+   pool->stats.num_allocs++;
 
    CHECK_MAGIC(elt, SLAB_MAGIC_FREE);
    SET_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
@@ -237,7 +279,9 @@ slab_alloc(struct slab_child_pool *pool)
  *
  * Freeing an object in a different child pool from the one where it was
  * allocated is allowed, as long the pool belong to the same parent. No
- * additional locking is required in this case.
+ * additional locking is required in this case. The object is kept in the
+ * magazine of the pool until enough are there to return them to their owners
+ * under one lock.
  */
 void slab_free(struct slab_child_pool *pool, void *ptr)
 {
@@ -247,6 +291,8 @@ void slab_free(struct slab_child_pool *pool, void *ptr)
    CHECK_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
    SET_MAGIC(elt, SLAB_MAGIC_FREE);
 
+   pool->stats.num_frees++;
+
    if (p_atomic_read(&elt->owner) == (intptr_t)pool) {
       /* This is the simple case: The caller guarantees that we can safely
        * access the free list.
@@ -257,8 +303,20 @@ void slab_free(struct slab_child_pool *pool, void *ptr)
    }
 
    /* The slow case: migration or an orphaned page. */
-   if (pool->parent)
-      mtx_lock(&pool->parent->mutex);
+   pool->stats.num_foreign_frees++;
+
+   if (pool->parent) {
+      elt->next = pool->magazine;
+      pool->magazine = elt;
+
+      if (++pool->num_magazine >= SLAB_MAGAZINE_SIZE) {
+         mtx_lock(&pool->parent->mutex);
+         pool->stats.num_parent_locks++;
+         slab_return_magazine_locked(pool);
+         mtx_unlock(&pool->parent->mutex);
+      }
+      return;
+   }
 
    /* Note: we _must_ re-read elt->owner here because the owning child pool
     * may have been destroyed by another thread in the meantime.
@@ -268,13 +326,8 @@ void slab_free(struct slab_child_pool *pool, void *ptr)
    if (!(owner_int & 1)) {
       struct slab_child_pool *owner = (struct slab_child_pool *)owner_int;
       elt->next = owner->migrated;
-      owner->migrated = elt;
-      if (pool->parent)
-         mtx_unlock(&pool->parent->mutex);
+      p_atomic_set(&owner->migrated, elt);
    } else {
-      if (pool->parent)
-         mtx_unlock(&pool->parent->mutex);
-
       slab_free_orphaned(elt);
    }
 }
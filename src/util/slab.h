@@ -33,7 +33,9 @@
  * Allocations obtained from one child pool should usually be freed in the
  * same child pool. Freeing an allocation in a different child pool associated
  * to the same parent is allowed (and requires no locking by the caller), but
- * it is discouraged because it implies a performance penalty.
+ * it is discouraged because it implies a performance penalty. Such frees are
+ * collected in a magazine of the freeing pool, and returned to their owners
+ * a batch at a time under the parent mutex.
  *
  * For convenience and to ease the transition, there is also a set of wrapper
  * functions around a single parent-child pair.
@@ -42,6 +44,8 @@
 #ifndef SLAB_H
 #define SLAB_H
 
+#include <stdint.h>
+
 #include "c11/threads.h"
 
 #ifdef __cplusplus
@@ -51,6 +55,15 @@ extern "C" {
 struct slab_element_header;
 struct slab_page_header;
 
+/* Counted by each child pool, for profiling */
+struct slab_stats {
+   uint64_t num_allocs;
+   uint64_t num_frees;
+   uint64_t num_foreign_frees;  /* of elements owned by another pool */
+   uint64_t num_pages;          /* allocated by this pool */
+   uint64_t num_parent_locks;   /* taken by this pool */
+};
+
 struct slab_parent_pool {
    mtx_t mutex;
    unsigned element_size;
@@ -71,6 +84,14 @@ struct slab_child_pool {
     * This list is protected by the parent mutex.
     */
    struct slab_element_header *migrated;
+
+   /* Elements owned by other pools but freed with this one, waiting to be
+    * moved to their owners' migrated lists.
+    */
+   struct slab_element_header *magazine;
+   unsigned num_magazine;
+
+   struct slab_stats stats;
 };
 
 void slab_create_parent(struct slab_parent_pool *parent,
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Stores, then looks up shader sized entries with the one file per entry
+ * cache and with the database cache. "Cold" lookups go through a freshly
+ * created cache, like the first draws of an application starting up, while
+ * "warm" ones repeat them through the same cache, one at a time and then
+ * all at once with disk_cache_get_batch(). Dropping the page cache between
+ * the store and the cold lookups shows the cost of reading the disk as
+ * well.
+ *
+ * Usage: disk_cache_bench [entries] [cache directory]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/disk_cache.h"
+#include "util/os_time.h"
+#include "util/rand_xor.h"
+
+/* Shader binaries compress a bit, so draw the bytes from a small alphabet */
+static void
+fill_entry(uint8_t *data, size_t size, uint64_t *seed)
+{
+   for (size_t i = 0; i < size; i++)
+      data[i] = rand_xorshift128plus(seed) & 0x3f;
+}
+
+static size_t
+entry_size(unsigned i)
+{
+   return 512 + (i * 2654435761u) % (16 * 1024);
+}
+
+static unsigned
+lookup_all(struct disk_cache *cache, uint8_t (*keys)[20], unsigned count)
+{
+   unsigned hits = 0;
+
+   for (unsigned i = 0; i < count; i++) {
+      size_t size;
+      void *data = disk_cache_get(cache, keys[i], &size);
+
+      if (data && size == entry_size(i))
+         hits++;
+      free(data);
+   }
+
+   return hits;
+}
+
+static unsigned
+lookup_batch(struct disk_cache *cache, uint8_t (*keys)[20], unsigned count)
+{
+   struct disk_cache_get_job **jobs = malloc(count * sizeof(*jobs));
+   unsigned hits = 0;
+
+   disk_cache_get_batch(cache, (const cache_key *)keys, count, jobs);
+
+   for (unsigned i = 0; i < count; i++) {
+      size_t size;
+      void *data = disk_cache_get_job_finish(jobs[i], &size);
+
+      if (data && size == entry_size(i))
+         hits++;
+      free(data);
+   }
+
+   free(jobs);
+   return hits;
+}
+
+static void
+bench(enum disk_cache_type type, const char *driver_id,
+      uint8_t (*keys)[20], unsigned count)
+{
+   uint64_t seed[2];
+   struct disk_cache *cache;
+   uint8_t *data = malloc(entry_size(0) + 16 * 1024);
+   int64_t start;
+   double put, cold, warm, batch;
+   unsigned hits;
+
+   s_rand_xorshift128plus(seed, true);
+
+   cache = disk_cache_type_create("disk_cache_bench", driver_id, 0, type);
+   if (!cache) {
+      fprintf(stderr, "failed to create the cache\n");
+      exit(1);
+   }
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < count; i++) {
+      fill_entry(data, entry_size(i), seed);
+      disk_cache_compute_key(cache, data, entry_size(i), keys[i]);
+      disk_cache_put(cache, keys[i], data, entry_size(i), NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+   put = (os_time_get_nano() - start) / 1e9;
+
+   disk_cache_destroy(cache);
+
+   start = os_time_get_nano();
+   cache = disk_cache_type_create("disk_cache_bench", driver_id, 0, type);
+   hits = lookup_all(cache, keys, count);
+   cold = (os_time_get_nano() - start) / 1e9;
+
+   start = os_time_get_nano();
+   lookup_all(cache, keys, count);
+   warm = (os_time_get_nano() - start) / 1e9;
+
+   start = os_time_get_nano();
+   if (lookup_batch(cache, keys, count) != hits)
+      fprintf(stderr, "batched lookups found other entries\n");
+   batch = (os_time_get_nano() - start) / 1e9;
+
+   disk_cache_destroy(cache);
+   free(data);
+
+   printf("%-10s %10.0f %10.0f %10.0f %10.0f %7u/%u\n",
+          type == DISK_CACHE_DATABASE ? "database" : "multi-file",
+          count / put, count / cold, count / warm, count / batch, hits, count);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned count = argc > 1 ? atoi(argv[1]) : 4096;
+   const char *dir = argc > 2 ? argv[2] : "./disk-cache-bench-tmp";
+   uint8_t (*keys)[20] = malloc(count * sizeof(*keys));
+
+   if (!count || !keys) {
+      fprintf(stderr, "usage: %s [entries] [cache directory]\n", argv[0]);
+      return 1;
+   }
+
+   setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+   setenv("MESA_GLSL_CACHE_DIR", dir, 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "4G", 1);
+
+   printf("%-10s %10s %10s %10s %10s %9s\n", "cache", "put/s", "cold get/s",
+          "warm get/s", "batch/s", "hits");
+
+   bench(DISK_CACHE_MULTI_FILE, "multi_file", keys, count);
+   bench(DISK_CACHE_DATABASE, "database", keys, count);
+
+   free(keys);
+
+   return 0;
+}
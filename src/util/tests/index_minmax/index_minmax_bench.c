@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Throughput of index buffer min/max scanning, plain C against the
+ * vectorized path, for each index size with and without primitive restart.
+ *
+ * Usage: index_minmax_bench [indices] [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/os_time.h"
+#include "util/u_index_minmax.h"
+
+typedef void (*minmax_func)(const void *, unsigned, unsigned, bool, unsigned,
+                            unsigned *, unsigned *);
+
+static double
+bench(minmax_func func, const void *indices, unsigned index_size,
+      unsigned count, bool restart, unsigned iterations, unsigned *checksum)
+{
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < iterations; ++i) {
+      unsigned min, max;
+      func(indices, index_size, count, restart, ~0u >> (32 - index_size * 8),
+           &min, &max);
+      *checksum += min ^ max;
+   }
+
+   int64_t elapsed = os_time_get_nano() - start;
+   double bytes = (double) count * index_size * iterations;
+
+   return bytes / (elapsed / 1e9) / (1024 * 1024);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned count = argc > 1 ? atoi(argv[1]) : (1 << 20);
+   unsigned iterations = argc > 2 ? atoi(argv[2]) : 200;
+   uint32_t *indices = malloc((size_t) count * 4);
+   unsigned checksum = 0, ref_checksum = 0;
+
+   if (!count || !iterations || !indices) {
+      fprintf(stderr, "usage: %s [indices] [iterations]\n", argv[0]);
+      return 1;
+   }
+
+   printf("%-6s %-8s %12s %12s\n", "size", "restart", "scalar", "simd");
+
+   for (unsigned size = 1; size <= 4; size *= 2) {
+      /* Random bytes, so restart indices turn up now and then */
+      for (unsigned i = 0; i < count * size; ++i)
+         ((uint8_t *) indices)[i] = rand();
+
+      for (unsigned restart = 0; restart <= 1; ++restart) {
+         double scalar = bench(util_index_minmax_scalar, indices, size, count,
+                               restart, iterations, &ref_checksum);
+         double simd = bench(util_index_minmax, indices, size, count,
+                             restart, iterations, &checksum);
+
+         printf("%-6u %-8s %7.0f MB/s %7.0f MB/s\n", size * 8,
+                restart ? "yes" : "no", scalar, simd);
+      }
+   }
+
+   free(indices);
+
+   if (checksum != ref_checksum) {
+      fprintf(stderr, "results differ\n");
+      return 1;
+   }
+
+   return 0;
+}
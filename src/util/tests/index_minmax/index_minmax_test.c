@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util/u_index_minmax.h"
+
+#define MAX_COUNT 300
+
+static void
+check(const void *indices, unsigned index_size, unsigned count,
+      bool restart, unsigned restart_index)
+{
+   unsigned min, max, ref_min, ref_max;
+
+   util_index_minmax(indices, index_size, count, restart, restart_index,
+                     &min, &max);
+   util_index_minmax_scalar(indices, index_size, count, restart,
+                            restart_index, &ref_min, &ref_max);
+
+   assert(min == ref_min);
+   assert(max == ref_max);
+}
+
+static void
+fill(void *indices, unsigned index_size, unsigned count,
+     unsigned restart_index, unsigned range)
+{
+   for (unsigned i = 0; i < count; ++i) {
+      /* Sprinkle restart indices among values of limited range */
+      unsigned v = ((unsigned) rand() << 16) ^ rand();
+
+      if ((rand() % 8) == 0)
+         v = restart_index;
+      else
+         v %= range;
+
+      if (index_size == 1)
+         ((uint8_t *) indices)[i] = v;
+      else if (index_size == 2)
+         ((uint16_t *) indices)[i] = v;
+      else
+         ((uint32_t *) indices)[i] = v;
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   static const unsigned sizes[] = { 1, 2, 4 };
+   uint32_t storage[MAX_COUNT + 1];
+
+   for (unsigned s = 0; s < 3; ++s) {
+      unsigned size = sizes[s];
+      unsigned type_max = size == 4 ? UINT32_MAX : (1u << (size * 8)) - 1;
+      unsigned restarts[] = { type_max, 0, type_max / 2, UINT32_MAX };
+
+      for (unsigned r = 0; r < 4; ++r) {
+         for (unsigned count = 0; count <= MAX_COUNT; ++count) {
+            /* Unaligned starts, and ranges that do and don't reach the
+             * top of the type so the biasing gets exercised */
+            uint8_t *indices = (uint8_t *) storage + size * (count % 3);
+            unsigned range = (count & 1) ? type_max : 1000;
+
+            fill(indices, size, count, restarts[r], range);
+            check(indices, size, count, true, restarts[r]);
+            check(indices, size, count, false, restarts[r]);
+         }
+      }
+
+      /* Nothing but restart indices */
+      unsigned min, max;
+      for (unsigned i = 0; i < MAX_COUNT * size; ++i)
+         ((uint8_t *) storage)[i] = 0xff;
+
+      util_index_minmax(storage, size, MAX_COUNT, true, type_max, &min, &max);
+      assert(min == type_max && max == 0);
+   }
+
+   return 0;
+}
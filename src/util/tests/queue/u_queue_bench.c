@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Jobs per second through util_queue against the number of threads, with
+ * and without work stealing. "flat" adds empty jobs from one thread and
+ * waits for them with util_queue_finish(), "tree" runs a job fanning out
+ * into child jobs and joining on them, which only work stealing queues
+ * spread over their threads.
+ *
+ * Usage: u_queue_bench [jobs] [max threads]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_queue.h"
+
+struct tree_job {
+   struct util_queue *queue;
+   struct util_queue_fence fence;
+   unsigned depth;
+};
+
+static void
+empty_execute(void *data, int thread_index)
+{
+}
+
+static void
+tree_execute(void *data, int thread_index)
+{
+   struct tree_job *job = data;
+   struct tree_job children[2];
+
+   if (!job->depth)
+      return;
+
+   for (unsigned i = 0; i < 2; i++) {
+      children[i].queue = job->queue;
+      children[i].depth = job->depth - 1;
+      util_queue_fence_init(&children[i].fence);
+      util_queue_add_child_job(job->queue, thread_index, &children[i],
+                               &children[i].fence, tree_execute, NULL, 0);
+   }
+
+   for (unsigned i = 0; i < 2; i++) {
+      util_queue_join(job->queue, thread_index, &children[i].fence);
+      util_queue_fence_destroy(&children[i].fence);
+   }
+}
+
+static double
+bench_flat(unsigned num_threads, unsigned flags, unsigned num_jobs)
+{
+   struct util_queue queue;
+   struct util_queue_fence *fences = malloc(num_jobs * sizeof(*fences));
+
+   if (!util_queue_init(&queue, "bench", 64, num_threads,
+                        flags | UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      exit(1);
+
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_fence_init(&fences[i]);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_add_job(&queue, &queue, &fences[i], empty_execute, NULL, 0);
+   util_queue_finish(&queue);
+
+   int64_t elapsed = os_time_get_nano() - start;
+
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_fence_destroy(&fences[i]);
+
+   util_queue_destroy(&queue);
+   free(fences);
+
+   return num_jobs / (elapsed / 1e9);
+}
+
+static double
+bench_tree(unsigned num_threads, unsigned flags, unsigned num_jobs)
+{
+   struct util_queue queue;
+   struct tree_job root = { .queue = &queue };
+
+   /* A full binary tree of at least num_jobs jobs */
+   while ((2u << root.depth) - 1 < num_jobs)
+      root.depth++;
+
+   if (!util_queue_init(&queue, "bench", 64, num_threads, flags))
+      exit(1);
+
+   int64_t start = os_time_get_nano();
+
+   util_queue_fence_init(&root.fence);
+   util_queue_add_job(&queue, &root, &root.fence, tree_execute, NULL, 0);
+   util_queue_fence_wait(&root.fence);
+   util_queue_fence_destroy(&root.fence);
+
+   int64_t elapsed = os_time_get_nano() - start;
+
+   util_queue_destroy(&queue);
+
+   return ((2u << root.depth) - 1) / (elapsed / 1e9);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_jobs = argc > 1 ? atoi(argv[1]) : (1 << 20);
+   unsigned max_threads;
+
+   util_cpu_detect();
+   max_threads = argc > 2 ? atoi(argv[2]) : util_cpu_caps.nr_cpus;
+
+   if (!num_jobs || !max_threads) {
+      fprintf(stderr, "usage: %s [jobs] [max threads]\n", argv[0]);
+      return 1;
+   }
+
+   printf("%-8s %14s %14s %14s %14s\n", "threads",
+          "flat", "flat stealing", "tree", "tree stealing");
+
+   for (unsigned t = 1;; t = MIN2(t * 2, max_threads)) {
+      printf("%-8u %12.2fM %12.2fM %12.2fM %12.2fM\n", t,
+             bench_flat(t, 0, num_jobs) / 1e6,
+             bench_flat(t, UTIL_QUEUE_INIT_WORK_STEALING, num_jobs) / 1e6,
+             bench_tree(t, 0, num_jobs) / 1e6,
+             bench_tree(t, UTIL_QUEUE_INIT_WORK_STEALING, num_jobs) / 1e6);
+
+      if (t == max_threads)
+         break;
+   }
+
+   return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util/u_queue.h"
+
+#define NUM_JOBS 2000
+
+struct job {
+   struct util_queue_fence fence;
+   unsigned runs;
+   unsigned cleanups;
+};
+
+struct tree_job {
+   struct util_queue *queue;
+   struct util_queue_fence fence;
+   unsigned depth;
+   unsigned *leaves;
+};
+
+static void
+job_execute(void *data, int thread_index)
+{
+   struct job *job = data;
+   job->runs++;
+}
+
+static void
+job_cleanup(void *data, int thread_index)
+{
+   struct job *job = data;
+   job->cleanups++;
+}
+
+/* Fans out into two children down to a depth, joining on them */
+static void
+tree_execute(void *data, int thread_index)
+{
+   struct tree_job *job = data;
+   struct tree_job children[2];
+
+   if (!job->depth) {
+      p_atomic_inc(job->leaves);
+      return;
+   }
+
+   for (unsigned i = 0; i < 2; i++) {
+      children[i].queue = job->queue;
+      children[i].depth = job->depth - 1;
+      children[i].leaves = job->leaves;
+      util_queue_fence_init(&children[i].fence);
+      util_queue_add_child_job(job->queue, thread_index, &children[i],
+                               &children[i].fence, tree_execute, NULL, 0);
+   }
+
+   for (unsigned i = 0; i < 2; i++) {
+      util_queue_join(job->queue, thread_index, &children[i].fence);
+      util_queue_fence_destroy(&children[i].fence);
+   }
+}
+
+static void
+test_jobs(unsigned num_threads, unsigned flags)
+{
+   struct util_queue queue;
+   struct job *jobs = calloc(NUM_JOBS, sizeof(*jobs));
+
+   assert(util_queue_init(&queue, "test", 8, num_threads, flags));
+
+   for (unsigned i = 0; i < NUM_JOBS; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, job_execute,
+                         job_cleanup, 0);
+   }
+
+   /* Every job runs once, whether waited for, dropped or finished */
+   for (unsigned i = 0; i < NUM_JOBS / 4; i++)
+      util_queue_fence_wait(&jobs[i].fence);
+   for (unsigned i = NUM_JOBS / 4; i < NUM_JOBS / 2; i++)
+      util_queue_drop_job(&queue, &jobs[i].fence);
+   util_queue_finish(&queue);
+
+   for (unsigned i = 0; i < NUM_JOBS; i++) {
+      assert(util_queue_fence_is_signalled(&jobs[i].fence));
+      assert(jobs[i].runs <= 1 && jobs[i].cleanups == 1);
+      assert(jobs[i].runs == 1 || i >= NUM_JOBS / 4);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+
+   /* Threads going away and coming back lose nothing */
+   util_queue_adjust_num_threads(&queue, 1);
+   for (unsigned i = 0; i < NUM_JOBS; i++) {
+      jobs[i].runs = 0;
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, job_execute,
+                         NULL, 0);
+      if (i == NUM_JOBS / 2)
+         util_queue_adjust_num_threads(&queue, num_threads);
+   }
+   util_queue_finish(&queue);
+
+   for (unsigned i = 0; i < NUM_JOBS; i++) {
+      assert(jobs[i].runs == 1);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+
+   util_queue_destroy(&queue);
+   free(jobs);
+}
+
+static void
+test_tree(unsigned num_threads, unsigned flags)
+{
+   struct util_queue queue;
+   unsigned leaves = 0;
+   struct tree_job root = {
+      .queue = &queue,
+      .depth = 12,
+      .leaves = &leaves,
+   };
+
+   assert(util_queue_init(&queue, "test", 8, num_threads, flags));
+
+   util_queue_fence_init(&root.fence);
+   util_queue_add_job(&queue, &root, &root.fence, tree_execute, NULL, 0);
+   util_queue_fence_wait(&root.fence);
+   util_queue_fence_destroy(&root.fence);
+
+   assert(leaves == 1 << root.depth);
+
+   util_queue_destroy(&queue);
+}
+
+int
+main(int argc, char **argv)
+{
+   static const unsigned flags[] = { 0, UTIL_QUEUE_INIT_WORK_STEALING };
+
+   for (unsigned f = 0; f < 2; f++) {
+      for (unsigned num_threads = 1; num_threads <= 4; num_threads *= 2) {
+         test_jobs(num_threads, flags[f]);
+         test_jobs(num_threads, flags[f] | UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+         test_tree(num_threads, flags[f]);
+      }
+   }
+
+   return 0;
+}
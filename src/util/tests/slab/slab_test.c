@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "c11/threads.h"
+#include "util/slab.h"
+
+#define NUM_ITEMS 16
+#define NUM_ELEMENTS (NUM_ITEMS * 64)
+#define NUM_ROUNDS 100
+
+struct thread_data {
+   struct slab_child_pool pool;
+   void *elements[NUM_ELEMENTS];
+   struct thread_data *other;
+};
+
+static void
+test_foreign_frees(void)
+{
+   struct slab_parent_pool parent;
+   struct slab_child_pool a, b;
+   void *elements[NUM_ELEMENTS];
+
+   slab_create_parent(&parent, 24, NUM_ITEMS);
+   slab_create_child(&a, &parent);
+   slab_create_child(&b, &parent);
+
+   for (unsigned i = 0; i < NUM_ELEMENTS; i++)
+      elements[i] = slab_alloc(&a);
+   assert(a.stats.num_allocs == NUM_ELEMENTS);
+   assert(a.stats.num_pages == NUM_ELEMENTS / NUM_ITEMS);
+
+   /* Frees through b go back to a in batches */
+   for (unsigned i = 0; i < NUM_ELEMENTS; i++)
+      slab_free(&b, elements[i]);
+   assert(b.stats.num_frees == NUM_ELEMENTS);
+   assert(b.stats.num_foreign_frees == NUM_ELEMENTS);
+   assert(b.stats.num_parent_locks < NUM_ELEMENTS / 8);
+
+   /* ... where they are allocated again without new pages */
+   for (unsigned i = 0; i < NUM_ELEMENTS; i++)
+      elements[i] = slab_alloc(&a);
+   assert(a.stats.num_pages == NUM_ELEMENTS / NUM_ITEMS);
+
+   /* Elements waiting in b's magazine when a goes away are freed with b */
+   for (unsigned i = 0; i < NUM_ELEMENTS / 2; i++)
+      slab_free(&b, elements[i]);
+   slab_destroy_child(&a);
+   for (unsigned i = NUM_ELEMENTS / 2; i < NUM_ELEMENTS; i++)
+      slab_free(&b, elements[i]);
+   slab_destroy_child(&b);
+
+   slab_destroy_parent(&parent);
+}
+
+static int
+thread_alloc(void *data)
+{
+   struct thread_data *thread = data;
+
+   for (unsigned i = 0; i < NUM_ELEMENTS; i++) {
+      unsigned *element = slab_alloc(&thread->pool);
+      *element = i;
+      thread->elements[i] = element;
+   }
+   return 0;
+}
+
+/* Frees the other thread's elements while allocating and freeing its own */
+static int
+thread_swap(void *data)
+{
+   struct thread_data *thread = data;
+
+   for (unsigned i = 0; i < NUM_ELEMENTS; i++) {
+      unsigned *element = thread->other->elements[i];
+      assert(*element == i);
+      slab_free(&thread->pool, element);
+
+      element = slab_alloc(&thread->pool);
+      *element = ~i;
+      slab_free(&thread->pool, element);
+   }
+   return 0;
+}
+
+static void
+run_threads(struct thread_data *threads, thrd_start_t func)
+{
+   thrd_t thrds[2];
+
+   for (unsigned i = 0; i < 2; i++)
+      thrd_create(&thrds[i], func, &threads[i]);
+   for (unsigned i = 0; i < 2; i++)
+      thrd_join(thrds[i], NULL);
+}
+
+static void
+test_threads(void)
+{
+   struct slab_parent_pool parent;
+   struct thread_data threads[2];
+
+   slab_create_parent(&parent, sizeof(unsigned), NUM_ITEMS);
+
+   for (unsigned i = 0; i < 2; i++) {
+      slab_create_child(&threads[i].pool, &parent);
+      threads[i].other = &threads[!i];
+   }
+
+   for (unsigned r = 0; r < NUM_ROUNDS; r++) {
+      run_threads(threads, thread_alloc);
+      run_threads(threads, thread_swap);
+   }
+
+   /* Elements go round between the pools rather than piling up */
+   for (unsigned i = 0; i < 2; i++) {
+      assert(threads[i].pool.stats.num_pages <= 4 * NUM_ELEMENTS / NUM_ITEMS);
+      slab_destroy_child(&threads[i].pool);
+   }
+
+   slab_destroy_parent(&parent);
+}
+
+int
+main(int argc, char **argv)
+{
+   test_foreign_frees();
+   test_threads();
+
+   return 0;
+}
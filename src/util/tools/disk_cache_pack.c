@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Packs shader caches into a read-only cache for
+ * MESA_DISK_CACHE_READ_ONLY_DIRS, either from existing cache directories,
+ * or from the one a command fills when run with an empty cache.
+ *
+ * Usage: disk_cache_pack OUTPUT_DIR CACHE_DIR...
+ *        disk_cache_pack OUTPUT_DIR -- COMMAND [ARGS...]
+ */
+
+#include <errno.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "util/disk_cache.h"
+#include "util/disk_cache_os.h"
+
+static int
+remove_entry(const char *path, const struct stat *sb, int typeflag,
+             struct FTW *ftwbuf)
+{
+   return remove(path);
+}
+
+/* Runs the command with a cache of its own, which is returned */
+static char *
+capture(char **argv)
+{
+   char tmpl[] = "/tmp/disk_cache_pack.XXXXXX";
+   char *dir = mkdtemp(tmpl);
+   int status;
+   pid_t pid;
+
+   if (!dir) {
+      fprintf(stderr, "Failed to create a cache directory: %s\n",
+              strerror(errno));
+      return NULL;
+   }
+
+   pid = fork();
+   if (pid == 0) {
+      /* Everything the command compiles must end up in the cache */
+      setenv("MESA_GLSL_CACHE_DIR", dir, 1);
+      setenv("MESA_GLSL_CACHE_DISABLE", "false", 1);
+      unsetenv("MESA_DISK_CACHE_READ_ONLY_DIRS");
+
+      execvp(argv[0], argv);
+      fprintf(stderr, "Failed to run %s: %s\n", argv[0], strerror(errno));
+      _exit(127);
+   }
+
+   if (pid == -1 || waitpid(pid, &status, 0) == -1) {
+      nftw(dir, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+      return NULL;
+   }
+
+   if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      fprintf(stderr, "%s failed, packing what it cached anyway\n", argv[0]);
+
+   return strdup(dir);
+}
+
+int
+main(int argc, char **argv)
+{
+   const char *out_dir = argv[1];
+   char *capture_dir = NULL;
+   int ret;
+
+   if (argc < 3 || (strcmp(argv[2], "--") == 0 && argc < 4)) {
+      fprintf(stderr, "Usage: %s OUTPUT_DIR CACHE_DIR...\n"
+                      "       %s OUTPUT_DIR -- COMMAND [ARGS...]\n",
+              argv[0], argv[0]);
+      return 1;
+   }
+
+   if (strcmp(argv[2], "--") == 0) {
+      capture_dir = capture(argv + 3);
+      if (!capture_dir)
+         return 1;
+
+      char *cache_dir;
+      if (asprintf(&cache_dir, "%s/" CACHE_DIR_NAME, capture_dir) == -1)
+         return 1;
+
+      ret = disk_cache_pack(out_dir, (const char *const *)&cache_dir, 1);
+
+      free(cache_dir);
+      nftw(capture_dir, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+      free(capture_dir);
+   } else {
+      ret = disk_cache_pack(out_dir, (const char *const *)argv + 2,
+                            argc - 2);
+   }
+
+   if (ret < 0) {
+      fprintf(stderr, "Failed to pack the cache into %s\n", out_dir);
+      return 1;
+   }
+
+   printf("Packed %d entries into %s/mesa_cache.db\n", ret, out_dir);
+   return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Index buffer min/max scanning. Drivers that need the index range of a draw
+ * and can't get it from the GPU scan the mapped index buffer, which for large
+ * meshes dominates the CPU cost of the draw. The bulk of the scan is done 16
+ * bytes at a time with SSE2 or NEON where the target has them, with primitive
+ * restart handled by replacing restart indices with the identity of each
+ * reduction (all ones for the minimum, zero for the maximum) rather than by
+ * branching. The remainder goes through the plain C loop.
+ */
+
+#include <stdint.h>
+
+#include "util/u_index_minmax.h"
+#include "util/macros.h"
+
+#if defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(_M_X64)
+#define UTIL_INDEX_MINMAX_SSE2
+#include <emmintrin.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#define UTIL_INDEX_MINMAX_NEON
+#include <arm_neon.h>
+#endif
+
+#define INDEX_MINMAX_SCALAR(type) \
+static void \
+index_minmax_##type(const type *indices, unsigned count, \
+                    bool restart, type restart_index, \
+                    type *out_min, type *out_max) \
+{ \
+   type min = *out_min, max = *out_max; \
+   if (restart) { \
+      for (unsigned i = 0; i < count; i++) { \
+         if (indices[i] != restart_index) { \
+            if (indices[i] > max) max = indices[i]; \
+            if (indices[i] < min) min = indices[i]; \
+         } \
+      } \
+   } else { \
+      for (unsigned i = 0; i < count; i++) { \
+         if (indices[i] > max) max = indices[i]; \
+         if (indices[i] < min) min = indices[i]; \
+      } \
+   } \
+   *out_min = min; \
+   *out_max = max; \
+}
+
+INDEX_MINMAX_SCALAR(uint8_t)
+INDEX_MINMAX_SCALAR(uint16_t)
+INDEX_MINMAX_SCALAR(uint32_t)
+
+/* Each vector kernel scans a multiple of 16 bytes from the start, folds the
+ * result into the running min/max and returns the number of indices scanned */
+
+#if defined(UTIL_INDEX_MINMAX_SSE2)
+
+/* SSE2 only has unsigned byte and signed word min/max, so 16 and 32-bit
+ * indices are biased into the signed range */
+
+static inline __m128i
+index_min_epi32(__m128i a, __m128i b)
+{
+#ifdef __SSE4_1__
+   return _mm_min_epi32(a, b);
+#else
+   __m128i gt = _mm_cmpgt_epi32(a, b);
+   return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+#endif
+}
+
+static inline __m128i
+index_max_epi32(__m128i a, __m128i b)
+{
+#ifdef __SSE4_1__
+   return _mm_max_epi32(a, b);
+#else
+   __m128i gt = _mm_cmpgt_epi32(a, b);
+   return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+#endif
+}
+
+#define INDEX_MINMAX_SSE2(type, bits, cmpeq, vmin, vmax, bias_val, type_max) \
+static unsigned \
+index_minmax_vec_##type(const type *indices, unsigned count, \
+                        bool restart, type restart_index, \
+                        type *out_min, type *out_max) \
+{ \
+   const unsigned lanes = 16 / sizeof(type); \
+   const __m128i bias = _mm_set1_epi##bits((type) bias_val); \
+   const __m128i r = _mm_set1_epi##bits(restart_index); \
+   __m128i min = _mm_xor_si128(_mm_set1_epi##bits((type) type_max), bias); \
+   __m128i max = bias; \
+   unsigned i = 0; \
+   \
+   if (restart) { \
+      for (; i + lanes <= count; i += lanes) { \
+         __m128i v = _mm_loadu_si128((const __m128i *) (indices + i)); \
+         __m128i eq = cmpeq(v, r); \
+         min = vmin(min, _mm_xor_si128(_mm_or_si128(v, eq), bias)); \
+         max = vmax(max, _mm_xor_si128(_mm_andnot_si128(eq, v), bias)); \
+      } \
+   } else { \
+      for (; i + lanes <= count; i += lanes) { \
+         __m128i v = _mm_xor_si128( \
+               _mm_loadu_si128((const __m128i *) (indices + i)), bias); \
+         min = vmin(min, v); \
+         max = vmax(max, v); \
+      } \
+   } \
+   \
+   type mins[16 / sizeof(type)], maxs[16 / sizeof(type)]; \
+   _mm_storeu_si128((__m128i *) mins, _mm_xor_si128(min, bias)); \
+   _mm_storeu_si128((__m128i *) maxs, _mm_xor_si128(max, bias)); \
+   \
+   for (unsigned l = 0; l < lanes; ++l) { \
+      *out_min = MIN2(*out_min, mins[l]); \
+      *out_max = MAX2(*out_max, maxs[l]); \
+   } \
+   \
+   return i; \
+}
+
+INDEX_MINMAX_SSE2(uint8_t, 8, _mm_cmpeq_epi8, _mm_min_epu8, _mm_max_epu8,
+                  0, UINT8_MAX)
+INDEX_MINMAX_SSE2(uint16_t, 16, _mm_cmpeq_epi16, _mm_min_epi16, _mm_max_epi16,
+                  0x8000, UINT16_MAX)
+INDEX_MINMAX_SSE2(uint32_t, 32, _mm_cmpeq_epi32, index_min_epi32,
+                  index_max_epi32, 0x80000000, UINT32_MAX)
+
+#elif defined(UTIL_INDEX_MINMAX_NEON)
+
+#define INDEX_MINMAX_NEON(type, vtype, sfx) \
+static unsigned \
+index_minmax_vec_##type(const type *indices, unsigned count, \
+                        bool restart, type restart_index, \
+                        type *out_min, type *out_max) \
+{ \
+   const unsigned lanes = 16 / sizeof(type); \
+   const vtype r = vdupq_n_##sfx(restart_index); \
+   vtype min = vdupq_n_##sfx((type) ~(type) 0); \
+   vtype max = vdupq_n_##sfx(0); \
+   unsigned i = 0; \
+   \
+   if (restart) { \
+      for (; i + lanes <= count; i += lanes) { \
+         vtype v = vld1q_##sfx(indices + i); \
+         vtype eq = vceqq_##sfx(v, r); \
+         min = vminq_##sfx(min, vorrq_##sfx(v, eq)); \
+         max = vmaxq_##sfx(max, vbicq_##sfx(v, eq)); \
+      } \
+   } else { \
+      for (; i + lanes <= count; i += lanes) { \
+         vtype v = vld1q_##sfx(indices + i); \
+         min = vminq_##sfx(min, v); \
+         max = vmaxq_##sfx(max, v); \
+      } \
+   } \
+   \
+   type mins[16 / sizeof(type)], maxs[16 / sizeof(type)]; \
+   vst1q_##sfx(mins, min); \
+   vst1q_##sfx(maxs, max); \
+   \
+   for (unsigned l = 0; l < lanes; ++l) { \
+      *out_min = MIN2(*out_min, mins[l]); \
+      *out_max = MAX2(*out_max, maxs[l]); \
+   } \
+   \
+   return i; \
+}
+
+INDEX_MINMAX_NEON(uint8_t, uint8x16_t, u8)
+INDEX_MINMAX_NEON(uint16_t, uint16x8_t, u16)
+INDEX_MINMAX_NEON(uint32_t, uint32x4_t, u32)
+
+#else
+
+#define INDEX_MINMAX_NONE(type) \
+static unsigned \
+index_minmax_vec_##type(const type *indices, unsigned count, \
+                        bool restart, type restart_index, \
+                        type *out_min, type *out_max) \
+{ \
+   return 0; \
+}
+
+INDEX_MINMAX_NONE(uint8_t)
+INDEX_MINMAX_NONE(uint16_t)
+INDEX_MINMAX_NONE(uint32_t)
+
+#endif
+
+/* A restart index that doesn't fit the index type never matches */
+
+#define INDEX_MINMAX_DISPATCH(type, type_max, vec) { \
+   const type *p = indices; \
+   type min = type_max, max = 0; \
+   bool restart = primitive_restart && restart_index <= type_max; \
+   unsigned done = vec ? index_minmax_vec_##type(p, count, restart, \
+                                                 restart_index, \
+                                                 &min, &max) : 0; \
+   index_minmax_##type(p + done, count - done, restart, restart_index, \
+                       &min, &max); \
+   *out_min_index = min; \
+   *out_max_index = max; \
+   break; \
+}
+
+static inline void
+index_minmax(const void *indices, unsigned index_size, unsigned count,
+             bool primitive_restart, unsigned restart_index,
+             unsigned *out_min_index, unsigned *out_max_index, bool vec)
+{
+   if (!count) {
+      *out_min_index = 0;
+      *out_max_index = 0;
+      return;
+   }
+
+   switch (index_size) {
+   case 4: INDEX_MINMAX_DISPATCH(uint32_t, UINT32_MAX, vec)
+   case 2: INDEX_MINMAX_DISPATCH(uint16_t, UINT16_MAX, vec)
+   case 1: INDEX_MINMAX_DISPATCH(uint8_t, UINT8_MAX, vec)
+   default:
+      unreachable("bad index size");
+   }
+}
+
+void
+util_index_minmax(const void *indices, unsigned index_size, unsigned count,
+                  bool primitive_restart, unsigned restart_index,
+                  unsigned *out_min_index, unsigned *out_max_index)
+{
+   index_minmax(indices, index_size, count, primitive_restart, restart_index,
+                out_min_index, out_max_index, true);
+}
+
+void
+util_index_minmax_scalar(const void *indices, unsigned index_size,
+                         unsigned count, bool primitive_restart,
+                         unsigned restart_index,
+                         unsigned *out_min_index, unsigned *out_max_index)
+{
+   index_minmax(indices, index_size, count, primitive_restart, restart_index,
+                out_min_index, out_max_index, false);
+}
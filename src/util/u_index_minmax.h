@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef U_INDEX_MINMAX_H
+#define U_INDEX_MINMAX_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Find the smallest and largest of \p count indices of \p index_size bytes
+ * (1, 2 or 4), ignoring any equal to \p restart_index if
+ * \p primitive_restart is set.
+ *
+ * If every index is skipped, the minimum is the largest value of the index
+ * type and the maximum is zero. With \p count zero, both are zero.
+ */
+void
+util_index_minmax(const void *indices, unsigned index_size, unsigned count,
+                  bool primitive_restart, unsigned restart_index,
+                  unsigned *out_min_index, unsigned *out_max_index);
+
+/**
+ * Plain C version of util_index_minmax(), for testing and benchmarking.
+ */
+void
+util_index_minmax_scalar(const void *indices, unsigned index_size,
+                         unsigned count, bool primitive_restart,
+                         unsigned restart_index,
+                         unsigned *out_min_index, unsigned *out_max_index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
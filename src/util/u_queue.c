@@ -28,6 +28,7 @@
 
 #include "c11/threads.h"
 #include "util/u_cpu_detect.h"
+#include "util/u_math.h"
 #include "util/os_time.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
@@ -234,6 +235,377 @@ util_queue_fence_destroy(struct util_queue_fence *fence)
 }
 #endif
 
+/****************************************************************************
+ * Work stealing (UTIL_QUEUE_INIT_WORK_STEALING)
+ *
+ * Every thread owns a deque, as in Chase & Lev, "Dynamic Circular
+ * Work-Stealing Deque": the owner pushes and takes jobs at the bottom without
+ * any lock, and other threads steal the oldest jobs at the top with a CAS.
+ * Jobs added from outside the queue are pushed onto a lock-free stack, which
+ * a thread takes whole and moves to its own deque. queue->lock is only taken
+ * by threads going to sleep when they found nothing to run, and to wake them.
+ */
+
+struct util_queue_ws_job {
+   struct util_queue_job job;
+   struct util_queue_ws_job *next; /* in queue->ws_injected */
+};
+
+struct util_queue_deque_array {
+   /* Arrays replaced by a larger one, which thieves may still be reading,
+    * are only freed with the queue.
+    */
+   struct util_queue_deque_array *retired;
+   int64_t mask;
+   struct util_queue_ws_job *slots[];
+};
+
+struct util_queue_deque {
+   int64_t top;
+   /* Keep what the thieves CAS off the cache line the owner writes */
+   char pad[56];
+   int64_t bottom;
+   struct util_queue_deque_array *array;
+   char pad2[48];
+};
+
+/* p_atomic_cmpxchg is a full barrier with every implementation, unlike
+ * p_atomic_read. That's needed between publishing a job and checking for
+ * sleeping threads, and between going to sleep and checking for jobs, or
+ * both sides could miss the other.
+ */
+static inline int
+ws_fenced_read(int *v)
+{
+   return p_atomic_cmpxchg(v, 0, 0);
+}
+
+static struct util_queue_deque_array *
+ws_deque_array_create(int64_t size, struct util_queue_deque_array *retired)
+{
+   struct util_queue_deque_array *array =
+      malloc(sizeof(*array) + size * sizeof(array->slots[0]));
+
+   if (array) {
+      array->retired = retired;
+      array->mask = size - 1;
+   }
+   return array;
+}
+
+/* Returns false if the deque was full and couldn't grow */
+static bool
+ws_deque_push(struct util_queue_deque *deque, struct util_queue_ws_job *job)
+{
+   int64_t b = deque->bottom;
+   int64_t t = p_atomic_read(&deque->top);
+   struct util_queue_deque_array *array = deque->array;
+
+   if (b - t > array->mask) {
+      struct util_queue_deque_array *grown =
+         ws_deque_array_create((array->mask + 1) * 2, array);
+      if (!grown)
+         return false;
+
+      for (int64_t i = t; i < b; i++)
+         grown->slots[i & grown->mask] = array->slots[i & array->mask];
+
+      p_atomic_set(&deque->array, grown);
+      array = grown;
+   }
+
+   p_atomic_set(&array->slots[b & array->mask], job);
+   /* Release: thieves seeing the new bottom see the job */
+   p_atomic_set(&deque->bottom, b + 1);
+   return true;
+}
+
+static struct util_queue_ws_job *
+ws_deque_take(struct util_queue_deque *deque)
+{
+   int64_t b = deque->bottom - 1;
+   struct util_queue_deque_array *array = deque->array;
+   struct util_queue_ws_job *job = NULL;
+
+   /* Claim the bottom job before looking at what thieves took */
+   p_atomic_xchg(&deque->bottom, b);
+   int64_t t = p_atomic_read(&deque->top);
+
+   if (t <= b) {
+      job = array->slots[b & array->mask];
+
+      if (t == b) {
+         /* The last job, which a thief may be stealing too */
+         if (p_atomic_cmpxchg(&deque->top, t, t + 1) != t)
+            job = NULL;
+         p_atomic_set(&deque->bottom, b + 1);
+      }
+   } else {
+      p_atomic_set(&deque->bottom, b + 1);
+   }
+
+   return job;
+}
+
+/* Can fail when racing with another thread, even if the deque isn't empty */
+static struct util_queue_ws_job *
+ws_deque_steal(struct util_queue_deque *deque)
+{
+   int64_t t = p_atomic_read(&deque->top);
+   int64_t b = p_atomic_read(&deque->bottom);
+
+   if (t >= b)
+      return NULL;
+
+   struct util_queue_deque_array *array = p_atomic_read(&deque->array);
+   struct util_queue_ws_job *job =
+      p_atomic_read(&array->slots[t & array->mask]);
+
+   if (p_atomic_cmpxchg(&deque->top, t, t + 1) != t)
+      return NULL;
+
+   return job;
+}
+
+static bool
+ws_deque_is_empty(struct util_queue_deque *deque)
+{
+   return p_atomic_read(&deque->top) >= p_atomic_read(&deque->bottom);
+}
+
+static struct util_queue_deque *
+ws_deques_create(unsigned num_threads, unsigned max_jobs)
+{
+   struct util_queue_deque *deques = calloc(num_threads, sizeof(*deques));
+   if (!deques)
+      return NULL;
+
+   for (unsigned i = 0; i < num_threads; i++) {
+      deques[i].array =
+         ws_deque_array_create(util_next_power_of_two(MAX2(max_jobs, 8)),
+                               NULL);
+      if (!deques[i].array) {
+         while (i--)
+            free(deques[i].array);
+         free(deques);
+         return NULL;
+      }
+   }
+   return deques;
+}
+
+static void
+ws_deques_destroy(struct util_queue_deque *deques, unsigned num_threads)
+{
+   for (unsigned i = 0; i < num_threads; i++) {
+      struct util_queue_deque_array *array = deques[i].array;
+
+      while (array) {
+         struct util_queue_deque_array *retired = array->retired;
+         free(array);
+         array = retired;
+      }
+   }
+   free(deques);
+}
+
+static struct util_queue_ws_job *
+ws_job_create(void *job, struct util_queue_fence *fence,
+              util_queue_execute_func execute,
+              util_queue_execute_func cleanup,
+              const size_t job_size)
+{
+   struct util_queue_ws_job *ws_job = malloc(sizeof(*ws_job));
+
+   if (ws_job) {
+      ws_job->job.job = job;
+      ws_job->job.job_size = job_size;
+      ws_job->job.fence = fence;
+      ws_job->job.execute = execute;
+      ws_job->job.cleanup = cleanup;
+      ws_job->next = NULL;
+   }
+   return ws_job;
+}
+
+static void
+ws_run_job(struct util_queue_ws_job *ws_job, int thread_index)
+{
+   ws_job->job.execute(ws_job->job.job, thread_index);
+   util_queue_fence_signal(ws_job->job.fence);
+   if (ws_job->job.cleanup)
+      ws_job->job.cleanup(ws_job->job.job, thread_index);
+   free(ws_job);
+}
+
+static void
+ws_wake(struct util_queue *queue)
+{
+   if (ws_fenced_read(&queue->ws_num_sleeping)) {
+      mtx_lock(&queue->lock);
+      cnd_signal(&queue->has_queued_cond);
+      mtx_unlock(&queue->lock);
+   }
+}
+
+static bool
+ws_has_work(struct util_queue *queue)
+{
+   if (p_atomic_read(&queue->ws_injected))
+      return true;
+
+   for (unsigned i = 0; i < queue->max_threads; i++) {
+      if (!ws_deque_is_empty(&queue->ws_deques[i]))
+         return true;
+   }
+   return false;
+}
+
+static struct util_queue_ws_job *
+ws_find_job(struct util_queue *queue, int thread_index)
+{
+   struct util_queue_deque *own = &queue->ws_deques[thread_index];
+   struct util_queue_ws_job *ws_job = ws_deque_take(own);
+
+   if (ws_job)
+      return ws_job;
+
+   /* The stack holds the newest job first. Push them in that order, so that
+    * this thread runs the oldest first and thieves take the newest. Jobs
+    * that don't fit are run right away.
+    */
+   ws_job = (struct util_queue_ws_job *)
+            p_atomic_xchg(&queue->ws_injected, (uintptr_t) NULL);
+   if (ws_job) {
+      if (ws_job->next) {
+         while (ws_job->next) {
+            struct util_queue_ws_job *next = ws_job->next;
+            if (!ws_deque_push(own, ws_job))
+               ws_run_job(ws_job, thread_index);
+            ws_job = next;
+         }
+         ws_wake(queue);
+      }
+      return ws_job;
+   }
+
+   /* Start with the next thread's deque, so that thieves spread out */
+   for (unsigned i = 1; i < queue->max_threads; i++) {
+      unsigned victim = (thread_index + i) % queue->max_threads;
+
+      ws_job = ws_deque_steal(&queue->ws_deques[victim]);
+      if (ws_job)
+         return ws_job;
+   }
+   return NULL;
+}
+
+/* Signals the fences of all queued jobs without running them */
+static void
+ws_drain(struct util_queue *queue)
+{
+   struct util_queue_ws_job *ws_job = (struct util_queue_ws_job *)
+      p_atomic_xchg(&queue->ws_injected, (uintptr_t) NULL);
+
+   while (ws_job) {
+      struct util_queue_ws_job *next = ws_job->next;
+      util_queue_fence_signal(ws_job->job.fence);
+      free(ws_job);
+      ws_job = next;
+   }
+
+   for (unsigned i = 0; i < queue->max_threads; i++) {
+      struct util_queue_deque *deque = &queue->ws_deques[i];
+
+      while (!ws_deque_is_empty(deque)) {
+         ws_job = ws_deque_steal(deque);
+         if (ws_job) {
+            util_queue_fence_signal(ws_job->job.fence);
+            free(ws_job);
+         }
+      }
+   }
+}
+
+static void
+util_queue_ws_thread_loop(struct util_queue *queue, int thread_index)
+{
+   while (1) {
+      struct util_queue_ws_job *ws_job = NULL;
+
+      if (thread_index < p_atomic_read(&queue->num_threads))
+         ws_job = ws_find_job(queue, thread_index);
+
+      if (ws_job) {
+         ws_run_job(ws_job, thread_index);
+         continue;
+      }
+
+      mtx_lock(&queue->lock);
+      p_atomic_inc(&queue->ws_num_sleeping);
+      ws_fenced_read(&queue->ws_num_sleeping);
+
+      while (thread_index < queue->num_threads && !ws_has_work(queue)) {
+         if (p_atomic_read(&queue->ws_num_sleeping) == queue->num_threads)
+            cnd_broadcast(&queue->ws_idle_cond);
+         cnd_wait(&queue->has_queued_cond, &queue->lock);
+      }
+
+      p_atomic_dec(&queue->ws_num_sleeping);
+      bool terminate = thread_index >= queue->num_threads;
+      mtx_unlock(&queue->lock);
+
+      if (terminate)
+         break;
+   }
+
+   /* signal remaining jobs if all threads are being terminated */
+   mtx_lock(&queue->lock);
+   if (queue->num_threads == 0)
+      ws_drain(queue);
+   mtx_unlock(&queue->lock);
+}
+
+static void
+util_queue_ws_add_job(struct util_queue *queue,
+                      void *job,
+                      struct util_queue_fence *fence,
+                      util_queue_execute_func execute,
+                      util_queue_execute_func cleanup,
+                      const size_t job_size)
+{
+   struct util_queue_ws_job *ws_job, *head;
+
+   /* Same as without work stealing when shutting down */
+   if (!p_atomic_read(&queue->num_threads))
+      return;
+
+   ws_job = ws_job_create(job, fence, execute, cleanup, job_size);
+   if (!ws_job)
+      return;
+
+   util_queue_fence_reset(fence);
+
+   do {
+      head = (struct util_queue_ws_job *) p_atomic_read(&queue->ws_injected);
+      ws_job->next = head;
+   } while (p_atomic_cmpxchg(&queue->ws_injected, (uintptr_t) head,
+                             (uintptr_t) ws_job) != (uintptr_t) head);
+
+   /* The last thread to exit drains the queue, jobs pushed after that would
+    * never run. The CAS is a full barrier, so if the drain came first, the
+    * thread count it was done for is seen here.
+    */
+   if (!p_atomic_read(&queue->num_threads)) {
+      mtx_lock(&queue->lock);
+      ws_drain(queue);
+      mtx_unlock(&queue->lock);
+      return;
+   }
+
+   ws_wake(queue);
+}
+
 /****************************************************************************
  * util_queue implementation
  */
@@ -275,6 +647,11 @@ util_queue_thread_func(void *input)
       u_thread_setname(name);
    }
 
+   if (queue->flags & UTIL_QUEUE_INIT_WORK_STEALING) {
+      util_queue_ws_thread_loop(queue, thread_index);
+      return 0;
+   }
+
    while (1) {
       struct util_queue_job job;
 
@@ -433,10 +810,16 @@ util_queue_init(struct util_queue *queue,
    queue->num_threads = num_threads;
    queue->max_jobs = max_jobs;
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
-      goto fail;
+   if (flags & UTIL_QUEUE_INIT_WORK_STEALING) {
+      queue->ws_deques = ws_deques_create(num_threads, max_jobs);
+      if (!queue->ws_deques)
+         goto fail;
+   } else {
+      queue->jobs = (struct util_queue_job*)
+                    calloc(max_jobs, sizeof(struct util_queue_job));
+      if (!queue->jobs)
+         goto fail;
+   }
 
    (void) mtx_init(&queue->lock, mtx_plain);
    (void) mtx_init(&queue->finish_lock, mtx_plain);
@@ -444,6 +827,7 @@ util_queue_init(struct util_queue *queue,
    queue->num_queued = 0;
    cnd_init(&queue->has_queued_cond);
    cnd_init(&queue->has_space_cond);
+   cnd_init(&queue->ws_idle_cond);
 
    queue->threads = (thrd_t*) calloc(num_threads, sizeof(thrd_t));
    if (!queue->threads)
@@ -469,11 +853,14 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
+   if (queue->jobs || queue->ws_deques) {
+      cnd_destroy(&queue->ws_idle_cond);
       cnd_destroy(&queue->has_space_cond);
       cnd_destroy(&queue->has_queued_cond);
       mtx_destroy(&queue->lock);
       free(queue->jobs);
+      if (queue->ws_deques)
+         ws_deques_destroy(queue->ws_deques, queue->max_threads);
    }
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
@@ -500,7 +887,7 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
    /* Setting num_threads is what causes the threads to terminate.
     * Then cnd_broadcast wakes them up and they will exit their function.
     */
-   queue->num_threads = keep_num_threads;
+   p_atomic_set(&queue->num_threads, keep_num_threads);
    cnd_broadcast(&queue->has_queued_cond);
    mtx_unlock(&queue->lock);
 
@@ -517,6 +904,12 @@ util_queue_destroy(struct util_queue *queue)
    util_queue_kill_threads(queue, 0, false);
    remove_from_atexit_list(queue);
 
+   if (queue->ws_deques) {
+      ws_drain(queue);
+      ws_deques_destroy(queue->ws_deques, queue->max_threads);
+   }
+
+   cnd_destroy(&queue->ws_idle_cond);
    cnd_destroy(&queue->has_space_cond);
    cnd_destroy(&queue->has_queued_cond);
    mtx_destroy(&queue->finish_lock);
@@ -535,6 +928,11 @@ util_queue_add_job(struct util_queue *queue,
 {
    struct util_queue_job *ptr;
 
+   if (queue->flags & UTIL_QUEUE_INIT_WORK_STEALING) {
+      util_queue_ws_add_job(queue, job, fence, execute, cleanup, job_size);
+      return;
+   }
+
    mtx_lock(&queue->lock);
    if (queue->num_threads == 0) {
       mtx_unlock(&queue->lock);
@@ -608,6 +1006,8 @@ util_queue_add_job(struct util_queue *queue,
  *
  * The function can be used when destroying an object associated with the job
  * when you don't care about the job completion state.
+ *
+ * Jobs can't be taken out of work stealing deques, so those always wait.
  */
 void
 util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
@@ -617,6 +1017,11 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
+   if (queue->flags & UTIL_QUEUE_INIT_WORK_STEALING) {
+      util_queue_fence_wait(fence);
+      return;
+   }
+
    mtx_lock(&queue->lock);
    for (unsigned i = queue->read_idx; i != queue->write_idx;
         i = (i + 1) % queue->max_jobs) {
@@ -645,8 +1050,64 @@ util_queue_finish_execute(void *data, int num_thread)
    util_barrier_wait(barrier);
 }
 
+void
+util_queue_add_child_job(struct util_queue *queue,
+                         int thread_index,
+                         void *job,
+                         struct util_queue_fence *fence,
+                         util_queue_execute_func execute,
+                         util_queue_execute_func cleanup,
+                         const size_t job_size)
+{
+   struct util_queue_ws_job *ws_job = NULL;
+
+   assert(thread_index >= 0 && thread_index < queue->max_threads);
+
+   if (queue->flags & UTIL_QUEUE_INIT_WORK_STEALING)
+      ws_job = ws_job_create(job, fence, execute, cleanup, job_size);
+
+   util_queue_fence_reset(fence);
+
+   if (ws_job && ws_deque_push(&queue->ws_deques[thread_index], ws_job)) {
+      ws_wake(queue);
+      return;
+   }
+
+   /* Without a deque, joining from the only thread could wait forever */
+   if (ws_job) {
+      ws_run_job(ws_job, thread_index);
+   } else {
+      execute(job, thread_index);
+      util_queue_fence_signal(fence);
+      if (cleanup)
+         cleanup(job, thread_index);
+   }
+}
+
+void
+util_queue_join(struct util_queue *queue, int thread_index,
+                struct util_queue_fence *fence)
+{
+   if (queue->flags & UTIL_QUEUE_INIT_WORK_STEALING) {
+      while (!util_queue_fence_is_signalled(fence)) {
+         struct util_queue_ws_job *ws_job = ws_find_job(queue, thread_index);
+
+         /* Nothing left to help with, the job runs on another thread */
+         if (!ws_job)
+            break;
+
+         ws_run_job(ws_job, thread_index);
+      }
+   }
+
+   util_queue_fence_wait(fence);
+}
+
 /**
  * Wait until all previously added jobs have completed.
+ *
+ * With work stealing, jobs don't complete in order, so this waits until
+ * the queue is idle instead.
  */
 void
 util_queue_finish(struct util_queue *queue)
@@ -666,6 +1127,16 @@ util_queue_finish(struct util_queue *queue)
       return;
    }
 
+   if (queue->flags & UTIL_QUEUE_INIT_WORK_STEALING) {
+      mtx_lock(&queue->lock);
+      while (p_atomic_read(&queue->ws_num_sleeping) != queue->num_threads ||
+             ws_has_work(queue))
+         cnd_wait(&queue->ws_idle_cond, &queue->lock);
+      mtx_unlock(&queue->lock);
+      mtx_unlock(&queue->finish_lock);
+      return;
+   }
+
    fences = malloc(queue->num_threads * sizeof(*fences));
    util_barrier_init(&barrier, queue->num_threads);
 
@@ -49,6 +49,12 @@ extern "C" {
 #define UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY      (1 << 0)
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
 #define UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY  (1 << 2)
+/* Each thread runs jobs from a deque of its own and steals from the others'
+ * when it's empty, and adding a job takes no lock. Jobs don't complete in
+ * order, adding never waits (max_jobs is only the initial deque size) and
+ * jobs can add child jobs, see util_queue_add_child_job().
+ */
+#define UTIL_QUEUE_INIT_WORK_STEALING             (1 << 3)
 
 #if UTIL_FUTEX_SUPPORTED
 #define UTIL_QUEUE_FENCE_FUTEX
@@ -199,6 +205,8 @@ struct util_queue_job {
    util_queue_execute_func cleanup;
 };
 
+struct util_queue_deque;
+
 /* Put this into your context. */
 struct util_queue {
    char name[14]; /* 13 characters = the thread name without the index */
@@ -216,6 +224,12 @@ struct util_queue {
    size_t total_jobs_size;  /* memory use of all jobs in the queue */
    struct util_queue_job *jobs;
 
+   /* UTIL_QUEUE_INIT_WORK_STEALING, instead of the ring buffer */
+   struct util_queue_deque *ws_deques; /* one per thread, max_threads */
+   uintptr_t ws_injected;   /* jobs added from outside, a lock-free stack */
+   int ws_num_sleeping;     /* threads waiting in has_queued_cond */
+   cnd_t ws_idle_cond;      /* for util_queue_finish */
+
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
 };
@@ -237,6 +251,25 @@ void util_queue_add_job(struct util_queue *queue,
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
 
+/* From inside a job running on thread_index, adds a job that the same thread
+ * runs next unless an idle thread steals it first. Queues without
+ * UTIL_QUEUE_INIT_WORK_STEALING run it right away instead.
+ */
+void util_queue_add_child_job(struct util_queue *queue,
+                              int thread_index,
+                              void *job,
+                              struct util_queue_fence *fence,
+                              util_queue_execute_func execute,
+                              util_queue_execute_func cleanup,
+                              const size_t job_size);
+
+/* From inside a job running on thread_index, waits for the fence of a child
+ * job, running other queued jobs on the same thread_index meanwhile.
+ */
+void util_queue_join(struct util_queue *queue,
+                     int thread_index,
+                     struct util_queue_fence *fence);
+
 void util_queue_finish(struct util_queue *queue);
 
 /* Adjust the number of active threads. The new number of threads can't be